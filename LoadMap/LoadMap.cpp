@@ -1,538 +1,715 @@
-////////////////////////////////////////////////////////////////////////////////
-/**
- * @file LoadMap.cpp
- * The main implementation file
- * @author TQN (truong_quoc_ngan@yahoo.com)
- * @date 09/11/2004
- * An IDA plugin, which loads a VC/Borland/Dede map file into IDA 4.5
- * Base on the idea of loadmap plugin of Toshiyuki Tega
- * Ver:    1.0 - 09/11/2004 - Initial release
- */
-////////////////////////////////////////////////////////////////////////////////
-
-#include "stdafx.h"
-
-typedef struct _tagPLUGIN_OPTIONS {
-    bool bNameApply;    // true - apply to name, false - apply to comment
-    bool bReplace;      // replace the existing name or comment
-    bool bVerbose;      // show detail messages
-} PLUGIN_OPTIONS;
-
-typedef enum _tagMAP_OPEN_ERROR {
-    OPEN_NO_ERROR = 0,
-    WIN32_ERROR,
-    FILE_EMPTY_ERROR,
-    FILE_BINARY_ERROR
-} MAP_OPEN_ERROR;
-
-// This is where the symbol table starts, do not edit.
-const char VC_HDR_START[]       = "Address         Publics by Value              Rva+Base     Lib:Object";
-const char BL_HDR_NAME_START[]  = "Address         Publics by Name";
-const char BL_HDR_VALUE_START[] = "Address         Publics by Value";
-
-const size_t g_minLineLen = 14; // For a "xxxx:xxxxxxxx " line
-
-static HINSTANCE g_hinstPlugin = NULL;
-static char g_szIniPath[MAX_PATH] = { 0 };
-
-/* Global variable for options of plugin */
-static PLUGIN_OPTIONS g_options = { 0 };
-
-/* Ini Section and Key names */
-static char g_szLoadMapSection[] = "LoadMap";
-static char g_szOptionsKey[] = "Options";
-
-////////////////////////////////////////////////////////////////////////////////
-/// global inline static  SkipSpaces
-/// @brief Seek to non space character at the beginning of a memory buffer
-/// @param  lpStart LPSTR   Pointer to start of buffer
-/// @param  lpEnd LPSTR Pointer to end of buffer
-/// @return LPSTR Pointer to first non space character at the beginning of buffer
-/// @author TQN
-/// @date 09/11/2004
-////////////////////////////////////////////////////////////////////////////////
-static inline LPSTR SkipSpaces(LPCSTR pStart, LPCSTR pEnd)
-{
-    _ASSERTE(pStart != NULL);
-    _ASSERTE(pEnd != NULL);
-    _ASSERTE(pStart <= pEnd);
-
-    LPCSTR p = pStart;
-    while ((p < pEnd) && isspace(*p))
-    {
-        p++;
-    }
-
-    return (LPSTR) p;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-/// global inline static  FindEOLChar
-/// @brief Find the EOL character '\r' or '\n' in a memory buffer
-/// @param  lpStart LPSTR Pointer to start of buffer
-/// @param  lpEnd LPSTR Pointer to end of buffer
-/// @return LPSTR Pointer to first EOL character in the buffer
-/// @author TQN
-/// @date 09/12/2004
-////////////////////////////////////////////////////////////////////////////////
-static inline LPSTR FindEOL(LPCSTR pStart, LPCSTR pEnd)
-{
-    _ASSERTE(pStart != NULL);
-    _ASSERTE(pEnd != NULL);
-    _ASSERTE(pStart <= pEnd);
-
-    LPCSTR p = pStart;
-    while ((p < pEnd) && ('\r' != *p) && ('\n' != *p))
-    {
-        p++;
-    }
-
-    return (LPSTR) p;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-/// global static  ShowMsg
-/// @brief Output a formatted string to messages window [analog of printf()]
-/// only when the verbose flag of plugin's options is true
-/// @param  format const char * printf() style message string.
-/// @return void
-/// @author TQN
-/// @date 09/11/2004
-////////////////////////////////////////////////////////////////////////////////
-static void ShowMsg(const char *format, ...)
-{
-    if (g_options.bVerbose)
-    {
-        va_list va;
-        va_start(va, format);
-        (void) vmsg(format, va);
-        va_end(va);
-    }
-}
-
-////////////////////////////////////////////////////////////////////////////////
-/**
- * @brief Open a map file and map the file content to virtual memory
- * @param lpszFileName  Path name of file to open.
- * @param dwSize Out variable to receive size of file.
- * @param lpMapAddr The pointer to memory address of mapped file
- * @return enum value of OPEN_FILE_ERROR
- * @author TQN
- * @date 09/12/2004
- */
-////////////////////////////////////////////////////////////////////////////////
-static MAP_OPEN_ERROR MapFileOpen(IN LPCSTR lpszFileName,
-                                  OUT LPSTR &lpMapAddr,
-                                  OUT DWORD &dwSize)
-{
-    // Set default values for output parameters
-    lpMapAddr = NULL;
-    dwSize = INVALID_FILE_SIZE;
-
-    // Validate all input pointer parameters
-    _ASSERTE(NULL != lpszFileName);
-    _ASSERTE(FALSE == IsBadStringPtr(lpszFileName, (UINT_PTR) -1));
-    if ((NULL == lpszFileName) || IsBadStringPtr(lpszFileName, (UINT_PTR) -1))
-    {
-        SetLastError(ERROR_INVALID_PARAMETER);
-        return WIN32_ERROR;
-    }
-
-    // Open the file
-    HANDLE hFile = CreateFile(lpszFileName, GENERIC_READ, FILE_SHARE_READ, NULL,
-                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (INVALID_HANDLE_VALUE == hFile)
-    {
-        return WIN32_ERROR;
-    }
-
-    dwSize = GetFileSize(hFile, NULL);
-    if ((INVALID_FILE_SIZE == dwSize) || (0 == dwSize))
-    {
-        // File too large or empty
-        WIN32CHECK(CloseHandle(hFile));
-        return ((0 == dwSize) ? FILE_EMPTY_ERROR : WIN32_ERROR);
-    }
-
-    HANDLE hMap = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
-    if (NULL == hMap)
-    {
-        WIN32CHECK(CloseHandle(hFile));
-        return WIN32_ERROR;
-    }
-
-    // Mapping creation successful, do not need file handle anymore
-    WIN32CHECK(CloseHandle(hFile));
-
-    lpMapAddr = (LPSTR) MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, dwSize);
-    if (NULL == lpMapAddr)
-    {
-        WIN32CHECK(CloseHandle(hMap));
-        return WIN32_ERROR;
-    }
-
-    // Map View successful, do not need the map handle anymore
-    WIN32CHECK(CloseHandle(hMap));
-
-    if (NULL != memchr(lpMapAddr, 0, dwSize))
-    {
-        // File is binary or Unicode file
-        WIN32CHECK(UnmapViewOfFile(lpMapAddr));
-        lpMapAddr = NULL;
-        return FILE_BINARY_ERROR;
-    }
-
-    return OPEN_NO_ERROR;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-/**
- * @brief Close memory map file which opened by MemMapFileOpen function.
- * @param lpAddr: Pointer to memory return by MemMapFileOpen.
- * @author TQN
- * @date 09/12/2004
- */
-////////////////////////////////////////////////////////////////////////////////
-static void MapFileClose(IN LPCVOID lpAddr)
-{
-    WIN32CHECK(UnmapViewOfFile(lpAddr));
-}
-
-/* The DLL entry point of plugin */
-BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID)
-{
-    if (DLL_PROCESS_ATTACH == fdwReason)
-    {
-        WIN32CHECK(DisableThreadLibraryCalls(g_hinstPlugin = hinstDLL));
-    }
-
-    return TRUE;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-/// global static  ShowOptionsDlg
-/// Show options dialog for getting user desired options
-/// @return void
-/// @author TQN
-/// @date 09/11/2004
-////////////////////////////////////////////////////////////////////////////////
-static void ShowOptionsDlg(void)
-{
-    // Build the format string constant used to create the dialog
-    const char format[] =
-        "STARTITEM 0\n"                             // TabStop
-        "LoadMap Options\n"                         // Title
-        "<Apply Map Symbols for Name:R>\n"          // Radio Button 0
-        "<Apply Map Symbols for Comment:R>>\n"    // Radio Button 1
-        "<Replace Existing Names/Comments:C>>\n"  // Checkbox Button
-        "<Show verbose messages:C>>\n\n";           // Checkbox Button
-
-    // Create the option dialog.
-    short name = (g_options.bNameApply ? 0 : 1);
-    short replace = (g_options.bReplace ? 1 : 0);
-    short verbose = (g_options.bVerbose ? 1 : 0);
-    if (AskUsingForm_c(format, &name, &replace, &verbose))
-    {
-        g_options.bNameApply = (0 == name);
-        g_options.bReplace = (1 == replace);
-        g_options.bVerbose = (1 == verbose);
-    }
-}
-
-////////////////////////////////////////////////////////////////////////////////
-/**
- * global static init
- * @brief Plugin initialize function
- * @return PLUGIN_KEEP always
- * @author TQN
- * @date 09/11/2004
- */
-////////////////////////////////////////////////////////////////////////////////
-static int idaapi init(void)
-{
-    msg("\nLoadMap: Plugin init.\n\n");
-
-    // Get the full path of plugin
-    WIN32CHECK(GetModuleFileName(g_hinstPlugin, g_szIniPath, sizeof(g_szIniPath)));
-    g_szIniPath[sizeof(g_szIniPath) - 1] = '\0';
-
-    // Change the extension of plugin to '.ini'
-    _VERIFY(PathRenameExtension(g_szIniPath, ".ini"));
-
-    // Get options saved in ini file
-    _VERIFY(GetPrivateProfileStruct(g_szLoadMapSection, g_szOptionsKey,
-                                    &g_options, sizeof(g_options), g_szIniPath));
-
-    return PLUGIN_KEEP;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-/**
- * global static  run
- * @brief Plugin run function
- * @param   int    Don't used
- * @return void
- * @author TQN
- * @date 09/11/2004
- */
-////////////////////////////////////////////////////////////////////////////////
-static void idaapi run(int /* arg */)
-{
-    static char mapFileName[_MAX_PATH] = { 0 };
-
-    // If user press shift key, show options dialog
-    if (GetAsyncKeyState(VK_SHIFT) & 0x8000)
-    {
-        ShowOptionsDlg();
-    }
-
-    ulong numOfSegs = (ulong) get_segm_qty();
-    if (0 == numOfSegs)
-    {
-        warning("Not found any segments");
-        return;
-    }
-
-    if ('\0' == mapFileName[0])
-    {
-        // First run (after all, mapFileName is static)
-        get_input_file_path(mapFileName, sizeof(mapFileName));
-        WIN32CHECK(PathRenameExtension(mapFileName, ".map"));
-    }
-
-    // Show open map file dialog
-    char *fname = askfile_c(0, mapFileName, "Open MAP file");
-    if (NULL == fname)
-    {
-        msg("LoadMap: User cancel\n");
-        return;
-    }
-
-    // Open the map file
-    LPSTR pMapStart = NULL;
-    DWORD mapSize = INVALID_FILE_SIZE;
-    MAP_OPEN_ERROR eRet = MapFileOpen(fname, pMapStart, mapSize);
-    switch (eRet)
-    {
-        case WIN32_ERROR:
-            warning("Could not open file '%s'.\nWin32 Error Code = 0x%08X",
-                    fname, GetLastError());
-            return;
-
-        case FILE_EMPTY_ERROR:
-            warning("File '%s' is empty, zero size", fname);
-            return;
-
-        case FILE_BINARY_ERROR:
-            warning("File '%s' seem to be a binary or Unicode file", fname);
-            return;
-
-        case OPEN_NO_ERROR:
-        default:
-            break;
-    }
-
-    bool foundHdr = false;
-    ulong validSyms = 0;
-    ulong invalidSyms = 0;
-
-    // The mark pointer to the end of memory map file
-    // all below code must not read or write at and over it
-    LPSTR pMapEnd = pMapStart + mapSize;
-
-    show_wait_box("Parsing and applying symbols from the Map file '%s'", fname);
-
-    __try
-    {
-        LPSTR pLine = pMapStart;
-        LPSTR pEOL = pMapStart;
-        while (pLine < pMapEnd)
-        {
-            // Skip the spaces, '\r', '\n' characters, blank lines, seek to the
-            // non space character at the beginning of a non blank line
-            pLine = SkipSpaces(pEOL, pMapEnd);
-
-            // Find the EOL '\r' or '\n' characters
-            pEOL = FindEOL(pLine, pMapEnd);
-
-            size_t lineLen = (size_t) (pEOL - pLine);
-            if (lineLen < g_minLineLen)
-            {
-                continue;
-            }
-
-            if (!foundHdr)
-            {
-                if ((0 == strnicmp(pLine, VC_HDR_START      , lineLen)) ||
-                    (0 == strnicmp(pLine, BL_HDR_NAME_START , lineLen)) ||
-                    (0 == strnicmp(pLine, BL_HDR_VALUE_START, lineLen)))
-                {
-                    foundHdr = true;
-                }
-            }
-            else
-            {
-                ulong seg = SREG_NUM;
-                ulong addr = BADADDR;
-                char name[MAXNAMELEN + 1];
-                char fmt[80];
-
-                name[0] = '\0';
-                fmt[0] = '\0';
-
-                // Get segment number, address, name, by pass spaces at beginning,
-                // between ':' character, between address and name
-                int ret = _snscanf(pLine, min(lineLen, MAXNAMELEN + g_minLineLen),
-                                   " %04X : %08X %s", &seg, &addr, name);
-                if (3 != ret)
-                {
-                    // we have parsed to end of value/name symbols table or reached EOF
-                    _snprintf(fmt, sizeof(fmt), "Parsing finished at line: '%%.%ds'.\n", lineLen);
-                    ShowMsg(fmt, pLine);
-                    break;
-                }
-                else if ((0 == seg) || (--seg >= numOfSegs) ||
-                        (BADADDR == addr) || ('\0' == name[0]))
-                {
-                    sprintf(fmt, "Invalid map line: %%.%ds.\n", lineLen);
-                    ShowMsg(fmt, pLine);
-
-                    invalidSyms++;
-                }
-                else
-                {
-                    // Ensure name is NULL terminated
-                    name[MAXNAMELEN] = '\0';
-
-                    // Determine the DeDe map file
-                    bool bNameApply = g_options.bNameApply;
-                    char *pname = name;
-                    if (('<' == pname[0]) && ('-' == pname[1]))
-                    {
-                        // Functions indicator symbol of DeDe map
-                        pname += 2;
-                        bNameApply = true;
-                    }
-                    else if ('*' == pname[0])
-                    {
-                        // VCL controls indicator symbol of DeDe map
-                        pname++;
-                        bNameApply = false;
-                    }
-                    else if (('-' == pname[0]) && ('>' == pname[1]))
-                    {
-                        // VCL methods indicator symbol of DeDe map
-                        pname += 2;
-                        bNameApply = false;
-                    }
-
-                    ulong la = addr + getnseg((int) seg)->startEA;
-                    flags_t f = getFlags(la);
-
-                    if (bNameApply) // Apply symbols for name
-                    {
-                        //  Add name if there's no meaningful name assigned.
-                        if (g_options.bReplace ||
-                            (!has_name(f) || has_dummy_name(f) || has_auto_name(f)))
-                        {
-                            if (set_name(la, pname, SN_NOWARN))
-                            {
-                                ShowMsg("%04X:%08X - Change name to '%s' successed\n",
-                                        seg, la, pname);
-                                validSyms++;
-                            }
-                            else
-                            {
-                                ShowMsg("%04X:%08X - Change name to '%s' failed\n",
-                                        seg, la, pname);
-                                invalidSyms++;
-                            }
-                        }
-                    }
-                    else if (g_options.bReplace || !has_cmt(f))
-                    {
-                        // Apply symbols for comment
-                        if (set_cmt(la, pname, false))
-                        {
-                            ShowMsg("%04X:%08X - Change comment to '%s' successed\n",
-                                    seg, la, pname);
-                            validSyms++;
-                        }
-                        else
-                        {
-                            ShowMsg("%04X:%08X - Change comment to '%s' failed\n",
-                                    seg, la, pname);
-                            invalidSyms++;
-                        }
-                    }
-                }
-            }
-        }
-    }
-    __finally
-    {
-        MapFileClose(pMapStart);
-        hide_wait_box();
-    }
-
-    if (!foundHdr)
-    {
-        warning("File '%s' is not a valid Map file", fname);
-    }
-    else
-    {
-        // Save file name for next askfile_c dialog
-        strncpy(mapFileName, fname, sizeof(mapFileName));
-
-        // Show the result
-        msg("Result of loading and parsing the Map file '%s'\n"
-            "   Number of Symbols applied: %d\n"
-            "   Number of Invalid Symbols: %d\n\n",
-            fname, validSyms, invalidSyms);
-    }
-}
-
-////////////////////////////////////////////////////////////////////////////////
-/**
- * global static term
- * @brief Plugin terminate function
- * @return void
- * @author TQN
- * @date 09/11/2004
- */
-////////////////////////////////////////////////////////////////////////////////
-static void idaapi term(void)
-{
-    msg("LoadMap: Plugin terminate.\n");
-
-    // Write the plugin's options to ini file
-    _VERIFY(WritePrivateProfileStruct(g_szLoadMapSection, g_szOptionsKey, &g_options,
-                                      sizeof(g_options), g_szIniPath));
-}
-
-//--------------------------------------------------------------------------
-//  Plugin information.
-//--------------------------------------------------------------------------
-static char wanted_name[]   = "LoadMap - Load Symbols From Map File";
-static char wanted_hotkey[] = "Ctrl-M";
-static char comment[]       = "LoadMap loads symbols from a VC/Borland/Dede map file.";
-static char help[]          = "LoadMap, VC/Borland/Dede map file import plugin."
-                              "This module reads an accompanying map file,\n"
-                              "and loads symbols into IDA database.";
-
-//--------------------------------------------------------------------------
-//  Plugin description block.
-//--------------------------------------------------------------------------
-extern "C" {
-    plugin_t PLUGIN = {
-        IDP_INTERFACE_VERSION,
-        0,                      //  Plugin flags (not used).
-        init,                   //  Initialize.
-        term,                   //  Terminate (not used).
-        run,                    //  Main function.
-        comment,
-        help,
-        wanted_name,
-        wanted_hotkey
-    };
-}
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file LoadMap.cpp
+ * The main implementation file
+ * @author TQN (truong_quoc_ngan@yahoo.com)
+ * @date 09/11/2004
+ * An IDA plugin, which loads a VC/Borland/Dede map file into IDA 4.5
+ * Base on the idea of loadmap plugin of Toshiyuki Tega
+ * Ver:    1.0 - 09/11/2004 - Initial release
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include <stddef.h>
+#include <vector>
+#include "mapfile.h"
+#include "mapapply.h"
+#include "mapindex.h"
+#include "mapparse.h"
+#include "progress.h"
+#include "diaglog.h"
+#include "sdkdb.h"
+
+#define MAP_APPLY_BATCH     1024    // symbols applied between two cancel checks
+#define MAP_REPORT_EXT      ".log"  // appended to the map file name
+
+/* Saved as a struct in the ini file, new options go at the end */
+typedef struct _tagPLUGIN_OPTIONS {
+    bool bNameApply;    // true - apply to name, false - apply to comment
+    bool bReplace;      // replace the existing name or comment
+    bool bVerbose;      // show detail messages
+    bool bUseIndex;     // keep a symbol index file next to the map file
+    bool bReportFile;   // verbose messages go to a report file, not to the output window
+} PLUGIN_OPTIONS;
+
+static HINSTANCE g_hinstPlugin = NULL;
+static char g_szIniPath[MAX_PATH] = { 0 };
+
+/* Counts and times of loading a map file */
+typedef struct _tagMAP_LOAD_STATS {
+    ulong validSyms;    // names and comments applied
+    ulong invalidSyms;  // invalid lines, failed names and comments
+    ulong dupSyms;      // same address and name as a later symbol
+    ulong skippedSyms;  // not applied because the user canceled
+    DWORD parseTime;    // ms, finding the header and parsing the table
+    DWORD applyTime;    // ms, sorting and applying the symbols
+    bool bIndexed;      // the symbols are from the index file
+    bool bApplied;      // the apply phase ran, false if the user canceled before it
+    bool bCanceled;     // the user canceled, a part or none of the symbols were applied
+} MAP_LOAD_STATS;
+
+/* A hash, parse or index write phase of loading a map file, in the wait box */
+typedef struct _tagMAP_PHASE {
+    PROGRESS_METER progress;
+    LPCSTR pszText;     // what the phase does
+    LPCSTR pszUnit;     // of the progress
+    bool bCanceled;     // the user canceled the phase
+} MAP_PHASE;
+
+/* Global variable for options of plugin */
+static PLUGIN_OPTIONS g_options = { 0 };
+
+/* The open database, for the main thread */
+static SDK_DB g_db;
+
+/* The longest parsed name fits the buffer of ApplyMapSymbol */
+C_ASSERT(MAXNAMELEN + 1 <= MAP_NAME_SIZE);
+
+/* Ini Section and Key names */
+static char g_szLoadMapSection[] = "LoadMap";
+static char g_szOptionsKey[] = "Options";
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  FormatEnd
+/// @brief Finish a _snprintf to a diagnostic buffer
+/// @param  pszBuf The buffer
+/// @param  size Size of the buffer
+/// @param  len The return value of _snprintf
+/// @return The length of the text, size - 1 when it was truncated
+////////////////////////////////////////////////////////////////////////////////
+static size_t FormatEnd(char *pszBuf, size_t size, int len)
+{
+    if ((len < 0) || ((size_t) len >= size))
+    {
+        pszBuf[size - 1] = '\0';
+        return size - 1;
+    }
+    return (size_t) len;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  FormatMapMessage
+/// @brief Format a verbose message record for the output window
+/// @param  pszBuf The buffer
+/// @param  size Size of the buffer
+/// @param  rec The record
+/// @return The length of the text
+////////////////////////////////////////////////////////////////////////////////
+static size_t FormatMapMessage(char *pszBuf, size_t size, const DIAG_RECORD &rec)
+{
+    int len;
+    switch (rec.reason)
+    {
+        case MAP_DIAG_INVALID_LINE:
+            len = _snprintf(pszBuf, size, "Invalid map line: %.*s.\n",
+                            (int) rec.nameLen, rec.pName);
+            break;
+
+        case MAP_DIAG_END_LINE:
+            // we have parsed to end of value/name symbols table or reached EOF
+            len = _snprintf(pszBuf, size, "Parsing finished at line: '%.*s'.\n",
+                            (int) rec.nameLen, rec.pName);
+            break;
+
+        default:
+            len = _snprintf(pszBuf, size, "%04X:%08X - Change %s to '%.*s' %s\n",
+                            (uint) rec.values[0], (uint) rec.addr,
+                            (MAP_DIAG_NAME == rec.reason) ? "name" : "comment",
+                            (int) rec.nameLen, rec.pName,
+                            (MAP_DIAG_SUCCEEDED == rec.outcome) ? "successed" : "failed");
+            break;
+    }
+
+    return FormatEnd(pszBuf, size, len);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  FormatMapReport
+/// @brief Format a verbose message record for the report file, as tab
+/// separated segment, address, outcome, reason and name or line
+/// @param  pszBuf The buffer
+/// @param  size Size of the buffer
+/// @param  rec The record
+/// @return The length of the text
+////////////////////////////////////////////////////////////////////////////////
+static size_t FormatMapReport(char *pszBuf, size_t size, const DIAG_RECORD &rec)
+{
+    static const char *const s_reasons[] = { "name", "comment", "invalid", "end" };
+    C_ASSERT(MAP_DIAG_END_LINE + 1 == sizeof(s_reasons) / sizeof(s_reasons[0]));
+
+    int len = _snprintf(pszBuf, size, "%04X\t%08X\t%s\t%s\t%.*s\n",
+                        (uint) rec.values[0], (uint) rec.addr,
+                        (MAP_DIAG_SUCCEEDED == rec.outcome) ? "ok" : "failed",
+                        s_reasons[rec.reason], (int) rec.nameLen, rec.pName);
+
+    return FormatEnd(pszBuf, size, len);
+}
+
+/* Writes a block of verbose messages to the output window */
+static void WriteMsgProc(void * /* ctx */, const char *pszText, size_t /* len */)
+{
+    msg("%s", pszText);
+}
+
+/* Writes a block of verbose messages to a file opened by qfopen */
+static void WriteFileProc(void *ctx, const char *pszText, size_t len)
+{
+    (void) qfwrite((FILE *) ctx, pszText, len);
+}
+
+/* The DLL entry point of plugin */
+BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID)
+{
+    if (DLL_PROCESS_ATTACH == fdwReason)
+    {
+        WIN32CHECK(DisableThreadLibraryCalls(g_hinstPlugin = hinstDLL));
+    }
+
+    return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  ShowOptionsDlg
+/// Show options dialog for getting user desired options
+/// @return void
+/// @author TQN
+/// @date 09/11/2004
+////////////////////////////////////////////////////////////////////////////////
+static void ShowOptionsDlg(void)
+{
+    // Build the format string constant used to create the dialog
+    const char format[] =
+        "STARTITEM 0\n"                             // TabStop
+        "LoadMap Options\n"                         // Title
+        "<Apply Map Symbols for Name:R>\n"          // Radio Button 0
+        "<Apply Map Symbols for Comment:R>>\n"    // Radio Button 1
+        "<Replace Existing Names/Comments:C>>\n"  // Checkbox Button
+        "<Show verbose messages:C>>\n"             // Checkbox Button
+        "<Keep a symbol index next to the Map file:C>\n"     // Checkbox Button
+        "<Write verbose messages to a report file:C>>\n\n"; // Checkbox Button
+
+    // Create the option dialog.
+    short name = (g_options.bNameApply ? 0 : 1);
+    short replace = (g_options.bReplace ? 1 : 0);
+    short verbose = (g_options.bVerbose ? 1 : 0);
+    short files = (short) ((g_options.bUseIndex ? 1 : 0) | (g_options.bReportFile ? 2 : 0));
+    if (AskUsingForm_c(format, &name, &replace, &verbose, &files))
+    {
+        g_options.bNameApply = (0 == name);
+        g_options.bReplace = (1 == replace);
+        g_options.bVerbose = (1 == verbose);
+        g_options.bUseIndex = (0 != (files & 1));
+        g_options.bReportFile = (0 != (files & 2));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * global static init
+ * @brief Plugin initialize function
+ * @return PLUGIN_KEEP always
+ * @author TQN
+ * @date 09/11/2004
+ */
+////////////////////////////////////////////////////////////////////////////////
+static int idaapi init(void)
+{
+    msg("\nLoadMap: Plugin init.\n\n");
+
+    // Pick the SIMD kernels before any worker thread uses them
+    InitMapParser();
+
+    // Get the full path of plugin
+    WIN32CHECK(GetModuleFileName(g_hinstPlugin, g_szIniPath, sizeof(g_szIniPath)));
+    g_szIniPath[sizeof(g_szIniPath) - 1] = '\0';
+
+    // Change the extension of plugin to '.ini'
+    _VERIFY(PathRenameExtension(g_szIniPath, ".ini"));
+
+    // Get options saved in ini file. The ini file of a version before the
+    // index option has only the options up to bUseIndex, the others stay off.
+    PLUGIN_OPTIONS options = g_options;
+    if (GetPrivateProfileStruct(g_szLoadMapSection, g_szOptionsKey,
+                                &options, sizeof(options), g_szIniPath))
+    {
+        g_options = options;
+    }
+    else
+    {
+        _VERIFY(GetPrivateProfileStruct(g_szLoadMapSection, g_szOptionsKey, &g_options,
+                                        offsetof(PLUGIN_OPTIONS, bUseIndex), g_szIniPath));
+    }
+
+    return PLUGIN_KEEP;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  ShowProgress
+/// @brief Show the progress of applying the symbols in the wait box
+/// @param  progress The progress of the apply loop
+/// @return true if the user canceled
+////////////////////////////////////////////////////////////////////////////////
+static bool ShowProgress(const PROGRESS_METER &progress)
+{
+    char szStatus[128];
+    progress.Format(szStatus, sizeof(szStatus), "symbols");
+    replace_wait_box("Applying symbols from the Map file\n%s", szStatus);
+
+    return wasBreak();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  StartPhase
+/// @brief Start the progress of a phase before the apply loop
+/// @param  phase The phase
+/// @param  pszText What the phase does, shown in the wait box
+/// @param  total Units of the whole phase
+/// @param  pszUnit The unit of the progress
+/// @return void
+////////////////////////////////////////////////////////////////////////////////
+static void StartPhase(MAP_PHASE &phase, LPCSTR pszText, uint64_t total, LPCSTR pszUnit)
+{
+    phase.progress.Start(total);
+    phase.pszText = pszText;
+    phase.pszUnit = pszUnit;
+    phase.bCanceled = false;
+    replace_wait_box("%s", pszText);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  ShowPhaseProc
+/// @brief PFN_MAP_PROGRESS of the phases, shows the progress in the wait box
+/// and checks for a user cancel when a report is due
+/// @param  ctx MAP_PHASE
+/// @param  done Units done
+/// @return true if the user canceled
+////////////////////////////////////////////////////////////////////////////////
+static bool ShowPhaseProc(void *ctx, uint64_t done)
+{
+    MAP_PHASE &phase = *(MAP_PHASE *) ctx;
+    if (phase.progress.Update(done))
+    {
+        char szStatus[128];
+        phase.progress.Format(szStatus, sizeof(szStatus), phase.pszUnit);
+        replace_wait_box("%s\n%s", phase.pszText, szStatus);
+        phase.bCanceled = wasBreak();
+    }
+
+    return phase.bCanceled;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * global static  ParseMapSymbols
+ * @brief Find the symbol tables of a map file and parse the "Publics by
+ * Value" table, or the "Publics by Name" table if there is no other one, on
+ * the worker threads
+ * @param mapFile The map file
+ * @param params The parameters of the parse, the dialect is set from the
+ * header line
+ * @param symbols Out, the symbols in file order
+ * @param phase Out, the progress of the parse, bCanceled if the user
+ * canceled it, the symbols are incomplete then
+ * @return FILE_NO_TABLE_ERROR if the symbol table header was not found,
+ * FILE_BINARY_ERROR if the file has a NUL character before the table ends
+ */
+////////////////////////////////////////////////////////////////////////////////
+static MAP_OPEN_ERROR ParseMapSymbols(const MAP_FILE_VIEW &mapFile, MAP_PARSE_PARAMS &params,
+                                      std::vector<MAP_SYMBOL> &symbols, MAP_PHASE &phase)
+{
+    // The mark pointer to the end of memory map file
+    // all below code must not read or write at and over it
+    LPCSTR pMapStart = mapFile.pData;
+    LPCSTR pMapEnd = pMapStart + mapFile.size;
+
+    MAP_TABLES tables;
+    if (!FindMapTables(pMapStart, pMapEnd, tables))
+    {
+        return (NULL != tables.pNul) ? FILE_BINARY_ERROR : FILE_NO_TABLE_ERROR;
+    }
+
+    // Both tables have the same symbols, the "Publics by Value" table is
+    // already in the address order of the apply phase
+    LPCSTR pTable = tables.pByValue;
+    params.dialect = tables.valueDialect;
+    if (NULL == pTable)
+    {
+        pTable = tables.pByName;
+        params.dialect = MAP_DIALECT_BORLAND;
+    }
+
+    if ((NULL != tables.pNul) && (tables.pNul < pTable))
+    {
+        // File is binary or Unicode file
+        return FILE_BINARY_ERROR;
+    }
+
+    // The IDA SDK is not thread safe, the worker threads only parse the text
+    // and the progress is shown on this thread between the rounds of chunks
+    StartPhase(phase, "Parsing the symbols of the Map file", (uint64_t) (pMapEnd - pTable),
+               "bytes");
+    WORKER_POOL workers;
+    workers.Start(0);
+    bool bText = ParseMapTable(pTable, pMapEnd, params, workers, symbols, ShowPhaseProc, &phase);
+    workers.Stop();
+
+    return bText ? OPEN_NO_ERROR : FILE_BINARY_ERROR;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * global static  ApplyMapSymbols
+ * @brief Read the symbols of a map file from its index file or parse them,
+ * then apply the symbols to the database in address order
+ * @param mapFile The map file
+ * @param pszIndexName Path name of the index file, NULL to parse the map
+ * file without an index
+ * @param pszReportName Path name of the report file of the verbose
+ * messages, NULL to show them in the output window
+ * @param indexView Out, the view of the index file, the names of the
+ * symbols are in it, closed by the caller
+ * @param numOfSegs Number of segments in the database
+ * @param stats Out, counts and times of the phases. A user cancel is
+ * checked while the map file is hashed, parsed and its index written, and
+ * between the batches of MAP_APPLY_BATCH symbols, a batch is always
+ * applied as a whole
+ * @return FILE_NO_TABLE_ERROR if the symbol table header was not found,
+ * FILE_BINARY_ERROR if the file has a NUL character before the table ends
+ */
+////////////////////////////////////////////////////////////////////////////////
+static MAP_OPEN_ERROR ApplyMapSymbols(const MAP_FILE_VIEW &mapFile, LPCSTR pszIndexName,
+                                      LPCSTR pszReportName, MAP_FILE_VIEW &indexView,
+                                      ulong numOfSegs, MAP_LOAD_STATS &stats)
+{
+    DWORD dwStart = GetTickCount();
+
+    MAP_PARSE_PARAMS params;
+    params.badAddr = (uint64_t) BADADDR;
+    params.maxNameLen = MAXNAMELEN;
+    params.dialect = MAP_DIALECT_BORLAND;
+
+    std::vector<MAP_SYMBOL> symbols;
+    MAP_INDEX_KEY key = { 0 };
+    MAP_PHASE phase;
+    phase.bCanceled = false;
+    if (NULL != pszIndexName)
+    {
+        StartPhase(phase, "Hashing the Map file", (uint64_t) mapFile.size, "bytes");
+        if (GetMapIndexKey(mapFile, params, key, ShowPhaseProc, &phase))
+        {
+            stats.bIndexed = LoadMapIndex(pszIndexName, key, mapFile, indexView, symbols);
+        }
+    }
+
+    if (!stats.bIndexed && !phase.bCanceled)
+    {
+        MAP_OPEN_ERROR eRet = ParseMapSymbols(mapFile, params, symbols, phase);
+        if (OPEN_NO_ERROR != eRet)
+        {
+            return eRet;
+        }
+
+        if ((NULL != pszIndexName) && !phase.bCanceled)
+        {
+            StartPhase(phase, "Writing the symbol index of the Map file",
+                       (uint64_t) symbols.size(), "symbols");
+            if (!SaveMapIndex(pszIndexName, key, mapFile, symbols, ShowPhaseProc, &phase) &&
+                !phase.bCanceled)
+            {
+                msg("LoadMap: Could not write the symbol index '%s'.\n", pszIndexName);
+            }
+        }
+    }
+
+    DWORD dwParsed = GetTickCount();
+    stats.parseTime = dwParsed - dwStart;
+
+    // A cancel before the apply phase applies no symbol
+    if (phase.bCanceled)
+    {
+        stats.bCanceled = true;
+        return OPEN_NO_ERROR;
+    }
+    stats.bApplied = true;
+    replace_wait_box("Applying symbols from the Map file");
+
+    // Resolve the segment bases once
+    std::vector<uint64_t> segBases(numOfSegs);
+    for (ulong seg = 0; seg < numOfSegs; seg++)
+    {
+        DB_SEGMENT dbSeg = { 0 };
+        _VERIFY(g_db.GetSegment(seg, dbSeg));
+        segBases[seg] = dbSeg.startEA;
+    }
+
+    // The valid symbols of the segments which are in the database by
+    // address, the other lines in file order
+    std::vector<MAP_APPLY_ITEM> items;
+    std::vector<const MAP_SYMBOL *> lines;
+    stats.dupSyms = (ulong) PrepareMapApply(symbols, segBases, items, lines);
+
+    // The verbose messages are kept as records and written in blocks, to
+    // the output window or to the report file
+    FILE *fpReport = NULL;
+    if (g_options.bVerbose && (NULL != pszReportName))
+    {
+        fpReport = qfopen(pszReportName, "wb");
+        if (NULL == fpReport)
+        {
+            msg("LoadMap: Could not create the report file '%s'.\n", pszReportName);
+        }
+    }
+    DIAG_LOG diag(FormatMapMessage, WriteMsgProc, NULL, MAXSTR - 1);
+    if (NULL != fpReport)
+    {
+        diag.SetOutput(FormatMapReport, WriteFileProc, fpReport);
+    }
+    DIAG_LOG *pDiag = g_options.bVerbose ? &diag : NULL;
+
+    // Report the invalid lines in file order
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        const MAP_SYMBOL &sym = *lines[i];
+        bool bEnd = (MAP_SYMBOL_END == sym.kind);
+        if (!bEnd)
+        {
+            stats.invalidSyms++;
+        }
+
+        if (NULL != pDiag)
+        {
+            pDiag->Add((uint16_t) MAP_DIAG_FAILED,
+                       (uint16_t) (bEnd ? MAP_DIAG_END_LINE : MAP_DIAG_INVALID_LINE),
+                       0, sym.pLine, sym.lineLen);
+        }
+    }
+
+    MAP_APPLY_OPTIONS applyOptions;
+    applyOptions.bNameApply = g_options.bNameApply;
+    applyOptions.bReplace = g_options.bReplace;
+
+    // A cancel after the last progress check stops before the first batch
+    PROGRESS_METER progress;
+    progress.Start((uint64_t) items.size());
+    stats.bCanceled = wasBreak();
+    size_t i = 0;
+    while (!stats.bCanceled && (i < items.size()))
+    {
+        size_t end = min(i + MAP_APPLY_BATCH, items.size());
+        for (; i < end; i++)
+        {
+            MAP_APPLY_RESULT eApply = ApplyMapSymbol(g_db, *items[i].pSym, items[i].la,
+                                                     applyOptions, pDiag);
+            if (MAP_APPLY_APPLIED == eApply)
+            {
+                stats.validSyms++;
+            }
+            else if (MAP_APPLY_FAILED == eApply)
+            {
+                stats.invalidSyms++;
+            }
+        }
+
+        if (progress.Update((uint64_t) i))
+        {
+            stats.bCanceled = ShowProgress(progress);
+        }
+    }
+    stats.skippedSyms = (ulong) (items.size() - i);
+
+    diag.Flush();
+    if (NULL != fpReport)
+    {
+        (void) qfclose(fpReport);
+    }
+
+    stats.applyTime = GetTickCount() - dwParsed;
+    return OPEN_NO_ERROR;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * global static  run
+ * @brief Plugin run function
+ * @param   int    Don't used
+ * @return void
+ * @author TQN
+ * @date 09/11/2004
+ */
+////////////////////////////////////////////////////////////////////////////////
+static void idaapi run(int /* arg */)
+{
+    static char mapFileName[_MAX_PATH] = { 0 };
+
+    // If user press shift key, show options dialog
+    if (GetAsyncKeyState(VK_SHIFT) & 0x8000)
+    {
+        ShowOptionsDlg();
+    }
+
+    ulong numOfSegs = (ulong) g_db.GetSegmentCount();
+    if (0 == numOfSegs)
+    {
+        warning("Not found any segments");
+        return;
+    }
+
+    if ('\0' == mapFileName[0])
+    {
+        // First run (after all, mapFileName is static)
+        get_input_file_path(mapFileName, sizeof(mapFileName));
+        WIN32CHECK(PathRenameExtension(mapFileName, ".map"));
+    }
+
+    // Show open map file dialog
+    char *fname = askfile_c(0, mapFileName, "Open MAP file");
+    if (NULL == fname)
+    {
+        msg("LoadMap: User cancel\n");
+        return;
+    }
+
+    // Open the map file
+    MAP_FILE_VIEW mapFile;
+    MAP_OPEN_ERROR eRet = MapFileOpen(fname, MAP_FILE_SEQUENTIAL, mapFile);
+    switch (eRet)
+    {
+        case WIN32_ERROR:
+            warning("Could not open file '%s'.\nWin32 Error Code = 0x%08X",
+                    fname, GetLastError());
+            return;
+
+        case FILE_EMPTY_ERROR:
+            warning("File '%s' is empty, zero size", fname);
+            return;
+
+        case FILE_BINARY_ERROR:
+            warning("File '%s' seem to be a binary or Unicode file", fname);
+            return;
+
+        case FILE_TOO_LARGE_ERROR:
+            warning("File '%s' is too large to be loaded", fname);
+            return;
+
+        case FILE_NO_TABLE_ERROR:
+        case OPEN_NO_ERROR:
+        default:
+            break;
+    }
+
+    MAP_LOAD_STATS stats = { 0 };
+
+    // The symbol index file is the map file name with MAP_INDEX_EXT
+    char indexName[_MAX_PATH + sizeof(MAP_INDEX_EXT)];
+    LPCSTR pszIndexName = NULL;
+    if (g_options.bUseIndex)
+    {
+        _snprintf(indexName, sizeof(indexName), "%s%s", fname, MAP_INDEX_EXT);
+        indexName[sizeof(indexName) - 1] = '\0';
+        pszIndexName = indexName;
+    }
+    MAP_FILE_VIEW indexView = { 0 };
+
+    // The report file is the map file name with MAP_REPORT_EXT
+    char reportName[_MAX_PATH + sizeof(MAP_REPORT_EXT)];
+    LPCSTR pszReportName = NULL;
+    if (g_options.bReportFile)
+    {
+        _snprintf(reportName, sizeof(reportName), "%s%s", fname, MAP_REPORT_EXT);
+        reportName[sizeof(reportName) - 1] = '\0';
+        pszReportName = reportName;
+    }
+
+    show_wait_box("Parsing and applying symbols from the Map file '%s'", fname);
+
+    __try
+    {
+        eRet = ApplyMapSymbols(mapFile, pszIndexName, pszReportName, indexView,
+                               numOfSegs, stats);
+    }
+    __finally
+    {
+        MapFileClose(indexView);
+        MapFileClose(mapFile);
+        hide_wait_box();
+    }
+
+    if (FILE_BINARY_ERROR == eRet)
+    {
+        warning("File '%s' seem to be a binary or Unicode file", fname);
+    }
+    else if (FILE_NO_TABLE_ERROR == eRet)
+    {
+        warning("File '%s' is not a valid Map file", fname);
+    }
+    else if (!stats.bApplied)
+    {
+        msg("LoadMap: User cancel, no symbols were applied.\n\n");
+    }
+    else
+    {
+        // Save file name for next askfile_c dialog
+        strncpy(mapFileName, fname, sizeof(mapFileName));
+
+        // Show the result
+        msg("Result of loading and parsing the Map file '%s'\n"
+            "   Number of Symbols applied: %d\n"
+            "   Number of Invalid Symbols: %d\n"
+            "   Number of Duplicate Symbols: %d\n"
+            "   Parse time: %u ms%s, apply time: %u ms\n\n",
+            fname, stats.validSyms, stats.invalidSyms, stats.dupSyms,
+            stats.parseTime, stats.bIndexed ? " (read from the symbol index)" : "",
+            stats.applyTime);
+
+        if (stats.bCanceled)
+        {
+            msg("LoadMap: User cancel, %u symbols were not applied.\n\n", stats.skippedSyms);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * global static term
+ * @brief Plugin terminate function
+ * @return void
+ * @author TQN
+ * @date 09/11/2004
+ */
+////////////////////////////////////////////////////////////////////////////////
+static void idaapi term(void)
+{
+    msg("LoadMap: Plugin terminate.\n");
+
+    // Write the plugin's options to ini file
+    _VERIFY(WritePrivateProfileStruct(g_szLoadMapSection, g_szOptionsKey, &g_options,
+                                      sizeof(g_options), g_szIniPath));
+}
+
+//--------------------------------------------------------------------------
+//  Plugin information.
+//--------------------------------------------------------------------------
+static char wanted_name[]   = "LoadMap - Load Symbols From Map File";
+static char wanted_hotkey[] = "Ctrl-M";
+static char comment[]       = "LoadMap loads symbols from a VC/Borland/Dede map file.";
+static char help[]          = "LoadMap, VC/Borland/Dede map file import plugin."
+                              "This module reads an accompanying map file,\n"
+                              "and loads symbols into IDA database.";
+
+//--------------------------------------------------------------------------
+//  Plugin description block.
+//--------------------------------------------------------------------------
+extern "C" {
+    plugin_t PLUGIN = {
+        IDP_INTERFACE_VERSION,
+        0,                      //  Plugin flags (not used).
+        init,                   //  Initialize.
+        term,                   //  Terminate (not used).
+        run,                    //  Main function.
+        comment,
+        help,
+        wanted_name,
+        wanted_hotkey
+    };
+}
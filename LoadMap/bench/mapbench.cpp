@@ -0,0 +1,412 @@
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file mapbench.cpp
+ * Benchmark of the LoadMap phases on map files, for example the files of
+ * mapgen. Times MapFileOpen, the header search, the parse of the symbol
+ * table, the hash of the map file, the save and the load of the symbol
+ * index, the apply order and the apply loop separately. A load from the
+ * index costs the hash and LoadMapIndex, the first load the parse, the
+ * hash and SaveMapIndex. The apply loop runs ApplyMapSymbol of the
+ * plugin against a MEM_DB in memory, with empty segments at the bases of
+ * the segments of the map file. The first pass also checks that a parse
+ * of the table as a single chunk gives the same records as the chunked one.
+ * Reports ns per byte of the map file and symbols per second, and writes
+ * the results as CSV. The CSV files of two builds can be compared:
+ *     mapbench [-p passes] [-t threads] [-a name|comment] [-r]
+ *              [-o results.csv] file.map...
+ *     mapbench -c base.csv new.csv
+ *   -a  apply the symbols without a DeDe prefix as names or comments
+ *   -r  replace the names and comments of the database
+ * The symbol index is written next to the map file and deleted again.
+ * Does not need IDA, build it from the LoadMap directory with
+ *     g++ -O2 -pthread -I. -I../common bench/mapbench.cpp mapfile.cpp
+ *         mapparse.cpp mapindex.cpp mapapply.cpp -o mapbench
+ * or
+ *     cl /O2 /EHsc /I. /I..\common bench\mapbench.cpp mapfile.cpp
+ *         mapparse.cpp mapindex.cpp mapapply.cpp
+ * @author TQN (truong_quoc_ngan@yahoo.com)
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "mapfile.h"
+#include "mapparse.h"
+#include "mapindex.h"
+#include "mapapply.h"
+#include "memdb.h"
+#include "threads.h"
+#include "benchres.h"
+
+#define PASSES              3           // default passes of each map file
+#define BENCH_MAX_NAME_LEN  512         // MAXNAMELEN of the IDA SDK
+#define BENCH_BADADDR       0xFFFFFFFFULL
+#define BENCH_IMAGE_BASE    0x401000
+#define BENCH_SEG_SIZE      0x10000000  // address space of a segment
+
+/* Counts of the apply loop, as MAP_LOAD_STATS of the plugin */
+typedef struct _tagBENCH_STATS {
+    size_t validSyms;
+    size_t invalidSyms;
+    size_t dupSyms;
+} BENCH_STATS;
+
+static BENCH_RESULTS g_results;
+static int g_passes = PASSES;
+
+/* The same symbol from the parse and from the index */
+static bool SameSymbol(const MAP_SYMBOL &a, const MAP_SYMBOL &b)
+{
+    return (a.pLine == b.pLine) && (a.kind == b.kind) &&
+           ((MAP_SYMBOL_VALID != a.kind) ||
+            ((a.seg == b.seg) && (a.addr == b.addr) && (a.target == b.target) &&
+             (a.nameLen == b.nameLen) && (0 == memcmp(a.pName, b.pName, a.nameLen))));
+}
+
+/* The index is in address order, the parse in file order */
+static bool FileOrderLess(const MAP_SYMBOL &a, const MAP_SYMBOL &b)
+{
+    return (a.pLine < b.pLine);
+}
+
+/* Progress of the chunked parse, never stops it */
+static bool NoStopProgressProc(void * /* ctx */, uint64_t /* done */)
+{
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  CheckSingleChunk
+/// @brief Parse the table once as a single chunk, on one thread without a
+/// progress callback, and compare it record by record with the chunked parse
+/// @param  pszFile Name of the map file for the messages
+/// @param  pTable First line of the symbol table
+/// @param  pMapEnd End of the map file
+/// @param  params Parameters of the parse
+/// @param  workers The pool of the timed parse
+/// @param  symbols The symbols of the timed parse
+/// @return The number of failed checks
+////////////////////////////////////////////////////////////////////////////////
+static int CheckSingleChunk(const char *pszFile, const char *pTable, const char *pMapEnd,
+                            const MAP_PARSE_PARAMS &params, WORKER_POOL &workers,
+                            const std::vector<MAP_SYMBOL> &symbols)
+{
+    WORKER_POOL serial;
+    serial.Start(1);
+    std::vector<MAP_SYMBOL> single;
+    bool bSingle = ParseMapTable(pTable, pMapEnd, params, serial, single, NULL, NULL);
+    serial.Stop();
+
+    // With one thread the timed parse was a single chunk too, a progress
+    // callback splits the table into chunks
+    std::vector<MAP_SYMBOL> chunked;
+    bool bChunked = true;
+    if (workers.GetThreadCount() <= 1)
+    {
+        bChunked = ParseMapTable(pTable, pMapEnd, params, workers, chunked,
+                                 NoStopProgressProc, NULL);
+    }
+    const std::vector<MAP_SYMBOL> &parsed = (workers.GetThreadCount() <= 1) ? chunked : symbols;
+
+    if (!bSingle || !bChunked || (single.size() != parsed.size()))
+    {
+        printf("FAILED: %s: single chunk parse %d, chunked %d, %u of %u symbols\n", pszFile,
+               bSingle, bChunked, (unsigned int) single.size(), (unsigned int) parsed.size());
+        return 1;
+    }
+
+    for (size_t i = 0; i < single.size(); i++)
+    {
+        if (!SameSymbol(single[i], parsed[i]))
+        {
+            printf("FAILED: %s: symbol %u of the single chunk parse differs\n", pszFile,
+                   (unsigned int) i);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  BenchMapFile
+/// @brief Run all phases on a map file g_passes times and add their times
+/// @return The number of failed checks, or -1 if the file could not be used
+////////////////////////////////////////////////////////////////////////////////
+static int BenchMapFile(const char *pszFile, const MAP_APPLY_OPTIONS &options,
+                        WORKER_POOL &workers)
+{
+    enum { T_OPEN, T_FIND, T_PARSE, T_KEY, T_SAVE, T_LOAD, T_PREPARE, T_APPLY, T_CLOSE, T_COUNT };
+    double t[T_COUNT] = { 0 };
+    double fileSize = 0, tableOff = 0, searched = 0;
+    size_t numSyms = 0;
+    BENCH_STATS stats = { 0, 0, 0 };
+    int errors = 0;
+
+    std::string indexName = std::string(pszFile) + MAP_INDEX_EXT;
+    MEM_DB db;
+    for (int p = 0; p < g_passes; p++)
+    {
+        db.Clear();
+        double t0 = BenchNow();
+        MAP_FILE_VIEW mapFile;
+        MAP_OPEN_ERROR eRet = MapFileOpen(pszFile, MAP_FILE_SEQUENTIAL, mapFile);
+        if (OPEN_NO_ERROR != eRet)
+        {
+            printf("Could not open %s, error %d\n", pszFile, (int) eRet);
+            return -1;
+        }
+        double t1 = BenchNow();
+
+        // As ParseMapSymbols of the plugin
+        MAP_PARSE_PARAMS params;
+        params.badAddr = BENCH_BADADDR;
+        params.maxNameLen = BENCH_MAX_NAME_LEN;
+        params.dialect = MAP_DIALECT_BORLAND;
+
+        const char *pMapEnd = mapFile.pData + mapFile.size;
+        MAP_TABLES tables;
+        bool bFound = FindMapTables(mapFile.pData, pMapEnd, tables);
+        const char *pTable = tables.pByValue;
+        params.dialect = tables.valueDialect;
+        if (NULL == pTable)
+        {
+            pTable = tables.pByName;
+            params.dialect = MAP_DIALECT_BORLAND;
+        }
+        double t2 = BenchNow();
+        if (!bFound || ((NULL != tables.pNul) && (tables.pNul < pTable)))
+        {
+            printf("%s has no symbol table or is not a text file\n", pszFile);
+            MapFileClose(mapFile);
+            return -1;
+        }
+
+        std::vector<MAP_SYMBOL> symbols;
+        bool bText = ParseMapTable(pTable, pMapEnd, params, workers, symbols, NULL, NULL);
+        double t3 = BenchNow();
+
+        // The plugin hashes the map file before every load, with or without an index
+        MAP_INDEX_KEY key;
+        (void) GetMapIndexKey(mapFile, params, key, NULL, NULL);
+        double t4 = BenchNow();
+
+        bool bSaved = SaveMapIndex(indexName.c_str(), key, mapFile, symbols, NULL, NULL);
+        double t5 = BenchNow();
+
+        MAP_FILE_VIEW indexView;
+        std::vector<MAP_SYMBOL> indexed;
+        bool bLoaded = LoadMapIndex(indexName.c_str(), key, mapFile, indexView, indexed);
+        double t6 = BenchNow();
+
+        // One segment per segment number of the map file
+        unsigned int numSegs = 0;
+        for (size_t i = 0; i < symbols.size(); i++)
+        {
+            if ((MAP_SYMBOL_VALID == symbols[i].kind) && (symbols[i].seg >= numSegs))
+            {
+                numSegs = symbols[i].seg + 1;
+            }
+        }
+        std::vector<uint64_t> segBases(numSegs);
+        for (unsigned int seg = 0; seg < numSegs; seg++)
+        {
+            segBases[seg] = BENCH_IMAGE_BASE + (uint64_t) seg * BENCH_SEG_SIZE;
+            (void) db.AddSegment((db_ea_t) segBases[seg],
+                                 (db_ea_t) (segBases[seg] + BENCH_SEG_SIZE), false, "");
+        }
+
+        std::vector<MAP_APPLY_ITEM> items;
+        std::vector<const MAP_SYMBOL *> lines;
+        size_t numDups = PrepareMapApply(symbols, segBases, items, lines);
+        double t7 = BenchNow();
+
+        db.Reserve(items.size());
+        BENCH_STATS passStats = { 0, 0, numDups };
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            MAP_APPLY_RESULT eApply = ApplyMapSymbol(db, *items[i].pSym, items[i].la, options,
+                                                     NULL);
+            if (MAP_APPLY_APPLIED == eApply)
+            {
+                passStats.validSyms++;
+            }
+            else if (MAP_APPLY_FAILED == eApply)
+            {
+                passStats.invalidSyms++;
+            }
+        }
+        double t8 = BenchNow();
+
+        if (0 == p)
+        {
+            if (!bText || !bSaved || !bLoaded || (indexed.size() != symbols.size()))
+            {
+                printf("FAILED: %s: parse %d, index save %d, load %d, %u of %u symbols\n",
+                       pszFile, bText, bSaved, bLoaded, (unsigned int) indexed.size(),
+                       (unsigned int) symbols.size());
+                errors++;
+            }
+            else
+            {
+                std::vector<MAP_SYMBOL> sorted(indexed);
+                std::stable_sort(sorted.begin(), sorted.end(), FileOrderLess);
+                for (size_t i = 0; i < symbols.size(); i++)
+                {
+                    if (!SameSymbol(symbols[i], sorted[i]))
+                    {
+                        printf("FAILED: %s: symbol %u of the index differs\n", pszFile,
+                               (unsigned int) i);
+                        errors++;
+                        break;
+                    }
+                }
+            }
+
+            errors += CheckSingleChunk(pszFile, pTable, pMapEnd, params, workers, symbols);
+
+            fileSize = (double) mapFile.size;
+            tableOff = (double) (pTable - mapFile.pData);
+            // The search ends at the "Publics by Value" header or at the end
+            searched = (double) ((NULL != tables.pByValue) ? tables.pByValue - mapFile.pData
+                                                           : (ptrdiff_t) mapFile.size);
+            numSyms = symbols.size();
+            stats = passStats;
+            stats.invalidSyms += lines.size();
+        }
+
+        MapFileClose(indexView);
+        MapFileClose(mapFile);
+        (void) remove(indexName.c_str());
+        double t9 = BenchNow();
+
+        t[T_OPEN] += t1 - t0;
+        t[T_FIND] += t2 - t1;
+        t[T_PARSE] += t3 - t2;
+        t[T_KEY] += t4 - t3;
+        t[T_SAVE] += t5 - t4;
+        t[T_LOAD] += t6 - t5;
+        t[T_PREPARE] += t7 - t6;
+        t[T_APPLY] += t8 - t7;
+        t[T_CLOSE] += t9 - t8;
+    }
+
+    const char *pszSet = strrchr(pszFile, '/');
+    pszSet = (NULL != pszSet) ? pszSet + 1 : pszFile;
+    const char *pszSet2 = strrchr(pszSet, '\\');
+    pszSet = (NULL != pszSet2) ? pszSet2 + 1 : pszSet;
+    printf("%s: %.0f bytes, %u lines, %u applied, %u invalid or failed, %u duplicates\n",
+           pszSet, fileSize, (unsigned int) numSyms, (unsigned int) stats.validSyms,
+           (unsigned int) stats.invalidSyms, (unsigned int) stats.dupSyms);
+
+    double bytes = fileSize * g_passes;
+    double syms = (double) numSyms * g_passes;
+    g_results.Add("MapFileOpen", pszSet, bytes, 0, t[T_OPEN], "symbols");
+    g_results.Add("FindMapTables", pszSet, searched * g_passes, 0, t[T_FIND], "symbols");
+    g_results.Add("ParseMapTable", pszSet, bytes - tableOff * g_passes, syms, t[T_PARSE],
+                  "symbols");
+    g_results.Add("GetMapIndexKey", pszSet, bytes, 0, t[T_KEY], "symbols");
+    g_results.Add("SaveMapIndex", pszSet, bytes, syms, t[T_SAVE], "symbols");
+    g_results.Add("LoadMapIndex", pszSet, bytes, syms, t[T_LOAD], "symbols");
+    g_results.Add("PrepareMapApply", pszSet, bytes, syms, t[T_PREPARE], "symbols");
+    g_results.Add("ApplyMapSymbol", pszSet, bytes, syms, t[T_APPLY], "symbols");
+    g_results.Add("MapFileClose", pszSet, bytes, 0, t[T_CLOSE], "symbols");
+
+    return errors;
+}
+
+static void Usage(void)
+{
+    printf("Usage: mapbench [-p passes] [-t threads] [-a name|comment] [-r]\n"
+           "                [-o results.csv] file.map...\n"
+           "       mapbench -c base.csv new.csv\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *pszCsv = NULL;
+    unsigned int threads = 0;
+    MAP_APPLY_OPTIONS options = { true, false };
+    std::vector<const char *> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((0 == strcmp(argv[i], "-c")) && (i + 2 < argc))
+        {
+            return BENCH_RESULTS::Compare(argv[i + 1], argv[i + 2]);
+        }
+        else if ((0 == strcmp(argv[i], "-p")) && (i + 1 < argc))
+        {
+            g_passes = atoi(argv[++i]);
+        }
+        else if ((0 == strcmp(argv[i], "-t")) && (i + 1 < argc))
+        {
+            threads = (unsigned int) atoi(argv[++i]);
+        }
+        else if ((0 == strcmp(argv[i], "-a")) && (i + 1 < argc))
+        {
+            options.bNameApply = (0 != strcmp(argv[++i], "comment"));
+        }
+        else if (0 == strcmp(argv[i], "-r"))
+        {
+            options.bReplace = true;
+        }
+        else if ((0 == strcmp(argv[i], "-o")) && (i + 1 < argc))
+        {
+            pszCsv = argv[++i];
+        }
+        else if ('-' != argv[i][0])
+        {
+            files.push_back(argv[i]);
+        }
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+    if (files.empty())
+    {
+        Usage();
+        return 1;
+    }
+    if (g_passes <= 0)
+    {
+        g_passes = PASSES;
+    }
+
+    InitMapParser();
+    WORKER_POOL workers;
+    workers.Start(threads);
+    printf("%u parse threads\n", workers.GetThreadCount());
+
+    int errors = 0;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        int ret = BenchMapFile(files[i], options, workers);
+        if (ret < 0)
+        {
+            workers.Stop();
+            return 1;
+        }
+        errors += ret;
+    }
+    workers.Stop();
+
+    if (errors > 0)
+    {
+        printf("FAILED: %d checks of the parse and the index\n", errors);
+        return 1;
+    }
+    if ((NULL != pszCsv) && !g_results.WriteCsv(pszCsv))
+    {
+        printf("Could not write %s\n", pszCsv);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,454 @@
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file mapgen.cpp
+ * Synthetic map file generator for the LoadMap benchmarks.
+ * Writes VC, Borland and DeDe style map files with any number of symbols,
+ * names of a given length distribution and a preamble of junk lines, so
+ * the parser can be measured on maps of every size and dialect:
+ *     mapgen [-f vc|borland|byname|dede] [-n symbols] [-l min:max] [-u]
+ *            [-j junkKB] [-g segments] [-s seed] file.map
+ *   -f  vc       "Publics by Value" with Rva+Base and Lib:Object columns
+ *       borland  "Publics by Name" and "Publics by Value" tables
+ *       byname   only the "Publics by Name" table
+ *       dede     "Publics by Value" with the DeDe name prefixes
+ *   -l  name lengths, log-uniform between min and max, -u for uniform
+ *   -j  KB of junk lines before the segment table, some of them with the
+ *       words of the table headers
+ * The symbols are spread over the segments with 16 bytes per symbol, the
+ * same seed makes the same file.
+ * Does not need IDA, build it from the LoadMap directory with
+ *     g++ -O2 bench/mapgen.cpp -o mapgen
+ * or
+ *     cl /O2 /EHsc bench\mapgen.cpp
+ * @author TQN (truong_quoc_ngan@yahoo.com)
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define GEN_BUF_SIZE        0x100000    // bytes written at once
+#define GEN_MAX_NAME_LEN    1024
+#define GEN_SYMBOL_SPACE    16          // bytes of a segment per symbol
+#define GEN_IMAGE_BASE      0x400000
+#define GEN_SEG_ALIGN       0x1000
+
+typedef enum _tagGEN_FORMAT {
+    GEN_VC = 0,
+    GEN_BORLAND,
+    GEN_BYNAME,
+    GEN_DEDE
+} GEN_FORMAT;
+
+/* What to generate */
+typedef struct _tagGEN_PARAMS {
+    GEN_FORMAT format;
+    uint64_t numSyms;
+    unsigned int minNameLen;
+    unsigned int maxNameLen;
+    bool bUniform;              // uniform name lengths, else log-uniform
+    uint64_t junkBytes;
+    unsigned int numSegs;
+    uint64_t seed;
+} GEN_PARAMS;
+
+/* Buffered output file */
+typedef struct _tagGEN_OUT {
+    FILE *fp;
+    std::vector<char> buf;
+    size_t used;
+    bool bError;
+} GEN_OUT;
+
+static const char VC_HEADER[]       = "  Address         Publics by Value              Rva+Base     Lib:Object";
+static const char BL_NAME_HEADER[]  = "  Address         Publics by Name";
+static const char BL_VALUE_HEADER[] = "  Address         Publics by Value";
+
+static const char *const g_junkLines[] = {
+    " Address space layout of the image is %08X",
+    " address of the entry point %08X",
+    " Publics are listed by value after the segments %08X",
+    "  Address         Publics of module %08X",
+    " Detailed map of segments %08X",
+    " Line numbers for Unit%08X(Unit.pas) segment .text",
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  Mix
+/// @brief splitmix64 finalizer, the hash of a symbol number
+////////////////////////////////////////////////////////////////////////////////
+static inline uint64_t Mix(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static void Flush(GEN_OUT &out)
+{
+    if ((out.used > 0) && (fwrite(&out.buf[0], 1, out.used, out.fp) != out.used))
+    {
+        out.bError = true;
+    }
+    out.used = 0;
+}
+
+static void Put(GEN_OUT &out, const char *pText, size_t len)
+{
+    if (out.buf.size() - out.used < len)
+    {
+        Flush(out);
+    }
+    memcpy(&out.buf[out.used], pText, len);
+    out.used += len;
+}
+
+static void PutLine(GEN_OUT &out, const char *pszLine)
+{
+    Put(out, pszLine, strlen(pszLine));
+    Put(out, "\r\n", 2);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  MakeName
+/// @brief Make the name of a symbol, the same for the same symbol number
+/// @param  params What to generate
+/// @param  k Symbol number
+/// @param  pszName Out, at least GEN_MAX_NAME_LEN + 3 chars
+/// @return Length of the name
+////////////////////////////////////////////////////////////////////////////////
+static size_t MakeName(const GEN_PARAMS &params, uint64_t k, char *pszName)
+{
+    static const char vcChars[] =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_@?$";
+    static const char blChars[] =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+
+    uint64_t h = Mix(params.seed ^ (k * 0xD6E8FEB86659FD93ULL));
+    double x = (double) (h >> 11) / 9007199254740992.0;
+    size_t len;
+    if (params.bUniform)
+    {
+        len = params.minNameLen + (size_t) (x * (params.maxNameLen - params.minNameLen + 1));
+    }
+    else
+    {
+        double lo = log((double) params.minNameLen);
+        double hi = log((double) params.maxNameLen + 1);
+        len = (size_t) exp(lo + (hi - lo) * x);
+    }
+    len = (len < params.minNameLen) ? params.minNameLen : len;
+    len = (len > params.maxNameLen) ? params.maxNameLen : len;
+
+    char *p = pszName;
+    if (GEN_DEDE == params.format)
+    {
+        // "<-" functions, "*" VCL controls, "->" VCL methods
+        unsigned int kind = (unsigned int) (Mix(h) % 10);
+        const char *pszPrefix = (kind < 6) ? "<-" : ((kind < 8) ? "*" : "->");
+        while ('\0' != *pszPrefix)
+        {
+            *p++ = *pszPrefix++;
+        }
+    }
+
+    bool bVC = (GEN_VC == params.format);
+    for (size_t i = 0; i < len; i++)
+    {
+        if ((0 == (i & 7)) && (i > 0))
+        {
+            h = Mix(h);
+        }
+        unsigned int c = (unsigned int) (h >> ((i & 7) * 8)) & 0xFF;
+        if (!bVC && (i > 0) && (i + 1 < len) && (0 == c % 11) && (p[-1] != '.'))
+        {
+            // Unit.Class.Method
+            *p++ = '.';
+        }
+        else if (bVC)
+        {
+            *p++ = ((0 == i) && (c & 1)) ? '?' : vcChars[c % (sizeof(vcChars) - 1)];
+        }
+        else
+        {
+            *p++ = blChars[c % (sizeof(blChars) - 1)];
+        }
+    }
+    *p = '\0';
+
+    return (size_t) (p - pszName);
+}
+
+static void PutJunk(GEN_OUT &out, const GEN_PARAMS &params)
+{
+    char line[128];
+    uint64_t written = 0;
+    for (uint64_t i = 0; written < params.junkBytes; i++)
+    {
+        uint64_t h = Mix(params.seed + i);
+        const char *pszFormat = g_junkLines[h % (sizeof(g_junkLines) / sizeof(g_junkLines[0]))];
+        int len = sprintf(line, pszFormat, (unsigned int) (h >> 32));
+        PutLine(out, line);
+        written += (uint64_t) len + 2;
+    }
+}
+
+static void PutSymbol(GEN_OUT &out, const GEN_PARAMS &params, uint64_t k, uint64_t perSeg,
+                      const std::vector<uint64_t> &segBases)
+{
+    char name[GEN_MAX_NAME_LEN + 3];
+    char line[GEN_MAX_NAME_LEN + 128];
+
+    unsigned int seg = (unsigned int) (k / perSeg);
+    uint64_t h = Mix(params.seed ^ k);
+    unsigned int addr = (unsigned int) ((k % perSeg) * GEN_SYMBOL_SPACE + (h % GEN_SYMBOL_SPACE));
+    (void) MakeName(params, k, name);
+
+    int len;
+    if (GEN_VC == params.format)
+    {
+        // Static functions of the library objects are "f i"
+        len = sprintf(line, " %04X:%08X       %-26s %08X %s   %s%u.obj", seg + 1, addr, name,
+                      (unsigned int) (segBases[seg] + addr), (h & 0x100) ? "f i" : "f  ",
+                      (h & 0x200) ? "libcmt:obj" : "module", (unsigned int) (h >> 48) & 0xFF);
+    }
+    else
+    {
+        len = sprintf(line, " %04X:%08X       %s", seg + 1, addr, name);
+    }
+    Put(out, line, (size_t) len);
+    Put(out, "\r\n", 2);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  PutTable
+/// @brief Write a symbol table, by value or in the random address order of
+/// a table sorted by name
+////////////////////////////////////////////////////////////////////////////////
+static void PutTable(GEN_OUT &out, const GEN_PARAMS &params, const char *pszHeader,
+                     bool bByName, uint64_t perSeg, const std::vector<uint64_t> &segBases)
+{
+    PutLine(out, "");
+    PutLine(out, pszHeader);
+    PutLine(out, "");
+
+    if (!bByName)
+    {
+        for (uint64_t k = 0; k < params.numSyms; k++)
+        {
+            PutSymbol(out, params, k, perSeg, segBases);
+        }
+    }
+    else
+    {
+        // An odd multiplier permutes [0, 2^n), the numbers over numSyms are skipped
+        uint64_t mask = 1;
+        while (mask < params.numSyms)
+        {
+            mask <<= 1;
+        }
+        mask--;
+        uint64_t add = Mix(params.seed) & mask;
+        for (uint64_t i = 0; i <= mask; i++)
+        {
+            uint64_t k = (i * 0x9E3779B97F4A7C15ULL + add) & mask;
+            if (k < params.numSyms)
+            {
+                PutSymbol(out, params, k, perSeg, segBases);
+            }
+        }
+    }
+    PutLine(out, "");
+}
+
+static bool Generate(const GEN_PARAMS &params, const char *pszFile)
+{
+    GEN_OUT out;
+    out.fp = fopen(pszFile, "wb");
+    if (NULL == out.fp)
+    {
+        return false;
+    }
+    out.buf.resize(GEN_BUF_SIZE);
+    out.used = 0;
+    out.bError = false;
+
+    uint64_t perSeg = (params.numSyms + params.numSegs - 1) / params.numSegs;
+    perSeg = (0 == perSeg) ? 1 : perSeg;
+    uint64_t segLen = perSeg * GEN_SYMBOL_SPACE;
+    segLen = (segLen + GEN_SEG_ALIGN - 1) & ~(uint64_t) (GEN_SEG_ALIGN - 1);
+    std::vector<uint64_t> segBases(params.numSegs);
+    for (unsigned int seg = 0; seg < params.numSegs; seg++)
+    {
+        segBases[seg] = GEN_IMAGE_BASE + GEN_SEG_ALIGN + seg * segLen;
+    }
+
+    char line[256];
+    bool bVC = (GEN_VC == params.format);
+    PutLine(out, bVC ? " bench" : "");
+    if (bVC)
+    {
+        PutLine(out, "");
+        PutLine(out, " Timestamp is 4d8c7d2a (Fri Mar 25 12:00:00 2011)");
+        PutLine(out, "");
+        sprintf(line, " Preferred load address is %08X", GEN_IMAGE_BASE);
+        PutLine(out, line);
+    }
+    PutLine(out, "");
+    PutJunk(out, params);
+    PutLine(out, " Start         Length     Name                   Class");
+    for (unsigned int seg = 0; seg < params.numSegs; seg++)
+    {
+        sprintf(line, " %04X:%08X %08XH %-22s CODE", seg + 1,
+                bVC ? 0 : (unsigned int) segBases[seg], (unsigned int) segLen,
+                bVC ? ".text" : "CODE");
+        PutLine(out, line);
+    }
+
+    switch (params.format)
+    {
+    case GEN_VC:
+        PutTable(out, params, VC_HEADER, false, perSeg, segBases);
+        PutLine(out, " entry point at        0001:00000000");
+        PutLine(out, "");
+        PutLine(out, " Static symbols");
+        PutLine(out, "");
+        PutLine(out, " 0001:00000010       _static_func               00401010 f   module.obj");
+        break;
+
+    case GEN_BORLAND:
+        PutTable(out, params, BL_NAME_HEADER, true, perSeg, segBases);
+        PutTable(out, params, BL_VALUE_HEADER, false, perSeg, segBases);
+        break;
+
+    case GEN_BYNAME:
+        PutTable(out, params, BL_NAME_HEADER, true, perSeg, segBases);
+        break;
+
+    default:
+        PutTable(out, params, BL_VALUE_HEADER, false, perSeg, segBases);
+        break;
+    }
+    if (!bVC)
+    {
+        PutLine(out, "");
+        PutLine(out, "Line numbers for System(System.pas) segment CODE");
+        PutLine(out, "");
+        PutLine(out, "  1234 0001:00000010");
+        PutLine(out, "");
+        sprintf(line, "Program entry point at 0001:%08X", 0);
+        PutLine(out, line);
+    }
+
+    Flush(out);
+    bool bOk = !out.bError;
+    bOk = (0 == fclose(out.fp)) && bOk;
+    return bOk;
+}
+
+static void Usage(void)
+{
+    printf("Usage: mapgen [-f vc|borland|byname|dede] [-n symbols] [-l min:max] [-u]\n"
+           "              [-j junkKB] [-g segments] [-s seed] file.map\n");
+}
+
+int main(int argc, char *argv[])
+{
+    GEN_PARAMS params;
+    params.format = GEN_VC;
+    params.numSyms = 100000;
+    params.minNameLen = 4;
+    params.maxNameLen = 48;
+    params.bUniform = false;
+    params.junkBytes = 0;
+    params.numSegs = 4;
+    params.seed = 1;
+
+    const char *pszFile = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        const char *pszArg = argv[i];
+        const char *pszValue = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (0 == strcmp(pszArg, "-u"))
+        {
+            params.bUniform = true;
+            continue;
+        }
+        if (('-' != pszArg[0]) && (NULL == pszFile))
+        {
+            pszFile = pszArg;
+            continue;
+        }
+        if (NULL == pszValue)
+        {
+            Usage();
+            return 1;
+        }
+
+        i++;
+        if (0 == strcmp(pszArg, "-f"))
+        {
+            static const char *const formats[] = { "vc", "borland", "byname", "dede" };
+            size_t f = 0;
+            while ((f < sizeof(formats) / sizeof(formats[0])) && (0 != strcmp(pszValue, formats[f])))
+            {
+                f++;
+            }
+            if (f == sizeof(formats) / sizeof(formats[0]))
+            {
+                Usage();
+                return 1;
+            }
+            params.format = (GEN_FORMAT) f;
+        }
+        else if (0 == strcmp(pszArg, "-n"))
+        {
+            params.numSyms = strtoull(pszValue, NULL, 10);
+        }
+        else if (0 == strcmp(pszArg, "-l"))
+        {
+            if ((2 != sscanf(pszValue, "%u:%u", &params.minNameLen, &params.maxNameLen)) ||
+                (0 == params.minNameLen) || (params.minNameLen > params.maxNameLen) ||
+                (params.maxNameLen > GEN_MAX_NAME_LEN))
+            {
+                printf("Name lengths must be 1 <= min <= max <= %u\n", GEN_MAX_NAME_LEN);
+                return 1;
+            }
+        }
+        else if (0 == strcmp(pszArg, "-j"))
+        {
+            params.junkBytes = strtoull(pszValue, NULL, 10) * 1024;
+        }
+        else if (0 == strcmp(pszArg, "-g"))
+        {
+            params.numSegs = (unsigned int) atoi(pszValue);
+        }
+        else if (0 == strcmp(pszArg, "-s"))
+        {
+            params.seed = strtoull(pszValue, NULL, 10);
+        }
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+    if ((NULL == pszFile) || (0 == params.numSegs) || (params.numSegs > 0xFFFF) ||
+        ((params.numSyms + params.numSegs - 1) / params.numSegs * GEN_SYMBOL_SPACE > 0xFFFFF000ULL))
+    {
+        Usage();
+        return 1;
+    }
+
+    if (!Generate(params, pszFile))
+    {
+        printf("Could not write %s\n", pszFile);
+        return 1;
+    }
+    return 0;
+}
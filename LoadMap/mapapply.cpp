@@ -0,0 +1,188 @@
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file mapapply.cpp
+ * Apply order of the LoadMap plugin.
+ * @author TQN (truong_quoc_ngan@yahoo.com)
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <algorithm>
+
+#include "mapapply.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+/// global inline static  ApplyItemLess
+/// @brief Order of the apply phase: by address, then in file order
+////////////////////////////////////////////////////////////////////////////////
+static inline bool ApplyItemLess(const MAP_APPLY_ITEM &a, const MAP_APPLY_ITEM &b)
+{
+    return (a.la < b.la) || ((a.la == b.la) && (a.pSym->pLine < b.pSym->pLine));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global inline static  LineLess
+/// @brief File order of two symbols
+////////////////////////////////////////////////////////////////////////////////
+static inline bool LineLess(const MAP_SYMBOL *a, const MAP_SYMBOL *b)
+{
+    return (a->pLine < b->pLine);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global inline static  CompareNames
+/// @brief Order of the targets and names of two symbols
+////////////////////////////////////////////////////////////////////////////////
+static inline int CompareNames(const MAP_SYMBOL &a, const MAP_SYMBOL &b)
+{
+    if (a.target != b.target)
+    {
+        return (a.target < b.target) ? -1 : 1;
+    }
+
+    int ret = memcmp(a.pName, b.pName, min(a.nameLen, b.nameLen));
+    if (0 == ret)
+    {
+        ret = (a.nameLen < b.nameLen) ? -1 : ((a.nameLen > b.nameLen) ? 1 : 0);
+    }
+
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  DropDuplicates
+/// @brief Drop the symbols with the same address, target and name as the
+/// next symbol at that address in file order.
+/// Applying such a symbol twice in a row gives the same name or comment as
+/// applying it once, with or without the replace option. A copy with
+/// another symbol of that address between them stays, the other symbol may
+/// be replaced by it, or keep it from being applied.
+/// @param  items The valid symbols in apply order, out, without duplicates
+/// @return Number of dropped symbols
+////////////////////////////////////////////////////////////////////////////////
+static size_t DropDuplicates(std::vector<MAP_APPLY_ITEM> &items)
+{
+    size_t numItems = 0;
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        if ((i + 1 < items.size()) && (items[i].la == items[i + 1].la) &&
+            (0 == CompareNames(*items[i].pSym, *items[i + 1].pSym)))
+        {
+            continue;
+        }
+        items[numItems++] = items[i];
+    }
+
+    size_t numDups = items.size() - numItems;
+    items.resize(numItems);
+    return numDups;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global  PrepareMapApply
+/// @brief Resolve, deduplicate and order the symbols for the apply phase
+/// @param  symbols The parsed symbols
+/// @param  segBases Start addresses of the segments of the database, the
+/// symbols of the other segments are invalid
+/// @param  items Out, the valid symbols in apply order
+/// @param  lines Out, the other symbols in file order
+/// @return Number of dropped duplicates
+////////////////////////////////////////////////////////////////////////////////
+size_t PrepareMapApply(const std::vector<MAP_SYMBOL> &symbols,
+                       const std::vector<uint64_t> &segBases,
+                       std::vector<MAP_APPLY_ITEM> &items,
+                       std::vector<const MAP_SYMBOL *> &lines)
+{
+    items.clear();
+    lines.clear();
+    items.reserve(symbols.size());
+    for (size_t i = 0; i < symbols.size(); i++)
+    {
+        const MAP_SYMBOL &sym = symbols[i];
+        if ((MAP_SYMBOL_VALID != sym.kind) || (sym.seg >= segBases.size()))
+        {
+            lines.push_back(&sym);
+            continue;
+        }
+
+        MAP_APPLY_ITEM item;
+        item.la = sym.addr + segBases[sym.seg];
+        item.pSym = &sym;
+        items.push_back(item);
+    }
+
+    // The index keeps the symbols by address
+    std::sort(lines.begin(), lines.end(), LineLess);
+
+    // Apply in address order, the database pages are visited once
+    std::sort(items.begin(), items.end(), ApplyItemLess);
+    size_t numDups = DropDuplicates(items);
+
+    return numDups;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global  ApplyMapSymbol
+/// @brief Apply a valid map symbol as the name or the comment of an address
+/// @param  db The database
+/// @param  sym The parsed symbol
+/// @param  la Linear address of the symbol
+/// @param  options Name or comment, and if the existing one is replaced
+/// @param  pDiag The verbose messages, NULL if not verbose
+/// @return MAP_APPLY_SKIPPED if the address keeps its name or comment
+////////////////////////////////////////////////////////////////////////////////
+MAP_APPLY_RESULT ApplyMapSymbol(IDA_DB &db, const MAP_SYMBOL &sym, uint64_t la,
+                                const MAP_APPLY_OPTIONS &options, DIAG_LOG *pDiag)
+{
+    char name[MAP_NAME_SIZE];
+
+    // The name is not NULL terminated in the map file
+    size_t nameLen = min(sym.nameLen, (size_t) (MAP_NAME_SIZE - 1));
+    memcpy(name, sym.pName, nameLen);
+    name[nameLen] = '\0';
+
+    // The parser removed the DeDe prefix of the name
+    bool bNameApply = options.bNameApply;
+    if (MAP_TARGET_NAME == sym.target)
+    {
+        bNameApply = true;
+    }
+    else if (MAP_TARGET_COMMENT == sym.target)
+    {
+        bNameApply = false;
+    }
+
+    uint32_t flags = db.GetFlags((db_ea_t) la);
+
+    bool bApplied;
+    if (bNameApply) // Apply symbols for name
+    {
+        //  Add name if there's no meaningful name assigned.
+        if (!options.bReplace && (0 != (flags & DB_HAS_NAME)) &&
+            (0 == (flags & (DB_HAS_DUMMY_NAME | DB_HAS_AUTO_NAME))))
+        {
+            return MAP_APPLY_SKIPPED;
+        }
+        bApplied = db.SetName((db_ea_t) la, name);
+    }
+    else if (options.bReplace || (0 == (flags & DB_HAS_CMT)))
+    {
+        // Apply symbols for comment
+        bApplied = db.SetCmt((db_ea_t) la, name);
+    }
+    else
+    {
+        return MAP_APPLY_SKIPPED;
+    }
+
+    if (NULL != pDiag)
+    {
+        pDiag->Add((uint16_t) (bApplied ? MAP_DIAG_SUCCEEDED : MAP_DIAG_FAILED),
+                   (uint16_t) (bNameApply ? MAP_DIAG_NAME : MAP_DIAG_COMMENT),
+                   la, sym.pName, sym.nameLen, sym.seg);
+    }
+
+    return bApplied ? MAP_APPLY_APPLIED : MAP_APPLY_FAILED;
+}
@@ -0,0 +1,82 @@
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file mapapply.h
+ * Apply order of the LoadMap plugin.
+ * The parsed symbols are resolved to linear addresses, the valid symbols
+ * are sorted by address and the duplicates are dropped, so the database
+ * pages are visited once when they are applied. The lines which are not
+ * valid symbols are kept in file order for the messages.
+ * A symbol is applied through the IDA_DB, the plugin passes the open
+ * database and the benchmark a MEM_DB.
+ * Does not call the IDA SDK.
+ * @author TQN (truong_quoc_ngan@yahoo.com)
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __LOADMAP_MAPAPPLY_H__
+#define __LOADMAP_MAPAPPLY_H__
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "idadb.h"
+#include "diaglog.h"
+#include "mapparse.h"
+
+#define MAP_NAME_SIZE   1024    // longest name applied, with the NUL
+
+/* Verbose message records, values[0] is the segment of the address */
+typedef enum _tagMAP_DIAG_REASON {
+    MAP_DIAG_NAME,          // change the name of an address
+    MAP_DIAG_COMMENT,       // change the comment of an address
+    MAP_DIAG_INVALID_LINE,  // the name is the map line
+    MAP_DIAG_END_LINE       // the name is the line which ended the table
+} MAP_DIAG_REASON;
+
+typedef enum _tagMAP_DIAG_OUTCOME {
+    MAP_DIAG_SUCCEEDED,
+    MAP_DIAG_FAILED
+} MAP_DIAG_OUTCOME;
+
+/* How the symbols are applied, from the plugin options */
+typedef struct _tagMAP_APPLY_OPTIONS {
+    bool bNameApply;        // true - apply to name, false - apply to comment
+    bool bReplace;          // replace the existing name or comment
+} MAP_APPLY_OPTIONS;
+
+/* Result of applying a symbol */
+typedef enum _tagMAP_APPLY_RESULT {
+    MAP_APPLY_SKIPPED,      // the address keeps its name or comment
+    MAP_APPLY_APPLIED,
+    MAP_APPLY_FAILED
+} MAP_APPLY_RESULT;
+
+/* A valid symbol and its linear address */
+typedef struct _tagMAP_APPLY_ITEM {
+    uint64_t la;                // linear address
+    const MAP_SYMBOL *pSym;
+} MAP_APPLY_ITEM;
+
+/*
+ * Resolve the symbols with the start addresses of the segments. The valid
+ * symbols of the segments go to items, by address then in file order,
+ * without the symbols with the same address, target and name as the next
+ * symbol at that address. The other symbols go to lines, in file order. Returns the number
+ * of dropped duplicates.
+ */
+size_t PrepareMapApply(const std::vector<MAP_SYMBOL> &symbols,
+                       const std::vector<uint64_t> &segBases,
+                       std::vector<MAP_APPLY_ITEM> &items,
+                       std::vector<const MAP_SYMBOL *> &lines);
+
+/*
+ * Apply a valid symbol as the name or the comment of its address, and
+ * add the verbose message of an applied or failed symbol to pDiag.
+ */
+MAP_APPLY_RESULT ApplyMapSymbol(IDA_DB &db, const MAP_SYMBOL &sym, uint64_t la,
+                                const MAP_APPLY_OPTIONS &options, DIAG_LOG *pDiag);
+
+#endif  // __LOADMAP_MAPAPPLY_H__
@@ -0,0 +1,409 @@
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file mapfile.cpp
+ * Read only view of a whole map file for the LoadMap parser.
+ * A mapped file is paged in by the parse threads as they touch it, a file
+ * which can not be mapped is read in blocks of READ_BLOCK_SIZE bytes.
+ * Only the first MAP_PROBE_SIZE bytes are checked here, the parser finds the
+ * NUL characters in the rest of the file while it reads the lines.
+ * @author TQN (truong_quoc_ngan@yahoo.com)
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+#include "mapfile.h"
+
+#define READ_BLOCK_SIZE     0x100000
+
+#ifdef _WIN32
+typedef HANDLE FILE_HANDLE;
+#else
+typedef int FILE_HANDLE;
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  ReadBlock
+/// @brief Read at most READ_BLOCK_SIZE bytes from the current file position
+/// @param  hFile The open file
+/// @param  pBuf Buffer to receive the bytes
+/// @param  len Bytes to read
+/// @param  numRead Out, bytes read, 0 at the end of the file
+/// @return false on a read error
+////////////////////////////////////////////////////////////////////////////////
+static bool ReadBlock(FILE_HANDLE hFile, char *pBuf, size_t len, size_t &numRead)
+{
+#ifdef _WIN32
+    DWORD dwRead = 0;
+    if (!ReadFile(hFile, pBuf, (DWORD) len, &dwRead, NULL))
+    {
+        return false;
+    }
+    numRead = dwRead;
+    return true;
+#else
+    for (;;)
+    {
+        ssize_t n = read(hFile, pBuf, len);
+        if (n >= 0)
+        {
+            numRead = (size_t) n;
+            return true;
+        }
+        if (EINTR != errno)
+        {
+            return false;
+        }
+    }
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  ReadWholeFile
+/// @brief Read a file which can not be mapped into a heap block
+/// @param  hFile The open file, at its start
+/// @param  sizeHint Size of the file, 0 if it is not known (pipes)
+/// @param  view Out, the heap block and its size
+/// @return enum value of MAP_OPEN_ERROR
+////////////////////////////////////////////////////////////////////////////////
+static MAP_OPEN_ERROR ReadWholeFile(FILE_HANDLE hFile, size_t sizeHint, MAP_FILE_VIEW &view)
+{
+    size_t capacity = (0 != sizeHint) ? sizeHint : READ_BLOCK_SIZE;
+    size_t size = 0;
+    char *pBuf = (char *) malloc(capacity);
+    if (NULL == pBuf)
+    {
+        return FILE_TOO_LARGE_ERROR;
+    }
+
+    for (;;)
+    {
+        size_t numRead = 0;
+        if (size == capacity)
+        {
+            // The buffer is full, which is the normal case when the size
+            // is known. Probe for the end of the file on the stack so a
+            // file of exactly sizeHint bytes is never grown to twice that.
+            char probe[256];
+            if (!ReadBlock(hFile, probe, sizeof(probe), numRead))
+            {
+                free(pBuf);
+                return WIN32_ERROR;
+            }
+            if (0 == numRead)
+            {
+                break;
+            }
+
+            // Only when the size is not known or the file grew
+            char *pNew = (capacity <= ((size_t) -1) / 2) ? (char *) realloc(pBuf, capacity * 2) : NULL;
+            if (NULL == pNew)
+            {
+                free(pBuf);
+                return FILE_TOO_LARGE_ERROR;
+            }
+            pBuf = pNew;
+            capacity *= 2;
+            memcpy(pBuf + size, probe, numRead);
+            size += numRead;
+            continue;
+        }
+
+        size_t len = capacity - size;
+        if (!ReadBlock(hFile, pBuf + size, (len < READ_BLOCK_SIZE) ? len : READ_BLOCK_SIZE, numRead))
+        {
+            free(pBuf);
+            return WIN32_ERROR;
+        }
+        if (0 == numRead)
+        {
+            break;
+        }
+        size += numRead;
+    }
+
+    if (0 == size)
+    {
+        free(pBuf);
+        return FILE_EMPTY_ERROR;
+    }
+
+    view.pData = pBuf;
+    view.size = size;
+    view.bMapped = false;
+    return OPEN_NO_ERROR;
+}
+
+#ifdef _WIN32
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  MapFileView
+/// @brief Map or read the whole file, Win32 version
+/// @param  pszFileName Path name of file to open
+/// @param  flags MAP_FILE_xxx flags
+/// @param  view Out, the view of the file
+/// @return enum value of MAP_OPEN_ERROR
+////////////////////////////////////////////////////////////////////////////////
+static MAP_OPEN_ERROR MapFileView(const char *pszFileName, unsigned int flags, MAP_FILE_VIEW &view)
+{
+    DWORD dwFlags = FILE_ATTRIBUTE_NORMAL;
+    if (0 != (flags & MAP_FILE_SEQUENTIAL))
+    {
+        dwFlags |= FILE_FLAG_SEQUENTIAL_SCAN;
+    }
+
+    // Open the file
+    HANDLE hFile = CreateFileA(pszFileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+                               OPEN_EXISTING, dwFlags, NULL);
+    if (INVALID_HANDLE_VALUE == hFile)
+    {
+        return WIN32_ERROR;
+    }
+
+    LARGE_INTEGER fileSize;
+    FILETIME ftWrite;
+    MAP_OPEN_ERROR eRet = OPEN_NO_ERROR;
+    if (GetFileTime(hFile, NULL, NULL, &ftWrite))
+    {
+        view.mtime = ((uint64_t) ftWrite.dwHighDateTime << 32) | ftWrite.dwLowDateTime;
+    }
+
+    if (!GetFileSizeEx(hFile, &fileSize))
+    {
+        eRet = WIN32_ERROR;
+    }
+    else if (0 == fileSize.QuadPart)
+    {
+        eRet = FILE_EMPTY_ERROR;
+    }
+    else if ((ULONGLONG) fileSize.QuadPart > (ULONGLONG) (SIZE_T) -1)
+    {
+        eRet = FILE_TOO_LARGE_ERROR;
+    }
+    else
+    {
+        SIZE_T size = (SIZE_T) fileSize.QuadPart;
+        if (0 == (flags & MAP_FILE_NO_MAP))
+        {
+            HANDLE hMap = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (NULL != hMap)
+            {
+                // The view keeps the mapping open
+                view.pData = (const char *) MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, size);
+                (void) CloseHandle(hMap);
+            }
+        }
+
+        if (NULL != view.pData)
+        {
+            view.size = size;
+            view.bMapped = true;
+        }
+        else
+        {
+            eRet = ReadWholeFile(hFile, size, view);
+        }
+    }
+
+    DWORD dwErr = GetLastError();
+    (void) CloseHandle(hFile);
+    SetLastError(dwErr);
+
+    return eRet;
+}
+
+#else
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  MapFileView
+/// @brief Map or read the whole file, POSIX version
+/// @param  pszFileName Path name of file to open
+/// @param  flags MAP_FILE_xxx flags
+/// @param  view Out, the view of the file
+/// @return enum value of MAP_OPEN_ERROR
+////////////////////////////////////////////////////////////////////////////////
+static MAP_OPEN_ERROR MapFileView(const char *pszFileName, unsigned int flags, MAP_FILE_VIEW &view)
+{
+    int fd = open(pszFileName, O_RDONLY);
+    if (fd < 0)
+    {
+        return WIN32_ERROR;
+    }
+
+    struct stat st;
+    MAP_OPEN_ERROR eRet = OPEN_NO_ERROR;
+    if (0 != fstat(fd, &st))
+    {
+        eRet = WIN32_ERROR;
+    }
+    else if (!S_ISREG(st.st_mode))
+    {
+        // Pipes and devices have no size, read them to the end
+        eRet = ReadWholeFile(fd, 0, view);
+    }
+    else if (0 == st.st_size)
+    {
+        eRet = FILE_EMPTY_ERROR;
+    }
+    else if ((uint64_t) st.st_size > (uint64_t) (size_t) -1)
+    {
+        eRet = FILE_TOO_LARGE_ERROR;
+    }
+    else
+    {
+        size_t size = (size_t) st.st_size;
+        if (0 == (flags & MAP_FILE_NO_MAP))
+        {
+            int mapFlags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+            if (0 != (flags & MAP_FILE_POPULATE))
+            {
+                mapFlags |= MAP_POPULATE;
+            }
+#endif
+            void *p = mmap(NULL, size, PROT_READ, mapFlags, fd, 0);
+            if (MAP_FAILED != p)
+            {
+#ifdef MADV_SEQUENTIAL
+                if (0 != (flags & MAP_FILE_SEQUENTIAL))
+                {
+                    (void) madvise(p, size, MADV_SEQUENTIAL);
+                }
+#endif
+                view.pData = (const char *) p;
+                view.size = size;
+                view.bMapped = true;
+            }
+        }
+
+        if (NULL == view.pData)
+        {
+#ifdef POSIX_FADV_SEQUENTIAL
+            if (0 != (flags & MAP_FILE_SEQUENTIAL))
+            {
+                (void) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            }
+#endif
+            eRet = ReadWholeFile(fd, size, view);
+        }
+    }
+
+    if ((OPEN_NO_ERROR == eRet) && S_ISREG(st.st_mode))
+    {
+        view.mtime = (uint64_t) st.st_mtime;
+    }
+
+    int err = errno;
+    (void) close(fd);
+    errno = err;
+
+    return eRet;
+}
+
+#endif  // _WIN32
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @brief Open a map file and map the file content to virtual memory
+ * @param pszFileName Path name of file to open
+ * @param flags MAP_FILE_xxx flags
+ * @param view Out, the view of the file
+ * @return enum value of MAP_OPEN_ERROR
+ * @author TQN
+ * @date 09/12/2004
+ */
+////////////////////////////////////////////////////////////////////////////////
+MAP_OPEN_ERROR MapFileOpen(const char *pszFileName, unsigned int flags, MAP_FILE_VIEW &view)
+{
+    // Set default values for output parameters
+    view.pData = NULL;
+    view.size = 0;
+    view.bMapped = false;
+    view.mtime = 0;
+
+    // Validate all input pointer parameters
+    _ASSERTE(NULL != pszFileName);
+    if (NULL == pszFileName)
+    {
+#ifdef _WIN32
+        SetLastError(ERROR_INVALID_PARAMETER);
+#else
+        errno = EINVAL;
+#endif
+        return WIN32_ERROR;
+    }
+
+    MAP_OPEN_ERROR eRet = MapFileView(pszFileName, flags, view);
+    if (OPEN_NO_ERROR != eRet)
+    {
+        return eRet;
+    }
+
+    if (0 != (flags & MAP_FILE_BINARY))
+    {
+        return OPEN_NO_ERROR;
+    }
+
+    // UTF-16 and UTF-32 files start with a BOM or have a NUL character in
+    // every ASCII character
+    const unsigned char *pProbe = (const unsigned char *) view.pData;
+    size_t probeSize = (view.size < MAP_PROBE_SIZE) ? view.size : MAP_PROBE_SIZE;
+    if (((probeSize >= 2) &&
+         (((0xFF == pProbe[0]) && (0xFE == pProbe[1])) || ((0xFE == pProbe[0]) && (0xFF == pProbe[1])))) ||
+        (NULL != memchr(pProbe, 0, probeSize)))
+    {
+        // File is binary or Unicode file
+        MapFileClose(view);
+        return FILE_BINARY_ERROR;
+    }
+
+    return OPEN_NO_ERROR;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @brief Close the view which opened by MapFileOpen function.
+ * @param view The view of MapFileOpen, cleared
+ * @author TQN
+ * @date 09/12/2004
+ */
+////////////////////////////////////////////////////////////////////////////////
+void MapFileClose(MAP_FILE_VIEW &view)
+{
+    if (NULL == view.pData)
+    {
+        return;
+    }
+
+    if (!view.bMapped)
+    {
+        free((void *) view.pData);
+    }
+    else
+    {
+#ifdef _WIN32
+        (void) UnmapViewOfFile(view.pData);
+#else
+        (void) munmap((void *) view.pData, view.size);
+#endif
+    }
+
+    view.pData = NULL;
+    view.size = 0;
+    view.bMapped = false;
+    view.mtime = 0;
+}
@@ -0,0 +1,57 @@
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file mapfile.h
+ * Read only view of a whole map file for the LoadMap parser.
+ * The file is memory mapped with Win32 file mappings on Windows and with
+ * mmap() elsewhere, and read into memory when it can not be mapped (pipes,
+ * some network file systems). Sizes are 64 bit, so maps over 4 GB open in
+ * 64 bit processes.
+ * @author TQN (truong_quoc_ngan@yahoo.com)
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __LOADMAP_MAPFILE_H__
+#define __LOADMAP_MAPFILE_H__
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _ASSERTE
+    #include <assert.h>
+    #define _ASSERTE(x) assert(x)
+#endif
+
+typedef enum _tagMAP_OPEN_ERROR {
+    OPEN_NO_ERROR = 0,
+    WIN32_ERROR,                // GetLastError() on Windows, errno elsewhere
+    FILE_EMPTY_ERROR,
+    FILE_BINARY_ERROR,          // NUL characters, by MapFileOpen in the first
+                                // MAP_PROBE_SIZE bytes or by the parser later
+    FILE_TOO_LARGE_ERROR,       // does not fit in the address space
+    FILE_NO_TABLE_ERROR         // no symbol table header, by the parser
+} MAP_OPEN_ERROR;
+
+/* MapFileOpen flags */
+#define MAP_FILE_SEQUENTIAL     0x01    // hint the OS that the file is read once, in order
+#define MAP_FILE_POPULATE       0x02    // read all pages when mapping, not on first access
+#define MAP_FILE_NO_MAP         0x04    // always read the file into memory
+#define MAP_FILE_BINARY         0x08    // not a text file, no Unicode check
+
+#define MAP_PROBE_SIZE          0x1000  // Bytes checked for Unicode by MapFileOpen
+
+typedef struct _tagMAP_FILE {
+    const char *pData;          // the whole file
+    size_t size;
+    bool bMapped;               // false: pData is a heap block
+    uint64_t mtime;             // last write time of the file, 0 for pipes
+} MAP_FILE_VIEW;
+
+/* Open a map file, the file is closed again when the view exists */
+MAP_OPEN_ERROR MapFileOpen(const char *pszFileName, unsigned int flags, MAP_FILE_VIEW &view);
+
+/* Release the view of MapFileOpen */
+void MapFileClose(MAP_FILE_VIEW &view);
+
+#endif  // __LOADMAP_MAPFILE_H__
@@ -0,0 +1,454 @@
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file mapindex.cpp
+ * Symbol index side file of the LoadMap plugin.
+ * File layout, in the byte order of the machine:
+ *     MAP_INDEX_HEADER
+ *     MAP_INDEX_RECORD[numRecords], by segment, offset and kind
+ *     name pool, every name once, not NUL terminated
+ * The records keep the offsets of their lines in the map file, so the
+ * messages of the invalid lines are the same as after a parse.
+ * @author TQN (truong_quoc_ngan@yahoo.com)
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "mapindex.h"
+
+using namespace std;
+
+#define HASH_SEED           0x6A09E667F3BCC908ULL
+#define HASH_MUL            0x9E3779B97F4A7C15ULL
+#define HASH_LANES          4           // independent multiply chains
+#define HASH_BLOCK_SIZE     0x1000000   // bytes hashed between two progress calls
+#define WRITE_BLOCK_RECORDS 0x1000
+#define NAME_SLOT_EMPTY     0xFFFFFFFFu // free slot of the name table
+
+typedef struct _tagMAP_INDEX_HEADER {
+    char magic[8];              // MAP_INDEX_MAGIC
+    uint32_t version;           // MAP_INDEX_VERSION
+    uint32_t recordSize;        // sizeof(MAP_INDEX_RECORD)
+    MAP_INDEX_KEY key;
+    uint64_t numRecords;
+    uint64_t poolSize;
+} MAP_INDEX_HEADER;
+
+typedef struct _tagMAP_INDEX_RECORD {
+    uint64_t lineOff;           // the line in the map file
+    uint32_t lineLen;
+    uint32_t seg;               // MAP_SYMBOL::seg
+    uint32_t addr;
+    uint32_t nameOff;           // in the name pool
+    uint16_t nameLen;
+    uint8_t kind;               // MAP_SYMBOL_KIND
+    uint8_t target;             // MAP_SYMBOL_TARGET
+    uint32_t reserved;
+} MAP_INDEX_RECORD;
+
+/* The records follow the header without padding and are read in place */
+typedef char MAP_INDEX_HEADER_SIZE_CHECK[(0 == sizeof(MAP_INDEX_HEADER) % 8) ? 1 : -1];
+typedef char MAP_INDEX_RECORD_SIZE_CHECK[(32 == sizeof(MAP_INDEX_RECORD)) ? 1 : -1];
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  HashMapFile
+/// @brief 64 bit hash of the whole map file, one multiply per 8 bytes in
+/// HASH_LANES chains, so the multiplies of the chains overlap
+/// @param  pData The map file
+/// @param  size Size of the map file
+/// @param  pfnProgress NULL, or called with the bytes hashed after every
+/// HASH_BLOCK_SIZE bytes
+/// @param  ctx Context of pfnProgress
+/// @param  pHash Out, the hash
+/// @return false if pfnProgress stopped the hash
+////////////////////////////////////////////////////////////////////////////////
+static bool HashMapFile(const char *pData, size_t size, PFN_MAP_PROGRESS pfnProgress,
+                        void *ctx, uint64_t *pHash)
+{
+    uint64_t h[HASH_LANES];
+    for (size_t i = 0; i < HASH_LANES; i++)
+    {
+        h[i] = HASH_SEED + i;
+    }
+
+    const char *p = pData;
+    size_t len = size;
+    uint64_t w;
+    while (len >= 8 * HASH_LANES)
+    {
+        // The blocks are whole lane groups, the hash does not depend on them
+        size_t blockLen = min(len, (size_t) HASH_BLOCK_SIZE) & ~(size_t) (8 * HASH_LANES - 1);
+        for (const char *pBlockEnd = p + blockLen; p < pBlockEnd; p += 8 * HASH_LANES)
+        {
+            for (size_t i = 0; i < HASH_LANES; i++)
+            {
+                memcpy(&w, p + 8 * i, 8);
+                h[i] = (h[i] ^ w) * HASH_MUL;
+                h[i] ^= h[i] >> 29;
+            }
+        }
+        len -= blockLen;
+
+        if ((NULL != pfnProgress) && pfnProgress(ctx, (uint64_t) (p - pData)))
+        {
+            return false;
+        }
+    }
+    for (size_t i = 0; len > 0; i++)
+    {
+        size_t n = (len < 8) ? len : 8;
+        w = 0;
+        memcpy(&w, p, n);
+        h[i] = (h[i] ^ w) * HASH_MUL;
+        h[i] ^= h[i] >> 29;
+        p += n;
+        len -= n;
+    }
+
+    uint64_t k = size;
+    for (size_t i = 0; i < HASH_LANES; i++)
+    {
+        k = (k ^ h[i]) * HASH_MUL;
+        k ^= k >> 29;
+    }
+
+    // fmix64 of MurmurHash3
+    k ^= k >> 33;
+    k *= 0xFF51AFD7ED558CCDULL;
+    k ^= k >> 33;
+    k *= 0xC4CEB9FE1A85EC53ULL;
+    k ^= k >> 33;
+    *pHash = k;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global  GetMapIndexKey
+/// @brief Fill the key of the index of a map file
+/// @param  mapFile The open map file
+/// @param  params The parameters of the parse, the records depend on them
+/// @param  key Out, the key
+/// @param  pfnProgress NULL, or called with the bytes of the map file hashed
+/// @param  ctx Context of pfnProgress
+/// @return false if pfnProgress stopped the hash, the key is not valid then
+////////////////////////////////////////////////////////////////////////////////
+bool GetMapIndexKey(const MAP_FILE_VIEW &mapFile, const MAP_PARSE_PARAMS &params,
+                    MAP_INDEX_KEY &key, PFN_MAP_PROGRESS pfnProgress, void *ctx)
+{
+    key.size = mapFile.size;
+    key.mtime = mapFile.mtime;
+    key.badAddr = params.badAddr;
+    key.maxNameLen = params.maxNameLen;
+    return HashMapFile(mapFile.pData, mapFile.size, pfnProgress, ctx, &key.hash);
+}
+
+/* Record order: segment, offset, kind, then the file order */
+typedef struct _tagRECORD_KEY {
+    uint64_t pos;               // seg << 32 | addr
+    uint64_t order;             // kind << 32 | index of the symbol in file order
+
+    bool operator<(const struct _tagRECORD_KEY &other) const
+    {
+        return (pos < other.pos) || ((pos == other.pos) && (order < other.order));
+    }
+} RECORD_KEY;
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  HashName
+/// @brief Hash of a name for the name table of InternNames
+////////////////////////////////////////////////////////////////////////////////
+static inline size_t HashName(const char *pName, size_t len)
+{
+    uint64_t h = HASH_SEED ^ len;
+    uint64_t w;
+    for (; len >= 8; pName += 8, len -= 8)
+    {
+        memcpy(&w, pName, 8);
+        h = (h ^ w) * HASH_MUL;
+        h ^= h >> 29;
+    }
+    if (len > 0)
+    {
+        w = 0;
+        memcpy(&w, pName, len);
+        h = (h ^ w) * HASH_MUL;
+        h ^= h >> 29;
+    }
+    return (size_t) (h ^ (h >> 32));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  InternNames
+/// @brief Put every name of the valid symbols once into the name pool, in
+/// the order of their first symbol. The names are found in an open
+/// addressing table of the symbol indexes, at most half full.
+/// @param  symbols The parsed symbols, less than 0xFFFFFFFF
+/// @param  nameOffs Out, the pool offset of the name of every symbol
+/// @param  pool Out, the name pool
+/// @return false if the pool is too large for the records
+////////////////////////////////////////////////////////////////////////////////
+static bool InternNames(const vector<MAP_SYMBOL> &symbols, vector<uint32_t> &nameOffs,
+                        vector<char> &pool)
+{
+    size_t numNames = 0;
+    size_t namesLen = 0;
+    for (size_t i = 0; i < symbols.size(); i++)
+    {
+        if (symbols[i].nameLen > 0)
+        {
+            numNames++;
+            namesLen += symbols[i].nameLen;
+        }
+    }
+
+    size_t tableSize = 16;
+    while (tableSize < 2 * numNames)
+    {
+        tableSize *= 2;
+    }
+    vector<uint32_t> table(tableSize, NAME_SLOT_EMPTY);
+
+    nameOffs.assign(symbols.size(), 0);
+    pool.clear();
+    pool.reserve(namesLen);
+
+    for (size_t i = 0; i < symbols.size(); i++)
+    {
+        const MAP_SYMBOL &sym = symbols[i];
+        if (0 == sym.nameLen)
+        {
+            continue;
+        }
+
+        size_t slot = HashName(sym.pName, sym.nameLen) & (tableSize - 1);
+        while (NAME_SLOT_EMPTY != table[slot])
+        {
+            const MAP_SYMBOL &other = symbols[table[slot]];
+            if ((other.nameLen == sym.nameLen) &&
+                (0 == memcmp(other.pName, sym.pName, sym.nameLen)))
+            {
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
+        }
+
+        if (NAME_SLOT_EMPTY != table[slot])
+        {
+            // Same name as an earlier symbol
+            nameOffs[i] = nameOffs[table[slot]];
+            continue;
+        }
+
+        if ((pool.size() > 0xFFFFFFFFu) || (sym.nameLen > 0xFFFFu))
+        {
+            return false;
+        }
+        table[slot] = (uint32_t) i;
+        nameOffs[i] = (uint32_t) pool.size();
+        pool.insert(pool.end(), sym.pName, sym.pName + sym.nameLen);
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global  SaveMapIndex
+/// @brief Write the symbols of a parse as the index of the map file
+/// @param  pszIndexName Path name of the index file
+/// @param  key Key of the map file
+/// @param  mapFile The map file, the symbols point into it
+/// @param  symbols The symbols of ParseMapTable
+/// @param  pfnProgress NULL, or called with the records written after every
+/// block of WRITE_BLOCK_RECORDS records
+/// @param  ctx Context of pfnProgress
+/// @return false if writing failed or pfnProgress stopped it, no index file
+/// is left then
+////////////////////////////////////////////////////////////////////////////////
+bool SaveMapIndex(const char *pszIndexName, const MAP_INDEX_KEY &key,
+                  const MAP_FILE_VIEW &mapFile, const vector<MAP_SYMBOL> &symbols,
+                  PFN_MAP_PROGRESS pfnProgress, void *ctx)
+{
+    _ASSERTE(NULL != pszIndexName);
+
+    if (symbols.size() >= NAME_SLOT_EMPTY)
+    {
+        return false;
+    }
+
+    // Sort the keys in place, the "Publics by Value" table is mostly in order
+    vector<RECORD_KEY> order(symbols.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const MAP_SYMBOL &sym = symbols[i];
+        order[i].pos = ((uint64_t) sym.seg << 32) | sym.addr;
+        order[i].order = ((uint64_t) sym.kind << 32) | i;
+    }
+    if (!is_sorted(order.begin(), order.end()))
+    {
+        sort(order.begin(), order.end());
+    }
+
+    vector<uint32_t> nameOffs;
+    vector<char> pool;
+    if (!InternNames(symbols, nameOffs, pool))
+    {
+        return false;
+    }
+
+    MAP_INDEX_HEADER hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, MAP_INDEX_MAGIC, sizeof(hdr.magic));
+    hdr.version = MAP_INDEX_VERSION;
+    hdr.recordSize = sizeof(MAP_INDEX_RECORD);
+    hdr.key = key;
+    hdr.numRecords = symbols.size();
+    hdr.poolSize = pool.size();
+
+    FILE *fp = fopen(pszIndexName, "wb");
+    if (NULL == fp)
+    {
+        return false;
+    }
+
+    bool bOk = (1 == fwrite(&hdr, sizeof(hdr), 1, fp));
+
+    vector<MAP_INDEX_RECORD> block;
+    block.reserve(WRITE_BLOCK_RECORDS);
+    for (size_t i = 0; bOk && (i < order.size()); i++)
+    {
+        size_t index = (size_t) (order[i].order & 0xFFFFFFFFu);
+        const MAP_SYMBOL &sym = symbols[index];
+        if (sym.lineLen > 0xFFFFFFFFu)
+        {
+            bOk = false;
+            break;
+        }
+
+        MAP_INDEX_RECORD rec;
+        rec.lineOff = (uint64_t) (sym.pLine - mapFile.pData);
+        rec.lineLen = (uint32_t) sym.lineLen;
+        rec.seg = sym.seg;
+        rec.addr = sym.addr;
+        rec.nameOff = nameOffs[index];
+        rec.nameLen = (uint16_t) sym.nameLen;
+        rec.kind = (uint8_t) sym.kind;
+        rec.target = (uint8_t) sym.target;
+        rec.reserved = 0;
+        block.push_back(rec);
+
+        if ((block.size() == WRITE_BLOCK_RECORDS) || (i + 1 == order.size()))
+        {
+            bOk = (block.size() == fwrite(&block[0], sizeof(MAP_INDEX_RECORD), block.size(), fp));
+            block.clear();
+            if (bOk && (NULL != pfnProgress) && pfnProgress(ctx, (uint64_t) i + 1))
+            {
+                bOk = false;
+            }
+        }
+    }
+
+    if (bOk && !pool.empty())
+    {
+        bOk = (1 == fwrite(&pool[0], pool.size(), 1, fp));
+    }
+
+    bOk = (0 == fclose(fp)) && bOk;
+    if (!bOk)
+    {
+        // A partly written index would be rejected by its size anyway
+        (void) remove(pszIndexName);
+    }
+
+    return bOk;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  IsSameKey
+/// @brief Compare the key of an index with the key of the map file
+////////////////////////////////////////////////////////////////////////////////
+static bool IsSameKey(const MAP_INDEX_KEY &a, const MAP_INDEX_KEY &b)
+{
+    return (a.size == b.size) && (a.mtime == b.mtime) && (a.hash == b.hash) &&
+           (a.badAddr == b.badAddr) && (a.maxNameLen == b.maxNameLen);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global  LoadMapIndex
+/// @brief Map the index file of a map file and check it
+/// @param  pszIndexName Path name of the index file
+/// @param  key Key of the map file
+/// @param  mapFile The map file
+/// @param  indexView Out, the view of the index, the names of the symbols
+/// are in it, closed by the caller after the symbols are applied
+/// @param  symbols Out, the symbols, by segment and offset
+/// @return false if the index is missing, bad or of another map file, the
+/// index view is closed then
+////////////////////////////////////////////////////////////////////////////////
+bool LoadMapIndex(const char *pszIndexName, const MAP_INDEX_KEY &key,
+                  const MAP_FILE_VIEW &mapFile, MAP_FILE_VIEW &indexView,
+                  vector<MAP_SYMBOL> &symbols)
+{
+    _ASSERTE(NULL != pszIndexName);
+
+    symbols.clear();
+    if (OPEN_NO_ERROR != MapFileOpen(pszIndexName, MAP_FILE_BINARY, indexView))
+    {
+        return false;
+    }
+
+    const MAP_INDEX_HEADER *pHdr = (const MAP_INDEX_HEADER *) indexView.pData;
+    size_t maxRecords = 0;
+    bool bOk = (indexView.size >= sizeof(MAP_INDEX_HEADER)) &&
+               (0 == memcmp(pHdr->magic, MAP_INDEX_MAGIC, sizeof(pHdr->magic))) &&
+               (MAP_INDEX_VERSION == pHdr->version) &&
+               (sizeof(MAP_INDEX_RECORD) == pHdr->recordSize) &&
+               IsSameKey(pHdr->key, key);
+    if (bOk)
+    {
+        maxRecords = (indexView.size - sizeof(MAP_INDEX_HEADER)) / sizeof(MAP_INDEX_RECORD);
+        bOk = (pHdr->numRecords <= maxRecords) &&
+              (pHdr->poolSize == indexView.size - sizeof(MAP_INDEX_HEADER) -
+                                 pHdr->numRecords * sizeof(MAP_INDEX_RECORD));
+    }
+
+    if (bOk)
+    {
+        size_t numRecords = (size_t) pHdr->numRecords;
+        const MAP_INDEX_RECORD *pRecords = (const MAP_INDEX_RECORD *) (pHdr + 1);
+        const char *pPool = (const char *) (pRecords + numRecords);
+        uint64_t poolSize = pHdr->poolSize;
+
+        symbols.resize(numRecords);
+        for (size_t i = 0; i < numRecords; i++)
+        {
+            const MAP_INDEX_RECORD &rec = pRecords[i];
+            if ((rec.lineOff > mapFile.size) || (rec.lineLen > mapFile.size - rec.lineOff) ||
+                (rec.nameOff > poolSize) || (rec.nameLen > poolSize - rec.nameOff) ||
+                (rec.kind > MAP_SYMBOL_END) || (rec.target > MAP_TARGET_COMMENT))
+            {
+                bOk = false;
+                break;
+            }
+
+            MAP_SYMBOL &sym = symbols[i];
+            sym.pLine = mapFile.pData + rec.lineOff;
+            sym.lineLen = rec.lineLen;
+            sym.pName = pPool + rec.nameOff;
+            sym.nameLen = rec.nameLen;
+            sym.seg = rec.seg;
+            sym.addr = rec.addr;
+            sym.kind = (MAP_SYMBOL_KIND) rec.kind;
+            sym.target = (MAP_SYMBOL_TARGET) rec.target;
+        }
+    }
+
+    if (!bOk)
+    {
+        symbols.clear();
+        MapFileClose(indexView);
+    }
+
+    return bOk;
+}
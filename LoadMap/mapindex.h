@@ -0,0 +1,60 @@
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file mapindex.h
+ * Symbol index side file of the LoadMap plugin.
+ * The parsed symbol table of a map file is saved next to it as sorted
+ * binary records and a pool of the names. A later load of the same map
+ * file maps the index and does not parse the text again. The index is
+ * only used when the size, the write time and the hash of the content of
+ * the map file are the ones it was saved for.
+ * Does not call the IDA SDK.
+ * @author TQN (truong_quoc_ngan@yahoo.com)
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __LOADMAP_MAPINDEX_H__
+#define __LOADMAP_MAPINDEX_H__
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "mapfile.h"
+#include "mapparse.h"
+
+#define MAP_INDEX_EXT       ".idx"      // appended to the map file name
+#define MAP_INDEX_MAGIC     "LMAPINDX"
+#define MAP_INDEX_VERSION   2           // change when the records change
+
+/* Identity of the map file an index was saved for */
+typedef struct _tagMAP_INDEX_KEY {
+    uint64_t size;
+    uint64_t mtime;             // MAP_FILE_VIEW::mtime
+    uint64_t hash;              // of the whole content
+    uint64_t badAddr;           // MAP_PARSE_PARAMS of the parse
+    uint64_t maxNameLen;
+} MAP_INDEX_KEY;
+
+/* Hash the map file and fill the key of its index, pfnProgress gets the
+   bytes hashed, false if it stopped the hash */
+bool GetMapIndexKey(const MAP_FILE_VIEW &mapFile, const MAP_PARSE_PARAMS &params,
+                    MAP_INDEX_KEY &key, PFN_MAP_PROGRESS pfnProgress, void *ctx);
+
+/* Save the symbols of ParseMapTable, pfnProgress gets the records written,
+   false if writing failed or pfnProgress stopped it */
+bool SaveMapIndex(const char *pszIndexName, const MAP_INDEX_KEY &key,
+                  const MAP_FILE_VIEW &mapFile, const std::vector<MAP_SYMBOL> &symbols,
+                  PFN_MAP_PROGRESS pfnProgress, void *ctx);
+
+/*
+ * Map the index of the map file, false if there is no index or it is not
+ * the index of this map file. The symbols are in address order, their
+ * names are in the index view and their lines in the map file view.
+ */
+bool LoadMapIndex(const char *pszIndexName, const MAP_INDEX_KEY &key,
+                  const MAP_FILE_VIEW &mapFile, MAP_FILE_VIEW &indexView,
+                  std::vector<MAP_SYMBOL> &symbols);
+
+#endif  // __LOADMAP_MAPINDEX_H__
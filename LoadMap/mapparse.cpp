@@ -0,0 +1,824 @@
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file mapparse.cpp
+ * Map file symbol table parser of the LoadMap plugin.
+ * Every chunk starts at an EOL character and ends at the next chunk, so a
+ * chunk sees the same lines as the serial scan of the whole table. A chunk
+ * stops at its first line which is not a symbol line, and the records of
+ * the chunks after the first such line are dropped.
+ * The EOL search also stops at NUL characters, so a binary file is found in
+ * the same pass over the text, a NUL before the end of the table fails it.
+ * The parser is a template of the dialect layout, so the DeDe name prefixes
+ * are only checked by the Borland parser and not per line.
+ * The headers are searched in the whole file at once, only the lines which
+ * start with the "ad" of "Address" are compared with them.
+ * The lines are tokenized in place: the EOL characters are searched 16 bytes
+ * at a time with SSE2, the segment and the address are decoded with a table
+ * lookup per digit, and the names are left in the map file.
+ * @author TQN (truong_quoc_ngan@yahoo.com)
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <algorithm>
+
+#include "mapparse.h"
+#include "cpufeat.h"
+
+using namespace std;
+
+// This is where the symbol table starts, do not edit.
+static const char VC_HDR_START[]       = "Address         Publics by Value              Rva+Base     Lib:Object";
+static const char BL_HDR_NAME_START[]  = "Address         Publics by Name";
+static const char BL_HDR_VALUE_START[] = "Address         Publics by Value";
+
+#define NOT_HEX     0xFF
+
+/* Value of the hex digits, NOT_HEX for other characters */
+static const unsigned char g_hexDigit[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+static bool g_bMapScanSSE2 = false;
+
+/* The lines of one parse job */
+typedef struct _tagMAP_CHUNK {
+    const char *pStart;         // an EOL character or the start of the table
+    const char *pEnd;
+    std::vector<MAP_SYMBOL> symbols;
+    bool bEnd;                  // the last record is a MAP_SYMBOL_END
+    bool bBinary;               // stopped at a NUL character
+} MAP_CHUNK;
+
+typedef struct _tagMAP_PARSE_JOB {
+    const MAP_PARSE_PARAMS *pParams;
+    std::vector<MAP_CHUNK> chunks;
+    size_t firstChunk;          // of the round being parsed
+} MAP_PARSE_JOB;
+
+////////////////////////////////////////////////////////////////////////////////
+/// global  InitMapParser
+/// @brief Select the SSE2 EOL search when the CPU supports it, must be
+/// called before worker threads parse a map file
+/// @return void
+////////////////////////////////////////////////////////////////////////////////
+void InitMapParser(void)
+{
+#ifdef CPU_X86
+    g_bMapScanSSE2 = CpuHasSSE2();
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global inline static  IsSpace
+/// @brief isspace() of the "C" locale, false for the characters above 0x7F
+/// @param  c The character
+/// @return true for ' ', '\t', '\n', '\v', '\f' and '\r'
+////////////////////////////////////////////////////////////////////////////////
+static inline bool IsSpace(char c)
+{
+    return (' ' == c) || ((unsigned int) ((unsigned char) c - '\t') <= (unsigned int) ('\r' - '\t'));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global inline static  SkipSpaces
+/// @brief Seek to non space character at the beginning of a memory buffer
+/// @param  pStart Pointer to start of buffer
+/// @param  pEnd Pointer to end of buffer
+/// @return Pointer to first non space character at the beginning of buffer
+/// @author TQN
+/// @date 09/11/2004
+////////////////////////////////////////////////////////////////////////////////
+static inline const char *SkipSpaces(const char *pStart, const char *pEnd)
+{
+    _ASSERTE(pStart != NULL);
+    _ASSERTE(pEnd != NULL);
+    _ASSERTE(pStart <= pEnd);
+
+    const char *p = pStart;
+    while ((p < pEnd) && IsSpace(*p))
+    {
+        p++;
+    }
+
+    return p;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global inline static  FindEOLChar
+/// @brief Find the EOL character '\r' or '\n' or a NUL character one
+/// character at a time
+/// @param  pStart Pointer to start of buffer
+/// @param  pEnd Pointer to end of buffer
+/// @return Pointer to first EOL or NUL character in the buffer, pEnd if not found
+/// @author TQN
+/// @date 09/12/2004
+////////////////////////////////////////////////////////////////////////////////
+static inline const char *FindEOLChar(const char *pStart, const char *pEnd)
+{
+    const char *p = pStart;
+    while ((p < pEnd) && ('\r' != *p) && ('\n' != *p) && ('\0' != *p))
+    {
+        p++;
+    }
+
+    return p;
+}
+
+#ifdef CPU_X86
+////////////////////////////////////////////////////////////////////////////////
+/// global static  FindEOLSSE2
+/// @brief FindEOLChar for 16 characters at a time, the last 15 characters
+/// are searched one at a time
+/// @param  pStart Pointer to start of buffer
+/// @param  pEnd Pointer to end of buffer
+/// @return Pointer to first EOL or NUL character in the buffer, pEnd if not found
+////////////////////////////////////////////////////////////////////////////////
+CPU_TARGET("sse2")
+static const char *FindEOLSSE2(const char *pStart, const char *pEnd)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i nul = _mm_setzero_si128();
+
+    const char *p = pStart;
+    for (; (size_t) (pEnd - p) >= 16; p += 16)
+    {
+        __m128i data = _mm_loadu_si128((const __m128i *) p);
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(data, cr), _mm_cmpeq_epi8(data, lf)),
+                         _mm_cmpeq_epi8(data, nul)));
+        if (0 != mask)
+        {
+            return p + LowestBit(mask);
+        }
+    }
+
+    return FindEOLChar(p, pEnd);
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+/// global inline static  FindEOL
+/// @brief Find the EOL character '\r' or '\n' or a NUL character in a
+/// memory buffer
+/// @param  pStart Pointer to start of buffer
+/// @param  pEnd Pointer to end of buffer
+/// @return Pointer to first EOL or NUL character in the buffer, pEnd if not found
+////////////////////////////////////////////////////////////////////////////////
+static inline const char *FindEOL(const char *pStart, const char *pEnd)
+{
+    _ASSERTE(pStart != NULL);
+    _ASSERTE(pEnd != NULL);
+    _ASSERTE(pStart <= pEnd);
+
+#ifdef CPU_X86
+    if (g_bMapScanSSE2)
+    {
+        return FindEOLSSE2(pStart, pEnd);
+    }
+#endif
+
+    return FindEOLChar(pStart, pEnd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global inline static  IsNulChar
+/// @brief Check the stop character of FindEOL
+/// @param  p Result of FindEOL
+/// @param  pEnd Pointer to end of buffer
+/// @return true if FindEOL stopped at a NUL character
+////////////////////////////////////////////////////////////////////////////////
+static inline bool IsNulChar(const char *p, const char *pEnd)
+{
+    return (p < pEnd) && ('\0' == *p);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  IsHeaderLine
+/// @brief strnicmp(pLine, pHeader, lineLen) == 0 of the "C" locale, so a
+/// line which is a prefix of the header also matches
+/// @param  pLine The line
+/// @param  lineLen Length of the line
+/// @param  pHeader NUL terminated header
+/// @return true if the line matches
+////////////////////////////////////////////////////////////////////////////////
+static bool IsHeaderLine(const char *pLine, size_t lineLen, const char *pHeader)
+{
+    for (size_t i = 0; i < lineLen; i++)
+    {
+        char a = pLine[i];
+        char b = pHeader[i];
+        if (('A' <= a) && (a <= 'Z'))
+        {
+            a = (char) (a | 0x20);
+        }
+        if (('A' <= b) && (b <= 'Z'))
+        {
+            b = (char) (b | 0x20);
+        }
+        if (a != b)
+        {
+            return false;
+        }
+        if ('\0' == b)
+        {
+            break;
+        }
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global inline static  IsAnchor
+/// @brief Check for the "ad" of "Address" case insensitive, or for a NUL
+/// @param  p The character, p[1] must be readable
+/// @param  bNul Also stop at NUL characters
+/// @return true if p is a header candidate or a NUL
+////////////////////////////////////////////////////////////////////////////////
+static inline bool IsAnchor(const char *p, bool bNul)
+{
+    return (('a' == (p[0] | 0x20)) && ('d' == (p[1] | 0x20))) || (bNul && ('\0' == p[0]));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  FindAnchorChar
+/// @brief Find the next header candidate or NUL one character at a time
+/// @param  pStart Pointer to start of buffer
+/// @param  pEnd Pointer to end of buffer
+/// @param  bNul Also stop at NUL characters
+/// @return Pointer to the candidate, pEnd if not found
+////////////////////////////////////////////////////////////////////////////////
+static const char *FindAnchorChar(const char *pStart, const char *pEnd, bool bNul)
+{
+    const char *p = pStart;
+    for (; p + 1 < pEnd; p++)
+    {
+        if (IsAnchor(p, bNul))
+        {
+            return p;
+        }
+    }
+
+    // The last character can only be a NUL, a header needs more
+    return ((p < pEnd) && bNul && ('\0' == *p)) ? p : pEnd;
+}
+
+#ifdef CPU_X86
+////////////////////////////////////////////////////////////////////////////////
+/// global static  FindAnchorSSE2
+/// @brief FindAnchorChar for 16 characters at a time, the characters and
+/// the characters after them are compared at once
+/// @param  pStart Pointer to start of buffer
+/// @param  pEnd Pointer to end of buffer
+/// @param  bNul Also stop at NUL characters
+/// @return Pointer to the candidate, pEnd if not found
+////////////////////////////////////////////////////////////////////////////////
+CPU_TARGET("sse2")
+static const char *FindAnchorSSE2(const char *pStart, const char *pEnd, bool bNul)
+{
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i a = _mm_set1_epi8('a');
+    const __m128i d = _mm_set1_epi8('d');
+    const __m128i nul = bNul ? _mm_setzero_si128() : _mm_set1_epi8('a');
+
+    const char *p = pStart;
+    for (; (size_t) (pEnd - p) >= 17; p += 16)
+    {
+        __m128i data = _mm_loadu_si128((const __m128i *) p);
+        __m128i next = _mm_loadu_si128((const __m128i *) (p + 1));
+        __m128i match = _mm_and_si128(_mm_cmpeq_epi8(_mm_or_si128(data, lower), a),
+                                      _mm_cmpeq_epi8(_mm_or_si128(next, lower), d));
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(
+            _mm_or_si128(match, _mm_cmpeq_epi8(data, nul)));
+        if (0 != mask)
+        {
+            return p + LowestBit(mask);
+        }
+    }
+
+    return FindAnchorChar(p, pEnd, bNul);
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+/// global inline static  FindAnchor
+/// @brief Find the next header candidate, the "ad" of "Address", or NUL
+/// @param  pStart Pointer to start of buffer
+/// @param  pEnd Pointer to end of buffer
+/// @param  bNul Also stop at NUL characters
+/// @return Pointer to the candidate, pEnd if not found
+////////////////////////////////////////////////////////////////////////////////
+static inline const char *FindAnchor(const char *pStart, const char *pEnd, bool bNul)
+{
+#ifdef CPU_X86
+    if (g_bMapScanSSE2)
+    {
+        return FindAnchorSSE2(pStart, pEnd, bNul);
+    }
+#endif
+
+    return FindAnchorChar(pStart, pEnd, bNul);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  IsLineStart
+/// @brief Check that only spaces are between the previous EOL character
+/// and a character, as a line after SkipSpaces starts
+/// @param  pStart Pointer to start of buffer
+/// @param  p The character
+/// @return true if a line starts at p
+////////////////////////////////////////////////////////////////////////////////
+static bool IsLineStart(const char *pStart, const char *p)
+{
+    while (p > pStart)
+    {
+        char c = *--p;
+        if (('\r' == c) || ('\n' == c))
+        {
+            return true;
+        }
+        if (!IsSpace(c))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global  FindMapTables
+/// @brief Find the "Publics by Name" and "Publics by Value" header lines.
+/// Only the lines starting with the "ad" of "Address" are compared with the
+/// headers, the others are skipped 16 characters at a time. A Borland map
+/// has its "Publics by Value" table after its "Publics by Name" table, so
+/// the search ends at the "Publics by Value" header.
+/// @param  pStart Pointer to start of the map file
+/// @param  pEnd Pointer to end of the map file
+/// @param  tables Out, the tables found
+/// @return false if there is no header
+////////////////////////////////////////////////////////////////////////////////
+bool FindMapTables(const char *pStart, const char *pEnd, MAP_TABLES &tables)
+{
+    tables.pByName = NULL;
+    tables.pByValue = NULL;
+    tables.valueDialect = MAP_DIALECT_BORLAND;
+    tables.pNul = NULL;
+
+    const char *p = pStart;
+    while (NULL == tables.pByValue)
+    {
+        p = FindAnchor(p, pEnd, NULL == tables.pNul);
+        if (p >= pEnd)
+        {
+            break;
+        }
+        if ('\0' == *p)
+        {
+            tables.pNul = p++;
+            if (NULL == tables.pByName)
+            {
+                // File is binary or Unicode file
+                break;
+            }
+            continue;
+        }
+
+        if (!IsLineStart(pStart, p))
+        {
+            p++;
+            continue;
+        }
+
+        // A NUL in the line is found by the next search
+        const char *pEOL = FindEOL(p, pEnd);
+        size_t lineLen = (size_t) (pEOL - p);
+        if ((lineLen < MAP_MIN_LINE_LEN) || (IsNulChar(pEOL, pEnd) && (NULL == tables.pNul)))
+        {
+            p = pEOL;
+            continue;
+        }
+
+        if ((lineLen >= sizeof(BL_HDR_NAME_START) - 1) &&
+            IsHeaderLine(p, lineLen, BL_HDR_NAME_START))
+        {
+            if (NULL == tables.pByName)
+            {
+                tables.pByName = SkipSpaces(pEOL, pEnd);
+            }
+        }
+        else if (IsHeaderLine(p, lineLen, VC_HDR_START      ) ||
+                 IsHeaderLine(p, lineLen, BL_HDR_NAME_START ) ||
+                 IsHeaderLine(p, lineLen, BL_HDR_VALUE_START))
+        {
+            // A line shorter than the VC header is a Borland header, also a
+            // line which is a prefix of both Borland headers
+            if ((lineLen >= sizeof(VC_HDR_START) - 1) &&
+                IsHeaderLine(p, lineLen, VC_HDR_START))
+            {
+                tables.valueDialect = MAP_DIALECT_VC;
+            }
+            tables.pByValue = SkipSpaces(pEOL, pEnd);
+        }
+        p = pEOL;
+    }
+
+    return (NULL != tables.pByName) || (NULL != tables.pByValue);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  ParseHexSlow
+/// @brief Decode a hex number like the "%X" conversion of scanf with a field
+/// width: an optional sign and an optional "0x" prefix, which count in the
+/// width, then the hex digits
+/// @param  p In, the first character, out, the character after the number
+/// @param  pEnd Pointer to end of the line
+/// @param  width Maximum characters of the number
+/// @param  value Out, the number
+/// @return false if there is no number
+////////////////////////////////////////////////////////////////////////////////
+static bool ParseHexSlow(const char *&p, const char *pEnd, size_t width, unsigned int &value)
+{
+    const char *pMax = ((size_t) (pEnd - p) > width) ? p + width : pEnd;
+    const char *q = p;
+    bool bNeg = false;
+    bool bDigit = false;
+
+    if ((q < pMax) && (('+' == *q) || ('-' == *q)))
+    {
+        bNeg = ('-' == *q);
+        q++;
+    }
+    if ((q < pMax) && ('0' == *q))
+    {
+        q++;
+        bDigit = true;
+        if ((q < pMax) && ('x' == (*q | 0x20)))
+        {
+            q++;
+        }
+    }
+
+    unsigned int v = 0;
+    for (; q < pMax; q++)
+    {
+        unsigned int d = g_hexDigit[(unsigned char) *q];
+        if (NOT_HEX == d)
+        {
+            break;
+        }
+        v = (v << 4) | d;
+        bDigit = true;
+    }
+
+    if (!bDigit)
+    {
+        return false;
+    }
+
+    p = q;
+    value = bNeg ? (0U - v) : v;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global inline static  ParseHex
+/// @brief Decode a hex number of at most width characters. Map files have
+/// exactly width digits, they are decoded without a branch per digit.
+/// @param  p In, the first character, out, the character after the number
+/// @param  pEnd Pointer to end of the line
+/// @param  width Maximum characters of the number, 4 or 8
+/// @param  value Out, the number
+/// @return false if there is no number
+////////////////////////////////////////////////////////////////////////////////
+static inline bool ParseHex(const char *&p, const char *pEnd, size_t width, unsigned int &value)
+{
+    if ((size_t) (pEnd - p) >= width)
+    {
+        unsigned int v = 0;
+        unsigned int bad = 0;
+        for (size_t i = 0; i < width; i++)
+        {
+            unsigned int d = g_hexDigit[(unsigned char) p[i]];
+            bad |= d;
+            v = (v << 4) | (d & 0x0F);
+        }
+        if (bad <= 0x0F)
+        {
+            p += width;
+            value = v;
+            return true;
+        }
+    }
+
+    return ParseHexSlow(p, pEnd, width, value);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global inline static  StripDeDePrefix
+/// @brief Remove the DeDe prefix of a symbol name and set the target of it
+/// @param  sym The valid symbol
+/// @return void
+////////////////////////////////////////////////////////////////////////////////
+static inline void StripDeDePrefix(MAP_SYMBOL &sym)
+{
+    const char *pname = sym.pName;
+    if ((sym.nameLen >= 2) && ('<' == pname[0]) && ('-' == pname[1]))
+    {
+        // Functions indicator symbol of DeDe map
+        sym.pName += 2;
+        sym.nameLen -= 2;
+        sym.target = MAP_TARGET_NAME;
+    }
+    else if ((sym.nameLen >= 1) && ('*' == pname[0]))
+    {
+        // VCL controls indicator symbol of DeDe map
+        sym.pName++;
+        sym.nameLen--;
+        sym.target = MAP_TARGET_COMMENT;
+    }
+    else if ((sym.nameLen >= 2) && ('-' == pname[0]) && ('>' == pname[1]))
+    {
+        // VCL methods indicator symbol of DeDe map
+        sym.pName += 2;
+        sym.nameLen -= 2;
+        sym.target = MAP_TARGET_COMMENT;
+    }
+}
+
+/* Column layout and name prefixes of the map dialects */
+struct MAP_VC_LAYOUT
+{
+    enum {
+        SEG_DIGITS = 4,         // "%04X:%08X"
+        ADDR_DIGITS = 8
+    };
+
+    // Names are linker names
+    static inline void StripPrefix(MAP_SYMBOL & /* sym */)
+    {
+    }
+};
+
+struct MAP_BORLAND_LAYOUT
+{
+    enum {
+        SEG_DIGITS = 4,
+        ADDR_DIGITS = 8
+    };
+
+    // "<-", "*" and "->" of DeDe maps
+    static inline void StripPrefix(MAP_SYMBOL &sym)
+    {
+        StripDeDePrefix(sym);
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  ParseMapLine
+/// @brief Parse a "seg:addr name" line of the symbol table. The line is
+/// tokenized like scanf(" %04X : %08X %s") reading at most maxNameLen +
+/// MAP_MIN_LINE_LEN characters of it.
+/// @param  LAYOUT MAP_xxx_LAYOUT of the dialect
+/// @param  pLine The line, without EOL characters
+/// @param  lineLen Length of the line
+/// @param  params What a valid symbol is
+/// @param  sym Out, the record of the line
+/// @return void
+////////////////////////////////////////////////////////////////////////////////
+template <class LAYOUT>
+static void ParseMapLine(const char *pLine, size_t lineLen, const MAP_PARSE_PARAMS &params,
+                         MAP_SYMBOL &sym)
+{
+    const char *pEnd = pLine + min(lineLen, params.maxNameLen + MAP_MIN_LINE_LEN);
+    const char *p = pLine;
+    const char *pName = NULL;
+    unsigned int seg = 0;
+    unsigned int addr = 0;
+
+    // Get segment number, address, name, by pass spaces at beginning,
+    // between ':' character, between address and name
+    p = SkipSpaces(p, pEnd);
+    if (ParseHex(p, pEnd, LAYOUT::SEG_DIGITS, seg))
+    {
+        p = SkipSpaces(p, pEnd);
+        if ((p < pEnd) && (':' == *p))
+        {
+            p = SkipSpaces(p + 1, pEnd);
+            if (ParseHex(p, pEnd, LAYOUT::ADDR_DIGITS, addr))
+            {
+                pName = SkipSpaces(p, pEnd);
+                p = pName;
+                while ((p < pEnd) && !IsSpace(*p))
+                {
+                    p++;
+                }
+            }
+        }
+    }
+
+    sym.pLine = pLine;
+    sym.lineLen = lineLen;
+    sym.pName = NULL;
+    sym.nameLen = 0;
+    sym.target = MAP_TARGET_OPTION;
+    if ((NULL == pName) || (p == pName))
+    {
+        // we have parsed to end of value/name symbols table or reached EOF
+        sym.kind = MAP_SYMBOL_END;
+    }
+    else if ((0 == seg) || (params.badAddr == (uint64_t) addr))
+    {
+        sym.kind = MAP_SYMBOL_INVALID;
+    }
+    else
+    {
+        seg--;
+        sym.pName = pName;
+        sym.nameLen = min((size_t) (p - pName), params.maxNameLen);
+        sym.kind = MAP_SYMBOL_VALID;
+        LAYOUT::StripPrefix(sym);
+    }
+    sym.seg = seg;
+    sym.addr = addr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global static  ParseChunkProc
+/// @brief Worker job, parses the lines of one chunk
+/// @param  LAYOUT MAP_xxx_LAYOUT of the dialect
+/// @param  ctx MAP_PARSE_JOB
+/// @param  index The chunk in the round
+/// @return void
+////////////////////////////////////////////////////////////////////////////////
+template <class LAYOUT>
+static void ParseChunkProc(void *ctx, size_t index)
+{
+    MAP_PARSE_JOB &job = *(MAP_PARSE_JOB *) ctx;
+    MAP_CHUNK &chunk = job.chunks[job.firstChunk + index];
+
+    // About one symbol per 40 bytes in VC and Borland maps
+    chunk.symbols.reserve((size_t) (chunk.pEnd - chunk.pStart) / 40 + 1);
+
+    const char *pLine = chunk.pStart;
+    const char *pEOL = chunk.pStart;
+    while (pLine < chunk.pEnd)
+    {
+        pLine = SkipSpaces(pEOL, chunk.pEnd);
+        pEOL = FindEOL(pLine, chunk.pEnd);
+        if (IsNulChar(pEOL, chunk.pEnd))
+        {
+            chunk.bBinary = true;
+            break;
+        }
+
+        size_t lineLen = (size_t) (pEOL - pLine);
+        if (lineLen < MAP_MIN_LINE_LEN)
+        {
+            continue;
+        }
+
+        MAP_SYMBOL sym;
+        ParseMapLine<LAYOUT>(pLine, lineLen, *job.pParams, sym);
+        chunk.symbols.push_back(sym);
+        if (MAP_SYMBOL_END == sym.kind)
+        {
+            chunk.bEnd = true;
+            break;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// global  ParseMapTable
+/// @brief Parse the symbol table in line aligned chunks on the worker threads
+/// and join the records of the chunks in file order
+/// @param  pStart Pointer to the end of the header line
+/// @param  pEnd Pointer to end of the map file
+/// @param  params What a valid symbol is
+/// @param  workers The parse threads, one thread without progress parses
+/// the whole table as one chunk
+/// @param  symbols Out, the records up to and including the first
+/// MAP_SYMBOL_END record
+/// @param  pfnProgress NULL, or called with the bytes of the table parsed
+/// after every round of MAP_ROUND_CHUNKS chunks per thread. The parse stops
+/// when it returns true, the records are incomplete then
+/// @param  ctx Context of pfnProgress
+/// @return false if a NUL character is found before the end of the table
+////////////////////////////////////////////////////////////////////////////////
+bool ParseMapTable(const char *pStart, const char *pEnd, const MAP_PARSE_PARAMS &params,
+                   WORKER_POOL &workers, std::vector<MAP_SYMBOL> &symbols,
+                   PFN_MAP_PROGRESS pfnProgress, void *ctx)
+{
+    _ASSERTE(pStart <= pEnd);
+
+    symbols.clear();
+
+    // Cut the table at the first EOL character after every MAP_CHUNK_SIZE bytes
+    vector<const char *> bounds;
+    bounds.push_back(pStart);
+    if ((workers.GetThreadCount() > 1) || (NULL != pfnProgress))
+    {
+        const char *p = pStart;
+        while ((size_t) (pEnd - p) > MAP_CHUNK_SIZE)
+        {
+            p = FindEOL(p + MAP_CHUNK_SIZE, pEnd);
+            if (p < pEnd)
+            {
+                bounds.push_back(p);
+            }
+        }
+    }
+    bounds.push_back(pEnd);
+
+    MAP_PARSE_JOB job;
+    job.pParams = &params;
+    job.firstChunk = 0;
+    job.chunks.resize(bounds.size() - 1);
+    for (size_t i = 0; i < job.chunks.size(); i++)
+    {
+        job.chunks[i].pStart = bounds[i];
+        job.chunks[i].pEnd = bounds[i + 1];
+        job.chunks[i].bEnd = false;
+        job.chunks[i].bBinary = false;
+    }
+
+    // Select the parser of the dialect once for all lines
+    PFN_JOB_PROC pfnParse = (MAP_DIALECT_VC == params.dialect) ?
+                            ParseChunkProc<MAP_VC_LAYOUT> : ParseChunkProc<MAP_BORLAND_LAYOUT>;
+    if (NULL == pfnProgress)
+    {
+        workers.Run(job.chunks.size(), pfnParse, &job);
+    }
+    else
+    {
+        // Rounds of chunks, the chunks after the end of the table or a NUL
+        // character are not parsed
+        size_t roundChunks = max(workers.GetThreadCount(), 1u) * MAP_ROUND_CHUNKS;
+        bool bStop = false;
+        while (!bStop && (job.firstChunk < job.chunks.size()))
+        {
+            size_t count = min(roundChunks, job.chunks.size() - job.firstChunk);
+            workers.Run(count, pfnParse, &job);
+            for (size_t i = job.firstChunk; i < job.firstChunk + count; i++)
+            {
+                bStop = bStop || job.chunks[i].bEnd || job.chunks[i].bBinary;
+            }
+            job.firstChunk += count;
+
+            const char *pDone = (job.firstChunk < job.chunks.size()) ?
+                                job.chunks[job.firstChunk].pStart : pEnd;
+            bStop = pfnProgress(ctx, (uint64_t) (pDone - pStart)) || bStop;
+        }
+    }
+
+    // The table ends in the first chunk with a MAP_SYMBOL_END record, the
+    // NUL characters after it are not in the table
+    size_t numChunks = 0;
+    size_t total = 0;
+    while (numChunks < job.chunks.size())
+    {
+        if (job.chunks[numChunks].bBinary)
+        {
+            return false;
+        }
+        total += job.chunks[numChunks].symbols.size();
+        if (job.chunks[numChunks++].bEnd)
+        {
+            break;
+        }
+    }
+
+    if (1 == numChunks)
+    {
+        symbols.swap(job.chunks[0].symbols);
+        return true;
+    }
+
+    symbols.reserve(total);
+    for (size_t i = 0; i < numChunks; i++)
+    {
+        vector<MAP_SYMBOL> &chunkSymbols = job.chunks[i].symbols;
+        symbols.insert(symbols.end(), chunkSymbols.begin(), chunkSymbols.end());
+        vector<MAP_SYMBOL>().swap(chunkSymbols);
+    }
+
+    return true;
+}
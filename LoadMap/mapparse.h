@@ -0,0 +1,105 @@
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file mapparse.h
+ * Map file symbol table parser of the LoadMap plugin.
+ * The symbol table is split into line aligned chunks, which are parsed on
+ * worker threads into symbol records. The records of all chunks are joined
+ * in file order, so they are the same as the records of a serial parse.
+ * The dialect of the map file is found from the header line, the lines are
+ * parsed by a parser specialized for the dialect at compile time.
+ * A NUL character in the text before the end of the table fails the parse,
+ * so the file is checked for binary data in the same pass.
+ * Does not call the IDA SDK, the records are applied by the caller.
+ * @author TQN (truong_quoc_ngan@yahoo.com)
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __LOADMAP_MAPPARSE_H__
+#define __LOADMAP_MAPPARSE_H__
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "threads.h"
+
+#ifndef _ASSERTE
+    #include <assert.h>
+    #define _ASSERTE(x) assert(x)
+#endif
+
+#define MAP_MIN_LINE_LEN    14          // For a "xxxx:xxxxxxxx " line
+#define MAP_CHUNK_SIZE      0x80000     // Bytes of the symbol table per parse job
+#define MAP_ROUND_CHUNKS    4           // chunks per thread between two progress calls
+
+typedef enum _tagMAP_SYMBOL_KIND {
+    MAP_SYMBOL_VALID = 0,       // seg, addr and name are set
+    MAP_SYMBOL_INVALID,         // segment number 0 or bad address
+    MAP_SYMBOL_END              // not a symbol line, the table ends here
+} MAP_SYMBOL_KIND;
+
+/* Map file dialects, from the symbol table header */
+typedef enum _tagMAP_DIALECT {
+    MAP_DIALECT_VC = 0,         // "Publics by Value ... Rva+Base Lib:Object"
+    MAP_DIALECT_BORLAND         // "Publics by Name" or "Publics by Value", also
+                                // DeDe maps, names with the DeDe prefixes
+} MAP_DIALECT;
+
+/* Where a symbol is applied, from the DeDe name prefix */
+typedef enum _tagMAP_SYMBOL_TARGET {
+    MAP_TARGET_OPTION = 0,      // no prefix, the name or comment plugin option
+    MAP_TARGET_NAME,            // "<-" functions
+    MAP_TARGET_COMMENT          // "*" VCL controls, "->" VCL methods
+} MAP_SYMBOL_TARGET;
+
+/* One parsed line of the symbol table, the text stays in the map file */
+typedef struct _tagMAP_SYMBOL {
+    const char *pLine;          // the line, for messages
+    size_t lineLen;
+    const char *pName;          // not NUL terminated, without the DeDe prefix
+    size_t nameLen;             // at most MAP_PARSE_PARAMS::maxNameLen
+    unsigned int seg;           // zero based segment number, not checked
+                                // against the segments of the database
+    unsigned int addr;          // offset in the segment
+    MAP_SYMBOL_KIND kind;
+    MAP_SYMBOL_TARGET target;
+} MAP_SYMBOL;
+
+/* What a valid symbol line is */
+typedef struct _tagMAP_PARSE_PARAMS {
+    uint64_t badAddr;           // address value rejected as invalid, BADADDR
+    size_t maxNameLen;          // longer names are cut
+    MAP_DIALECT dialect;        // of the table, from FindMapTables
+} MAP_PARSE_PARAMS;
+
+/*
+ * Progress of a long phase, called on the calling thread with the units
+ * done so far (bytes or symbols), returns true to stop the phase
+ */
+typedef bool (*PFN_MAP_PROGRESS)(void *ctx, uint64_t done);
+
+/* Select the SIMD kernels, call it before the first ParseMapTable */
+void InitMapParser(void);
+
+/* The symbol tables of a map file, from FindMapTables */
+typedef struct _tagMAP_TABLES {
+    const char *pByName;        // first line of "Publics by Name", NULL if none
+    const char *pByValue;       // first line of "Publics by Value", NULL if none
+    MAP_DIALECT valueDialect;   // of "Publics by Value", "Publics by Name" is Borland
+    const char *pNul;           // first NUL character of the search, NULL if none,
+                                // the file is binary if it is before the table
+} MAP_TABLES;
+
+/* Find the symbol table headers in one search, returns false if there is none */
+bool FindMapTables(const char *pStart, const char *pEnd, MAP_TABLES &tables);
+
+/* Parse the symbol table [pStart, pEnd) up to and including its MAP_SYMBOL_END
+   line, returns false for a binary file. pfnProgress gets the bytes of the
+   table parsed, when it stops the parse the symbols are incomplete */
+bool ParseMapTable(const char *pStart, const char *pEnd, const MAP_PARSE_PARAMS &params,
+                   WORKER_POOL &workers, std::vector<MAP_SYMBOL> &symbols,
+                   PFN_MAP_PROGRESS pfnProgress, void *ctx);
+
+#endif  // __LOADMAP_MAPPARSE_H__
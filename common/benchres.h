@@ -0,0 +1,167 @@
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file benchres.h
+ * Timer and results of the standalone benchmarks of the IDB2SIG and LoadMap
+ * plugins. The results are printed as ns per byte and items per second and
+ * written as CSV, the CSV files of two builds are compared row by row.
+ * Not used by the plugins.
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __COMMON_BENCHRES_H__
+#define __COMMON_BENCHRES_H__
+
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get a wall clock time in seconds, only the difference of two
+/// times is meaningful
+////////////////////////////////////////////////////////////////////////////////
+static inline double BenchNow(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double) count.QuadPart / (double) freq.QuadPart;
+#else
+    struct timespec ts;
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+#endif
+}
+
+/* One measurement */
+typedef struct tagBENCH_RESULT {
+    std::string kernel;
+    std::string set;
+    double bytes;               // bytes processed in all passes
+    double items;               // lines or symbols made in all passes, 0 if none
+    double seconds;
+} BENCH_RESULT;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief The results of a benchmark run
+////////////////////////////////////////////////////////////////////////////////
+struct BENCH_RESULTS
+{
+    /* Add a result and print it, pszUnit names the items */
+    void Add(const char *pszKernel, const char *pszSet, double bytes, double items,
+             double seconds, const char *pszUnit)
+    {
+        BENCH_RESULT r;
+        r.kernel = pszKernel;
+        r.set = pszSet;
+        r.bytes = bytes;
+        r.items = items;
+        r.seconds = seconds;
+        results.push_back(r);
+
+        printf("%-22s %-15s %8.3f ns/byte", pszKernel, pszSet,
+               (bytes > 0) ? seconds * 1e9 / bytes : 0.0);
+        if ((items > 0) && (seconds > 0))
+        {
+            printf(" %12.0f %s/s", items / seconds, pszUnit);
+        }
+        printf("\n");
+    }
+
+    /* Write the results as CSV, false if the file could not be written */
+    bool WriteCsv(const char *pszFile) const
+    {
+        FILE *fp = fopen(pszFile, "w");
+        if (NULL == fp)
+        {
+            return false;
+        }
+
+        fprintf(fp, "kernel,set,bytes,items,seconds,ns_per_byte,items_per_sec\n");
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const BENCH_RESULT &r = results[i];
+            fprintf(fp, "%s,%s,%.0f,%.0f,%.6f,%.4f,%.0f\n", r.kernel.c_str(), r.set.c_str(),
+                    r.bytes, r.items, r.seconds,
+                    (r.bytes > 0) ? r.seconds * 1e9 / r.bytes : 0.0,
+                    ((r.items > 0) && (r.seconds > 0)) ? r.items / r.seconds : 0.0);
+        }
+
+        return (0 == fclose(fp));
+    }
+
+    /* Read the results of WriteCsv */
+    bool ReadCsv(const char *pszFile)
+    {
+        FILE *fp = fopen(pszFile, "r");
+        if (NULL == fp)
+        {
+            return false;
+        }
+
+        char line[512];
+        while (NULL != fgets(line, sizeof(line), fp))
+        {
+            char kernel[128], set[256];
+            BENCH_RESULT r;
+            if (5 == sscanf(line, "%127[^,],%255[^,],%lf,%lf,%lf", kernel, set, &r.bytes,
+                            &r.items, &r.seconds))
+            {
+                r.kernel = kernel;
+                r.set = set;
+                results.push_back(r);
+            }
+        }
+
+        (void) fclose(fp);
+        return true;
+    }
+
+    /* Print the ns/byte of the rows of both CSV files and the speedup */
+    static int Compare(const char *pszBase, const char *pszNew)
+    {
+        BENCH_RESULTS base, cur;
+        if (!base.ReadCsv(pszBase) || !cur.ReadCsv(pszNew))
+        {
+            printf("Could not read %s or %s\n", pszBase, pszNew);
+            return 1;
+        }
+
+        printf("%-22s %-15s %12s %12s %8s\n", "kernel", "set", "base ns/B", "new ns/B",
+               "speedup");
+        for (size_t i = 0; i < cur.results.size(); i++)
+        {
+            const BENCH_RESULT &n = cur.results[i];
+            for (size_t j = 0; j < base.results.size(); j++)
+            {
+                const BENCH_RESULT &b = base.results[j];
+                if ((b.kernel == n.kernel) && (b.set == n.set) && (b.bytes > 0) &&
+                    (n.bytes > 0))
+                {
+                    double nsBase = b.seconds * 1e9 / b.bytes;
+                    double nsNew = n.seconds * 1e9 / n.bytes;
+                    printf("%-22s %-15s %12.3f %12.3f %7.2fx\n", n.kernel.c_str(),
+                           n.set.c_str(), nsBase, nsNew, (nsNew > 0) ? nsBase / nsNew : 0.0);
+                    break;
+                }
+            }
+        }
+        return 0;
+    }
+
+    std::vector<BENCH_RESULT> results;
+};
+
+#endif  // __COMMON_BENCHRES_H__
@@ -0,0 +1,101 @@
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file cpufeat.h
+ * x86 SIMD support shared by the IDB2SIG and LoadMap kernels: which
+ * instruction sets the compiler can target, and which ones the CPU and
+ * the OS support at runtime.
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __COMMON_CPUFEAT_H__
+#define __COMMON_CPUFEAT_H__
+
+#pragma once
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+    #define CPU_X86
+    #include <emmintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #if (_MSC_VER >= 1700)          // AVX2 intrinsics need VS2012
+            #define CPU_AVX2
+            #include <immintrin.h>
+        #endif
+        #define CPU_TARGET(x)
+    #else
+        #define CPU_AVX2
+        #include <immintrin.h>
+        #define CPU_TARGET(x)   __attribute__((target(x)))
+    #endif
+#endif
+
+#ifdef CPU_X86
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Index of the lowest set bit, mask must not be 0
+////////////////////////////////////////////////////////////////////////////////
+static inline unsigned int LowestBit(unsigned int mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    (void) _BitScanForward(&index, mask);
+    return (unsigned int) index;
+#else
+    return (unsigned int) __builtin_ctz(mask);
+#endif
+}
+
+#ifdef _MSC_VER
+
+static inline bool CpuHasSSE2(void)
+{
+    int info[4];
+    __cpuid(info, 1);
+    return (0 != (info[3] & (1 << 26)));
+}
+
+#ifdef CPU_AVX2
+static inline bool CpuHasAVX2(void)
+{
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+
+    // The OS must also save the YMM registers
+    __cpuid(info, 1);
+    if ((info[2] & ((1 << 27) | (1 << 28))) != ((1 << 27) | (1 << 28)))
+    {
+        return false;
+    }
+    if ((_xgetbv(0) & 6) != 6)
+    {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (0 != (info[1] & (1 << 5)));
+}
+#endif
+
+#else
+
+static inline bool CpuHasSSE2(void)
+{
+    __builtin_cpu_init();
+    return (0 != __builtin_cpu_supports("sse2"));
+}
+
+static inline bool CpuHasAVX2(void)
+{
+    __builtin_cpu_init();
+    return (0 != __builtin_cpu_supports("avx2"));
+}
+
+#endif  // _MSC_VER
+
+#endif  // CPU_X86
+
+#endif  // __COMMON_CPUFEAT_H__
@@ -0,0 +1,162 @@
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file diaglog.h
+ * Diagnostics of the IDB2SIG and LoadMap plugins, one record per item
+ * instead of one output window message. The records are kept in a fixed
+ * buffer with a pool of their names, and are formatted and written as
+ * blocks of lines when the buffer is full or the run ends, to the output
+ * window or to a report file.
+ * Does not call the IDA SDK, the plugins give the format and write procedures.
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __COMMON_DIAGLOG_H__
+#define __COMMON_DIAGLOG_H__
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#define DIAG_MAX_RECORDS    4096            // records kept before a flush
+#define DIAG_NAME_POOL      (128 * 1024)    // bytes of names kept before a flush
+#define DIAG_BLOCK_SIZE     (64 * 1024)     // default longest text written at once
+
+/* The diagnostic of one item */
+typedef struct tagDIAG_RECORD {
+    uint64_t addr;          // address of the item
+    uint64_t values[2];     // details: a segment, a length and its limit, a target
+    const char *pName;      // name or text of the item, in the name pool, not NUL terminated
+    uint32_t nameLen;
+    uint16_t outcome;       // defined by the plugin
+    uint16_t reason;        // defined by the plugin
+} DIAG_RECORD;
+
+/* Format a record as lines of text, returns the length, less than size unless truncated */
+typedef size_t (*PFN_DIAG_FORMAT)(char *pszBuf, size_t size, const DIAG_RECORD &rec);
+
+/* Write a block of whole lines, NUL terminated */
+typedef void (*PFN_DIAG_WRITE)(void *ctx, const char *pszText, size_t len);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Buffered diagnostic records, used by one thread
+////////////////////////////////////////////////////////////////////////////////
+struct DIAG_LOG
+{
+    DIAG_LOG(PFN_DIAG_FORMAT pfnFormat, PFN_DIAG_WRITE pfnWrite, void *ctx,
+             size_t blockSize = DIAG_BLOCK_SIZE)
+        : m_pfnFormat(pfnFormat), m_pfnWrite(pfnWrite), m_pWriteCtx(ctx),
+          m_blockSize(blockSize), m_poolUsed(0), m_total(0)
+    {
+    }
+
+    /* Change where the next flushes write */
+    void SetOutput(PFN_DIAG_FORMAT pfnFormat, PFN_DIAG_WRITE pfnWrite, void *ctx,
+                   size_t blockSize = DIAG_BLOCK_SIZE)
+    {
+        Flush();
+        m_pfnFormat = pfnFormat;
+        m_pfnWrite = pfnWrite;
+        m_pWriteCtx = ctx;
+        m_blockSize = blockSize;
+    }
+
+    /* Add a record, the name is copied, flushes when the buffer is full */
+    void Add(uint16_t outcome, uint16_t reason, uint64_t addr, const char *pName, size_t nameLen,
+             uint64_t value0 = 0, uint64_t value1 = 0)
+    {
+        if (m_records.empty())
+        {
+            // The names must not move, the pool never grows
+            m_records.reserve(DIAG_MAX_RECORDS);
+            m_pool.resize(DIAG_NAME_POOL);
+        }
+        if (nameLen > DIAG_NAME_POOL)
+        {
+            nameLen = DIAG_NAME_POOL;
+        }
+        if ((m_records.size() >= DIAG_MAX_RECORDS) || (DIAG_NAME_POOL - m_poolUsed < nameLen))
+        {
+            Flush();
+        }
+
+        DIAG_RECORD rec;
+        rec.addr = addr;
+        rec.values[0] = value0;
+        rec.values[1] = value1;
+        rec.pName = &m_pool[0] + m_poolUsed;
+        rec.nameLen = (uint32_t) nameLen;
+        rec.outcome = outcome;
+        rec.reason = reason;
+        if (nameLen > 0)
+        {
+            memcpy(&m_pool[0] + m_poolUsed, pName, nameLen);
+        }
+        m_poolUsed += nameLen;
+        m_records.push_back(rec);
+        m_total++;
+    }
+
+    /* Format the records and write them in blocks of whole lines */
+    void Flush()
+    {
+        if (m_records.empty())
+        {
+            return;
+        }
+
+        if (m_text.size() < m_blockSize + 1)
+        {
+            m_text.resize(m_blockSize + 1);
+        }
+        char *pText = &m_text[0];
+
+        size_t used = 0;
+        for (size_t i = 0; i < m_records.size(); i++)
+        {
+            size_t len = m_pfnFormat(pText + used, m_blockSize + 1 - used, m_records[i]);
+            if ((used + len >= m_blockSize) && (used > 0))
+            {
+                // Maybe truncated, format it again at the start of the next block
+                pText[used] = '\0';
+                m_pfnWrite(m_pWriteCtx, pText, used);
+                used = 0;
+                len = m_pfnFormat(pText, m_blockSize + 1, m_records[i]);
+            }
+            used += (len < m_blockSize) ? len : m_blockSize;
+        }
+        if (used > 0)
+        {
+            pText[used] = '\0';
+            m_pfnWrite(m_pWriteCtx, pText, used);
+        }
+
+        m_records.clear();
+        m_poolUsed = 0;
+    }
+
+    /* Records added since the log was created */
+    size_t GetTotal() const
+    {
+        return m_total;
+    }
+
+private:
+    PFN_DIAG_FORMAT m_pfnFormat;
+    PFN_DIAG_WRITE m_pfnWrite;
+    void *m_pWriteCtx;
+    size_t m_blockSize;
+
+    std::vector<DIAG_RECORD> m_records;
+    std::vector<char> m_pool;           // names of the records
+    size_t m_poolUsed;
+    std::vector<char> m_text;           // block being formatted
+    size_t m_total;
+
+    DIAG_LOG(const DIAG_LOG &);
+    DIAG_LOG &operator=(const DIAG_LOG &);
+};
+
+#endif  // __COMMON_DIAGLOG_H__
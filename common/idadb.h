@@ -0,0 +1,105 @@
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file idadb.h
+ * The part of the IDA database the engines of the IDB2SIG and LoadMap
+ * plugins use: segments and their bytes, items with their names and
+ * references, functions and entry points, and setting names and comments.
+ * The plugins pass the SDK_DB of sdkdb.h, the command line tools and the
+ * benchmarks a MEM_DB of memdb.h, so the engines also run without IDA.
+ * Does not call the IDA SDK.
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __COMMON_IDADB_H__
+#define __COMMON_IDADB_H__
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* An address of the database, the size of ea_t */
+#ifdef __EA64__
+typedef uint64_t db_ea_t;
+#else
+typedef uint32_t db_ea_t;
+#endif
+
+#define DB_BADADDR          ((db_ea_t) -1)
+
+/* IDA_DB::GetFlags, the name and comment flags of an address */
+#define DB_HAS_NAME         0x01    // has_name
+#define DB_HAS_DUMMY_NAME   0x02    // has_dummy_name, like loc_401000
+#define DB_HAS_AUTO_NAME    0x04    // has_auto_name
+#define DB_HAS_USER_NAME    0x08    // has_user_name
+#define DB_HAS_CMT          0x10    // has_cmt
+#define DB_HAS_ANY_NAME     (DB_HAS_NAME | DB_HAS_DUMMY_NAME)
+
+/* A segment */
+typedef struct tagDB_SEGMENT {
+    db_ea_t startEA;
+    db_ea_t endEA;
+    bool bCode;                     // SEG_CODE
+} DB_SEGMENT;
+
+/* A function */
+typedef struct tagDB_FUNC {
+    db_ea_t startEA;
+    db_ea_t endEA;
+    bool bLib;                      // FUNC_LIB
+} DB_FUNC;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief The database calls of the plugin engines, one SDK call each.
+/// Only the main thread may use the SDK_DB.
+////////////////////////////////////////////////////////////////////////////////
+struct IDA_DB
+{
+    virtual ~IDA_DB() {}
+
+    /* get_segm_qty and getnseg */
+    virtual size_t GetSegmentCount() const = 0;
+    virtual bool GetSegment(size_t n, DB_SEGMENT &seg) const = 0;
+
+    /* get_segm_name, the length of the name */
+    virtual size_t GetSegmentName(db_ea_t ea, char *pszBuf, size_t size) const = 0;
+
+    /* get_many_bytes, the bytes which are not loaded are read as get_byte reads them */
+    virtual void GetBytes(db_ea_t ea, uint8_t *pBuf, size_t size) const = 0;
+
+    /* DB_HAS_* of getFlags */
+    virtual uint32_t GetFlags(db_ea_t ea) const = 0;
+
+    /* get_item_end and next_not_tail */
+    virtual db_ea_t GetItemEnd(db_ea_t ea) const = 0;
+    virtual db_ea_t NextHead(db_ea_t ea) const = 0;
+
+    /* get_true_name, NULL if the address has no name */
+    virtual const char *GetName(db_ea_t ea, char *pszBuf, size_t size) const = 0;
+
+    /* is_uname, the name is not a dummy name */
+    virtual bool IsUserName(const char *pszName) const = 0;
+
+    /* is_public_name */
+    virtual bool IsPublicName(db_ea_t ea) const = 0;
+
+    /* get_first_dref_from, get_next_dref_from and get_first_fcref_from */
+    virtual db_ea_t GetFirstDref(db_ea_t ea) const = 0;
+    virtual db_ea_t GetNextDref(db_ea_t ea, db_ea_t current) const = 0;
+    virtual db_ea_t GetFirstFcref(db_ea_t ea) const = 0;
+
+    /* get_func_qty, getn_func and get_func */
+    virtual size_t GetFuncCount() const = 0;
+    virtual bool GetFunc(size_t n, DB_FUNC &func) const = 0;
+    virtual bool GetFuncAt(db_ea_t ea, DB_FUNC &func) const = 0;
+
+    /* get_entry_qty, and get_entry of get_entry_ordinal, DB_BADADDR if none */
+    virtual size_t GetEntryCount() const = 0;
+    virtual db_ea_t GetEntry(size_t n) const = 0;
+
+    /* set_name without warnings and set_cmt of a regular comment */
+    virtual bool SetName(db_ea_t ea, const char *pszName) = 0;
+    virtual bool SetCmt(db_ea_t ea, const char *pszCmt) = 0;
+};
+
+#endif  // __COMMON_IDADB_H__
@@ -0,0 +1,953 @@
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file memdb.h
+ * An IDA_DB in memory, for the command line tools and the benchmarks.
+ * Everything is kept in flat arrays: the segments with the bytes of the
+ * code segments, the items sorted by address with their references, and
+ * an open addressing hash table of the addresses with a name or a comment.
+ * The items are found by a binary search, or in O(1) when they are visited
+ * in address order as the engines do, so a run measures the engines and
+ * not the database.
+ * The plugins record the MEM_DB of the open database with Record and Save,
+ * and the tools Load it.
+ * Does not call the IDA SDK.
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __COMMON_MEMDB_H__
+#define __COMMON_MEMDB_H__
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "idadb.h"
+
+#define MEM_DB_MAGIC        "IDADBSNP"
+#define MEM_DB_VERSION      1
+#define MEM_DB_NO_NAME      0xFFFFFFFF      // no name or comment in the pool
+#define MEM_DB_IS_PUBLIC    0x80000000      // flags, is_public_name, not a DB_HAS_* flag
+#define MEM_DB_IN_USE       0x40000000      // flags, the slot of the address is used
+#define MEM_DB_NAME_SIZE    1024            // longest name recorded
+
+/* Write or read a block of a recorded database, false on errors */
+typedef bool (*PFN_DB_WRITE)(void *ctx, const char *pData, size_t len);
+typedef bool (*PFN_DB_READ)(void *ctx, void *pData, size_t len);
+
+/* A segment, the name in the name pool */
+typedef struct tagMEM_SEGMENT {
+    db_ea_t startEA;
+    db_ea_t endEA;
+    uint32_t nameOff;
+    uint32_t bCode;                 // the bytes are kept
+} MEM_SEGMENT;
+
+/* An item, the head of an instruction or data */
+typedef struct tagMEM_ITEM {
+    db_ea_t ea;
+    db_ea_t endEA;
+    db_ea_t fcref;                  // first code reference, DB_BADADDR if none
+    uint32_t firstDref;             // data references in drefs
+    uint32_t numDrefs;
+} MEM_ITEM;
+
+/* An address with a name or a comment, the strings in the name pool */
+typedef struct tagMEM_ADDR {
+    db_ea_t ea;
+    uint32_t flags;                 // DB_HAS_*, MEM_DB_IS_PUBLIC and MEM_DB_IN_USE, 0 if free
+    uint32_t nameOff;
+    uint32_t cmtOff;
+} MEM_ADDR;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief The recorded database. Not thread safe, the item lookups keep a
+/// cursor like the SDK keeps its cache.
+////////////////////////////////////////////////////////////////////////////////
+struct MEM_DB : public IDA_DB
+{
+    MEM_DB() : m_numAddrs(0), m_numNames(0), m_cursor(0) {}
+
+    void Clear()
+    {
+        m_segments.clear();
+        m_bytes.clear();
+        m_items.clear();
+        m_drefs.clear();
+        m_funcs.clear();
+        m_entries.clear();
+        m_pool.clear();
+        m_addrs.clear();
+        m_names.clear();
+        m_numAddrs = 0;
+        m_numNames = 0;
+        m_cursor = 0;
+    }
+
+    /* Size the hash tables for a number of addresses with a name or a comment */
+    void Reserve(size_t numAddrs)
+    {
+        size_t size = 1024;
+        while (size < 2 * numAddrs)
+        {
+            size <<= 1;
+        }
+        if (size > m_addrs.size())
+        {
+            ResizeAddrs(size);
+        }
+        if (size > m_names.size())
+        {
+            ResizeNames(size);
+        }
+    }
+
+    /* Add a segment after the previous one, returns the buffer of the bytes
+       of a code segment to fill, else NULL */
+    uint8_t *AddSegment(db_ea_t startEA, db_ea_t endEA, bool bCode, const char *pszName)
+    {
+        MEM_SEGMENT seg;
+        seg.startEA = startEA;
+        seg.endEA = endEA;
+        seg.nameOff = AddString(pszName);
+        seg.bCode = bCode ? 1 : 0;
+        m_segments.push_back(seg);
+        m_bytes.push_back(std::vector<uint8_t>());
+        if (!bCode)
+        {
+            return NULL;
+        }
+
+        m_bytes.back().resize((size_t) (endEA - startEA));
+        return m_bytes.back().empty() ? NULL : &m_bytes.back()[0];
+    }
+
+    /* Add an item after the previous one */
+    void AddItem(db_ea_t ea, db_ea_t endEA)
+    {
+        MEM_ITEM item;
+        item.ea = ea;
+        item.endEA = endEA;
+        item.fcref = DB_BADADDR;
+        item.firstDref = (uint32_t) m_drefs.size();
+        item.numDrefs = 0;
+        m_items.push_back(item);
+    }
+
+    /* References of the last item */
+    void AddDref(db_ea_t target)
+    {
+        m_drefs.push_back(target);
+        m_items.back().numDrefs++;
+    }
+
+    void SetFcref(db_ea_t target)
+    {
+        m_items.back().fcref = target;
+    }
+
+    /* Add a function after the previous one */
+    void AddFunc(const DB_FUNC &func)
+    {
+        m_funcs.push_back(func);
+    }
+
+    void AddEntry(db_ea_t ea)
+    {
+        m_entries.push_back(ea);
+    }
+
+    /* Set a name with its DB_HAS_* flags, as the database has it */
+    void AddName(db_ea_t ea, const char *pszName, uint32_t flags, bool bPublic)
+    {
+        MEM_ADDR *pAddr = InsertAddr(ea);
+        RemoveName(*pAddr);
+        pAddr->flags = (pAddr->flags & (DB_HAS_CMT | MEM_DB_IN_USE)) | flags |
+                       (bPublic ? MEM_DB_IS_PUBLIC : 0);
+        pAddr->nameOff = AddString(pszName);
+        InsertName(HashName(pszName), ea);
+    }
+
+    /* Copy everything the engines read from another database */
+    void Record(const IDA_DB &db)
+    {
+        char szName[MEM_DB_NAME_SIZE];
+        std::vector<db_ea_t> targets;
+
+        Clear();
+        size_t numSegs = db.GetSegmentCount();
+        for (size_t n = 0; n < numSegs; n++)
+        {
+            DB_SEGMENT seg;
+            if (!db.GetSegment(n, seg) || (seg.endEA < seg.startEA))
+            {
+                continue;
+            }
+            (void) db.GetSegmentName(seg.startEA, szName, sizeof(szName));
+            uint8_t *pBytes = AddSegment(seg.startEA, seg.endEA, seg.bCode, szName);
+            if (NULL != pBytes)
+            {
+                db.GetBytes(seg.startEA, pBytes, (size_t) (seg.endEA - seg.startEA));
+            }
+        }
+
+        // The items of the code segments with their names and references
+        for (size_t n = 0; n < m_segments.size(); n++)
+        {
+            const MEM_SEGMENT &seg = m_segments[n];
+            if (!seg.bCode)
+            {
+                continue;
+            }
+            for (db_ea_t ea = seg.startEA; (DB_BADADDR != ea) && (ea < seg.endEA);
+                 ea = db.NextHead(ea))
+            {
+                AddItem(ea, db.GetItemEnd(ea));
+                RecordName(db, ea);
+                for (db_ea_t ref = db.GetFirstDref(ea); DB_BADADDR != ref;
+                     ref = db.GetNextDref(ea, ref))
+                {
+                    AddDref(ref);
+                    targets.push_back(ref);
+                }
+                db_ea_t fcref = db.GetFirstFcref(ea);
+                if (DB_BADADDR != fcref)
+                {
+                    SetFcref(fcref);
+                    targets.push_back(fcref);
+                }
+            }
+        }
+        std::sort(m_items.begin(), m_items.end(), ItemLess);
+
+        // The names of the referenced data
+        for (size_t i = 0; i < targets.size(); i++)
+        {
+            if (NULL == FindAddr(targets[i]))
+            {
+                RecordName(db, targets[i]);
+            }
+        }
+
+        size_t numFuncs = db.GetFuncCount();
+        m_funcs.reserve(numFuncs);
+        for (size_t n = 0; n < numFuncs; n++)
+        {
+            DB_FUNC func;
+            if (db.GetFunc(n, func))
+            {
+                AddFunc(func);
+            }
+        }
+
+        size_t numEntries = db.GetEntryCount();
+        for (size_t n = 0; n < numEntries; n++)
+        {
+            AddEntry(db.GetEntry(n));
+        }
+    }
+
+    /* Write the database, in the byte order of this machine */
+    bool Save(PFN_DB_WRITE pfnWrite, void *ctx) const
+    {
+        uint32_t version = MEM_DB_VERSION, eaSize = sizeof(db_ea_t);
+        std::vector<MEM_ADDR> addrs;
+        addrs.reserve(m_numAddrs);
+        for (size_t i = 0; i < m_addrs.size(); i++)
+        {
+            if (0 != m_addrs[i].flags)
+            {
+                addrs.push_back(m_addrs[i]);
+            }
+        }
+
+        bool bOk = pfnWrite(ctx, MEM_DB_MAGIC, 8) &&
+                   pfnWrite(ctx, (const char *) &version, sizeof(version)) &&
+                   pfnWrite(ctx, (const char *) &eaSize, sizeof(eaSize)) &&
+                   WriteArray(pfnWrite, ctx, m_pool) && WriteArray(pfnWrite, ctx, m_segments) &&
+                   WriteArray(pfnWrite, ctx, m_items) && WriteArray(pfnWrite, ctx, m_drefs) &&
+                   WriteArray(pfnWrite, ctx, m_funcs) && WriteArray(pfnWrite, ctx, m_entries) &&
+                   WriteArray(pfnWrite, ctx, addrs);
+        for (size_t n = 0; bOk && (n < m_bytes.size()); n++)
+        {
+            bOk = WriteArray(pfnWrite, ctx, m_bytes[n]);
+        }
+        return bOk;
+    }
+
+    /* Read a database written by Save, false if it is bad or of another
+       version or address size, the database is then empty */
+    bool Load(PFN_DB_READ pfnRead, void *ctx)
+    {
+        char magic[8];
+        uint32_t version = 0, eaSize = 0;
+        std::vector<MEM_ADDR> addrs;
+
+        Clear();
+        bool bOk = pfnRead(ctx, magic, sizeof(magic)) && (0 == memcmp(magic, MEM_DB_MAGIC, 8)) &&
+                   pfnRead(ctx, &version, sizeof(version)) && (MEM_DB_VERSION == version) &&
+                   pfnRead(ctx, &eaSize, sizeof(eaSize)) && (sizeof(db_ea_t) == eaSize) &&
+                   ReadArray(pfnRead, ctx, m_pool) && ReadArray(pfnRead, ctx, m_segments) &&
+                   ReadArray(pfnRead, ctx, m_items) && ReadArray(pfnRead, ctx, m_drefs) &&
+                   ReadArray(pfnRead, ctx, m_funcs) && ReadArray(pfnRead, ctx, m_entries) &&
+                   ReadArray(pfnRead, ctx, addrs);
+        m_bytes.resize(m_segments.size());
+        for (size_t n = 0; bOk && (n < m_bytes.size()); n++)
+        {
+            bOk = ReadArray(pfnRead, ctx, m_bytes[n]) &&
+                  (!m_segments[n].bCode ||
+                   (m_bytes[n].size() == (size_t) (m_segments[n].endEA - m_segments[n].startEA)));
+        }
+        for (size_t i = 0; bOk && (i < addrs.size()); i++)
+        {
+            bOk = (0 != (addrs[i].flags & MEM_DB_IN_USE)) && IsPoolString(addrs[i].nameOff) &&
+                  IsPoolString(addrs[i].cmtOff);
+            if (bOk)
+            {
+                *InsertAddr(addrs[i].ea) = addrs[i];
+                if (MEM_DB_NO_NAME != addrs[i].nameOff)
+                {
+                    InsertName(HashName(&m_pool[addrs[i].nameOff]), addrs[i].ea);
+                }
+            }
+        }
+        for (size_t i = 0; bOk && (i < m_items.size()); i++)
+        {
+            bOk = ((uint64_t) m_items[i].firstDref + m_items[i].numDrefs <= m_drefs.size());
+        }
+        for (size_t n = 0; bOk && (n < m_segments.size()); n++)
+        {
+            bOk = IsPoolString(m_segments[n].nameOff);
+        }
+
+        if (!bOk)
+        {
+            Clear();
+        }
+        return bOk;
+    }
+
+    /* Sizes of the recorded database */
+    size_t GetItemCount() const
+    {
+        return m_items.size();
+    }
+
+    size_t GetNameCount() const
+    {
+        return m_numNames;
+    }
+
+    size_t GetByteCount() const
+    {
+        size_t size = 0;
+        for (size_t n = 0; n < m_bytes.size(); n++)
+        {
+            size += m_bytes[n].size();
+        }
+        return size;
+    }
+
+    // IDA_DB
+
+    virtual size_t GetSegmentCount() const
+    {
+        return m_segments.size();
+    }
+
+    virtual bool GetSegment(size_t n, DB_SEGMENT &seg) const
+    {
+        if (n >= m_segments.size())
+        {
+            return false;
+        }
+        seg.startEA = m_segments[n].startEA;
+        seg.endEA = m_segments[n].endEA;
+        seg.bCode = (0 != m_segments[n].bCode);
+        return true;
+    }
+
+    virtual size_t GetSegmentName(db_ea_t ea, char *pszBuf, size_t size) const
+    {
+        size_t n = FindSegment(ea);
+        return CopyString((n < m_segments.size()) ? m_segments[n].nameOff : MEM_DB_NO_NAME,
+                          pszBuf, size);
+    }
+
+    virtual void GetBytes(db_ea_t ea, uint8_t *pBuf, size_t size) const
+    {
+        size_t off = 0;
+        while (off < size)
+        {
+            db_ea_t cur = (db_ea_t) (ea + off);
+            size_t n = FindSegment(cur);
+            if ((n < m_segments.size()) && m_segments[n].bCode)
+            {
+                size_t len = (std::min)(size - off, (size_t) (m_segments[n].endEA - cur));
+                memcpy(pBuf + off, &m_bytes[n][(size_t) (cur - m_segments[n].startEA)], len);
+                off += len;
+            }
+            else
+            {
+                // get_byte of a byte without a value
+                pBuf[off++] = 0xFF;
+            }
+        }
+    }
+
+    virtual uint32_t GetFlags(db_ea_t ea) const
+    {
+        const MEM_ADDR *pAddr = FindAddr(ea);
+        return (NULL != pAddr) ? (pAddr->flags & ~(MEM_DB_IS_PUBLIC | MEM_DB_IN_USE)) : 0;
+    }
+
+    virtual db_ea_t GetItemEnd(db_ea_t ea) const
+    {
+        size_t i = FindItem(ea);
+        if (i < m_items.size())
+        {
+            return m_items[i].endEA;
+        }
+
+        // A tail or an unexplored byte
+        i = (size_t) (std::upper_bound(m_items.begin(), m_items.end(), ea, EaItemLess) -
+                      m_items.begin());
+        if ((i > 0) && (ea < m_items[i - 1].endEA))
+        {
+            return m_items[i - 1].endEA;
+        }
+        return ea + 1;
+    }
+
+    virtual db_ea_t NextHead(db_ea_t ea) const
+    {
+        size_t i = FindItem(ea);
+        if (i < m_items.size())
+        {
+            i++;
+        }
+        else
+        {
+            i = (size_t) (std::upper_bound(m_items.begin(), m_items.end(), ea, EaItemLess) -
+                          m_items.begin());
+        }
+        return (i < m_items.size()) ? m_items[i].ea : DB_BADADDR;
+    }
+
+    virtual const char *GetName(db_ea_t ea, char *pszBuf, size_t size) const
+    {
+        const MEM_ADDR *pAddr = FindAddr(ea);
+        if ((NULL == pAddr) || (MEM_DB_NO_NAME == pAddr->nameOff))
+        {
+            return NULL;
+        }
+        (void) CopyString(pAddr->nameOff, pszBuf, size);
+        return pszBuf;
+    }
+
+    virtual bool IsUserName(const char *pszName) const
+    {
+        return !IsDummyName(pszName);
+    }
+
+    virtual bool IsPublicName(db_ea_t ea) const
+    {
+        const MEM_ADDR *pAddr = FindAddr(ea);
+        return (NULL != pAddr) && (0 != (pAddr->flags & MEM_DB_IS_PUBLIC));
+    }
+
+    virtual db_ea_t GetFirstDref(db_ea_t ea) const
+    {
+        size_t i = FindItem(ea);
+        if ((i >= m_items.size()) || (0 == m_items[i].numDrefs))
+        {
+            return DB_BADADDR;
+        }
+        return m_drefs[m_items[i].firstDref];
+    }
+
+    virtual db_ea_t GetNextDref(db_ea_t ea, db_ea_t current) const
+    {
+        size_t i = FindItem(ea);
+        if (i >= m_items.size())
+        {
+            return DB_BADADDR;
+        }
+
+        const MEM_ITEM &item = m_items[i];
+        for (uint32_t d = 0; d + 1 < item.numDrefs; d++)
+        {
+            if (m_drefs[item.firstDref + d] == current)
+            {
+                return m_drefs[item.firstDref + d + 1];
+            }
+        }
+        return DB_BADADDR;
+    }
+
+    virtual db_ea_t GetFirstFcref(db_ea_t ea) const
+    {
+        size_t i = FindItem(ea);
+        return (i < m_items.size()) ? m_items[i].fcref : DB_BADADDR;
+    }
+
+    virtual size_t GetFuncCount() const
+    {
+        return m_funcs.size();
+    }
+
+    virtual bool GetFunc(size_t n, DB_FUNC &func) const
+    {
+        if (n >= m_funcs.size())
+        {
+            return false;
+        }
+        func = m_funcs[n];
+        return true;
+    }
+
+    virtual bool GetFuncAt(db_ea_t ea, DB_FUNC &func) const
+    {
+        size_t n = (size_t) (std::upper_bound(m_funcs.begin(), m_funcs.end(), ea, EaFuncLess) -
+                             m_funcs.begin());
+        if ((DB_BADADDR == ea) || (0 == n) || (ea >= m_funcs[n - 1].endEA))
+        {
+            return false;
+        }
+        func = m_funcs[n - 1];
+        return true;
+    }
+
+    virtual size_t GetEntryCount() const
+    {
+        return m_entries.size();
+    }
+
+    virtual db_ea_t GetEntry(size_t n) const
+    {
+        return (n < m_entries.size()) ? m_entries[n] : DB_BADADDR;
+    }
+
+    /* A user name, unique in the database; an empty name deletes the name */
+    virtual bool SetName(db_ea_t ea, const char *pszName)
+    {
+        if ('\0' == pszName[0])
+        {
+            MEM_ADDR *pAddr = FindAddr(ea);
+            if (NULL != pAddr)
+            {
+                RemoveName(*pAddr);
+                pAddr->flags &= ~(DB_HAS_NAME | DB_HAS_DUMMY_NAME | DB_HAS_AUTO_NAME |
+                                  DB_HAS_USER_NAME | MEM_DB_IS_PUBLIC);
+            }
+            return true;
+        }
+
+        // One probe finds the name, or the free slot it gets
+        uint64_t hash = HashName(pszName);
+        GrowNames();
+        size_t slot = FindName(pszName, hash);
+        if (m_names[slot].bUsed && (m_names[slot].ea != ea))
+        {
+            return false;
+        }
+
+        MEM_ADDR *pAddr = InsertAddr(ea);
+        uint32_t keep = pAddr->flags & (DB_HAS_CMT | MEM_DB_IS_PUBLIC | MEM_DB_IN_USE);
+        if (!m_names[slot].bUsed)
+        {
+            RemoveName(*pAddr);
+            pAddr->nameOff = AddString(pszName);
+            SetNameSlot(slot, hash, ea);
+        }
+        pAddr->flags = keep | DB_HAS_NAME | DB_HAS_USER_NAME;
+        return true;
+    }
+
+    virtual bool SetCmt(db_ea_t ea, const char *pszCmt)
+    {
+        MEM_ADDR *pAddr = InsertAddr(ea);
+        pAddr->cmtOff = AddString(pszCmt);
+        pAddr->flags |= DB_HAS_CMT;
+        return true;
+    }
+
+private:
+    /* A slot of the name table, the hash and the address of a unique name */
+    typedef struct tagMEM_NAME {
+        uint64_t hash;
+        db_ea_t ea;                 // DB_BADADDR for a free or removed slot
+        uint32_t bUsed;             // the slot ends no probe sequence
+    } MEM_NAME;
+
+    static bool ItemLess(const MEM_ITEM &a, const MEM_ITEM &b)
+    {
+        return (a.ea < b.ea);
+    }
+
+    static bool EaItemLess(db_ea_t ea, const MEM_ITEM &item)
+    {
+        return (ea < item.ea);
+    }
+
+    static bool EaFuncLess(db_ea_t ea, const DB_FUNC &func)
+    {
+        return (ea < func.startEA);
+    }
+
+    static bool EaSegmentLess(db_ea_t ea, const MEM_SEGMENT &seg)
+    {
+        return (ea < seg.startEA);
+    }
+
+    static uint64_t HashEa(db_ea_t ea)
+    {
+        // fmix64 of MurmurHash3
+        uint64_t k = ea;
+        k ^= k >> 33;
+        k *= 0xFF51AFD7ED558CCDULL;
+        k ^= k >> 33;
+        return k;
+    }
+
+    static uint64_t HashName(const char *pszName)
+    {
+        // FNV-1a
+        uint64_t h = 0xCBF29CE484222325ULL;
+        for (const uint8_t *p = (const uint8_t *) pszName; '\0' != *p; p++)
+        {
+            h = (h ^ *p) * 0x100000001B3ULL;
+        }
+        return h;
+    }
+
+    /* The dummy names of IDA: a dummy prefix and a hexadecimal address */
+    static bool IsDummyName(const char *pszName)
+    {
+        static const char *s_prefixes[] = {
+            "sub_", "locret_", "loc_", "off_", "seg_", "asc_", "byte_", "word_", "dword_",
+            "qword_", "byte3_", "xmmword_", "ymmword_", "packreal_", "flt_", "dbl_",
+            "tbyte_", "stru_", "custdata_", "algn_", "unk_"
+        };
+
+        for (size_t i = 0; i < sizeof(s_prefixes) / sizeof(s_prefixes[0]); i++)
+        {
+            size_t len = strlen(s_prefixes[i]);
+            if (0 != strncmp(pszName, s_prefixes[i], len))
+            {
+                continue;
+            }
+
+            const char *p = pszName + len;
+            if ('\0' == *p)
+            {
+                return false;
+            }
+            for (; '\0' != *p; p++)
+            {
+                if (!(((*p >= '0') && (*p <= '9')) || ((*p >= 'A') && (*p <= 'F')) ||
+                      ((*p >= 'a') && (*p <= 'f'))))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        return ('\0' == pszName[0]);
+    }
+
+    template <class T>
+    static bool WriteArray(PFN_DB_WRITE pfnWrite, void *ctx, const std::vector<T> &v)
+    {
+        uint64_t count = v.size();
+        return pfnWrite(ctx, (const char *) &count, sizeof(count)) &&
+               (v.empty() || pfnWrite(ctx, (const char *) &v[0], v.size() * sizeof(T)));
+    }
+
+    template <class T>
+    static bool ReadArray(PFN_DB_READ pfnRead, void *ctx, std::vector<T> &v)
+    {
+        uint64_t count = 0;
+        if (!pfnRead(ctx, &count, sizeof(count)) || (count > (uint64_t) (SIZE_MAX / sizeof(T))))
+        {
+            return false;
+        }
+
+        // Grow by blocks, a bad count fails at the end of the file
+        const size_t block = (1 << 20) / sizeof(T) + 1;
+        v.clear();
+        while (v.size() < count)
+        {
+            size_t pos = v.size();
+            size_t len = (size_t) (std::min)((uint64_t) block, count - pos);
+            v.resize(pos + len);
+            if (!pfnRead(ctx, &v[pos], len * sizeof(T)))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    uint32_t AddString(const char *pszText)
+    {
+        uint32_t off = (uint32_t) m_pool.size();
+        m_pool.insert(m_pool.end(), pszText, pszText + strlen(pszText) + 1);
+        return off;
+    }
+
+    bool IsPoolString(uint32_t off) const
+    {
+        return (MEM_DB_NO_NAME == off) ||
+               ((off < m_pool.size()) && ('\0' == m_pool.back()));
+    }
+
+    size_t CopyString(uint32_t off, char *pszBuf, size_t size) const
+    {
+        size_t len = 0;
+        if (MEM_DB_NO_NAME != off)
+        {
+            len = (std::min)(strlen(&m_pool[off]), size - 1);
+            memcpy(pszBuf, &m_pool[off], len);
+        }
+        pszBuf[len] = '\0';
+        return len;
+    }
+
+    void RecordName(const IDA_DB &db, db_ea_t ea)
+    {
+        char szName[MEM_DB_NAME_SIZE];
+        uint32_t flags = db.GetFlags(ea);
+        if (0 != (flags & DB_HAS_CMT))
+        {
+            // The engines only test the comment flag
+            (void) SetCmt(ea, "");
+        }
+        if ((0 != (flags & DB_HAS_ANY_NAME)) &&
+            (NULL != db.GetName(ea, szName, sizeof(szName))))
+        {
+            AddName(ea, szName, flags & ~DB_HAS_CMT, db.IsPublicName(ea));
+        }
+    }
+
+    /* The segment of an address, m_segments.size() if none */
+    size_t FindSegment(db_ea_t ea) const
+    {
+        size_t n = (size_t) (std::upper_bound(m_segments.begin(), m_segments.end(), ea,
+                                              EaSegmentLess) - m_segments.begin());
+        if ((n > 0) && (ea < m_segments[n - 1].endEA))
+        {
+            return n - 1;
+        }
+        return m_segments.size();
+    }
+
+    /* The item starting at an address, m_items.size() if none. The item
+       at or after the last one found is checked first. */
+    size_t FindItem(db_ea_t ea) const
+    {
+        size_t i = m_cursor;
+        if ((i < m_items.size()) && (m_items[i].ea == ea))
+        {
+            return i;
+        }
+        if ((i + 1 < m_items.size()) && (m_items[i + 1].ea == ea))
+        {
+            m_cursor = i + 1;
+            return m_cursor;
+        }
+
+        i = (size_t) (std::upper_bound(m_items.begin(), m_items.end(), ea, EaItemLess) -
+                      m_items.begin());
+        if ((i > 0) && (m_items[i - 1].ea == ea))
+        {
+            m_cursor = i - 1;
+            return m_cursor;
+        }
+        return m_items.size();
+    }
+
+    const MEM_ADDR *FindAddr(db_ea_t ea) const
+    {
+        if (m_addrs.empty())
+        {
+            return NULL;
+        }
+
+        size_t mask = m_addrs.size() - 1;
+        for (size_t i = (size_t) HashEa(ea) & mask; 0 != m_addrs[i].flags; i = (i + 1) & mask)
+        {
+            if (m_addrs[i].ea == ea)
+            {
+                return &m_addrs[i];
+            }
+        }
+        return NULL;
+    }
+
+    MEM_ADDR *FindAddr(db_ea_t ea)
+    {
+        return const_cast<MEM_ADDR *>(static_cast<const MEM_DB *>(this)->FindAddr(ea));
+    }
+
+    /* The slot of an address, a new slot has no name and no comment. The
+       slots are never freed, a free slot ends the probe sequences. */
+    MEM_ADDR *InsertAddr(db_ea_t ea)
+    {
+        if ((m_numAddrs + 1) * 2 > m_addrs.size())
+        {
+            ResizeAddrs((std::max)(m_addrs.size() * 2, (size_t) 1024));
+        }
+
+        MEM_ADDR *pAddr = FindSlot(ea);
+        if (0 != pAddr->flags)
+        {
+            return pAddr;
+        }
+
+        m_numAddrs++;
+        pAddr->ea = ea;
+        pAddr->flags = MEM_DB_IN_USE;
+        pAddr->nameOff = MEM_DB_NO_NAME;
+        pAddr->cmtOff = MEM_DB_NO_NAME;
+        return pAddr;
+    }
+
+    /* The slot of an address, or the free slot it would get */
+    MEM_ADDR *FindSlot(db_ea_t ea)
+    {
+        size_t mask = m_addrs.size() - 1;
+        size_t i = (size_t) HashEa(ea) & mask;
+        while ((0 != m_addrs[i].flags) && (m_addrs[i].ea != ea))
+        {
+            i = (i + 1) & mask;
+        }
+        return &m_addrs[i];
+    }
+
+    void ResizeAddrs(size_t size)
+    {
+        std::vector<MEM_ADDR> old;
+        old.swap(m_addrs);
+        MEM_ADDR empty = { 0, 0, MEM_DB_NO_NAME, MEM_DB_NO_NAME };
+        m_addrs.assign(size, empty);
+        for (size_t i = 0; i < old.size(); i++)
+        {
+            if (0 != old[i].flags)
+            {
+                *FindSlot(old[i].ea) = old[i];
+            }
+        }
+    }
+
+    /* The slot of a name, or the free slot it would get */
+    size_t FindName(const char *pszName, uint64_t hash) const
+    {
+        size_t mask = m_names.size() - 1;
+        size_t i = (size_t) hash & mask;
+        for (; m_names[i].bUsed; i = (i + 1) & mask)
+        {
+            if ((m_names[i].hash == hash) && (DB_BADADDR != m_names[i].ea))
+            {
+                const MEM_ADDR *pAddr = FindAddr(m_names[i].ea);
+                if ((NULL != pAddr) && (MEM_DB_NO_NAME != pAddr->nameOff) &&
+                    (0 == strcmp(&m_pool[pAddr->nameOff], pszName)))
+                {
+                    break;
+                }
+            }
+        }
+        return i;
+    }
+
+    /* Room for one more name */
+    void GrowNames()
+    {
+        if ((m_numNames + 1) * 2 > m_names.size())
+        {
+            ResizeNames((std::max)(m_names.size() * 2, (size_t) 1024));
+        }
+    }
+
+    void InsertName(uint64_t hash, db_ea_t ea)
+    {
+        GrowNames();
+        PutName(hash, ea);
+    }
+
+    /* Rehash without the removed names */
+    void ResizeNames(size_t size)
+    {
+        std::vector<MEM_NAME> old;
+        old.swap(m_names);
+        MEM_NAME empty = { 0, DB_BADADDR, 0 };
+        m_names.assign(size, empty);
+        m_numNames = 0;
+        for (size_t i = 0; i < old.size(); i++)
+        {
+            if (DB_BADADDR != old[i].ea)
+            {
+                PutName(old[i].hash, old[i].ea);
+            }
+        }
+    }
+
+    void PutName(uint64_t hash, db_ea_t ea)
+    {
+        size_t mask = m_names.size() - 1;
+        size_t i = (size_t) hash & mask;
+        while (m_names[i].bUsed)
+        {
+            i = (i + 1) & mask;
+        }
+        SetNameSlot(i, hash, ea);
+    }
+
+    void SetNameSlot(size_t slot, uint64_t hash, db_ea_t ea)
+    {
+        m_names[slot].hash = hash;
+        m_names[slot].ea = ea;
+        m_names[slot].bUsed = 1;
+        m_numNames++;
+    }
+
+    /* Remove the name of an address from the name table, the slot stays
+       used until the next rehash */
+    void RemoveName(MEM_ADDR &addr)
+    {
+        if (MEM_DB_NO_NAME == addr.nameOff)
+        {
+            return;
+        }
+
+        uint64_t hash = HashName(&m_pool[addr.nameOff]);
+        size_t mask = m_names.size() - 1;
+        for (size_t i = (size_t) hash & mask; m_names[i].bUsed; i = (i + 1) & mask)
+        {
+            if ((m_names[i].hash == hash) && (m_names[i].ea == addr.ea))
+            {
+                m_names[i].ea = DB_BADADDR;
+                break;
+            }
+        }
+        addr.nameOff = MEM_DB_NO_NAME;
+    }
+
+    std::vector<MEM_SEGMENT> m_segments;        // sorted by address, not overlapping
+    std::vector<std::vector<uint8_t> > m_bytes; // of each segment, empty if not code
+    std::vector<MEM_ITEM> m_items;              // sorted by address
+    std::vector<db_ea_t> m_drefs;
+    std::vector<DB_FUNC> m_funcs;               // sorted by address
+    std::vector<db_ea_t> m_entries;
+    std::vector<char> m_pool;                   // NUL terminated names and comments
+    std::vector<MEM_ADDR> m_addrs;              // open addressing, a power of 2 slots
+    std::vector<MEM_NAME> m_names;              // open addressing, a power of 2 slots
+    size_t m_numAddrs;
+    size_t m_numNames;                          // used slots, with the removed names
+    mutable size_t m_cursor;
+};
+
+#endif  // __COMMON_MEMDB_H__
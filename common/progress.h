@@ -0,0 +1,125 @@
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file progress.h
+ * Progress of the long loops of the IDB2SIG and LoadMap plugins: items
+ * done, throughput and time left. The meter only measures, the plugins
+ * show it in the IDA wait box and check for a user cancel when Update()
+ * says a report is due, so both happen at a bounded rate.
+ * Does not call the IDA SDK.
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __COMMON_PROGRESS_H__
+#define __COMMON_PROGRESS_H__
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+    #define PROGRESS_SNPRINTF   _snprintf
+#else
+    #include <time.h>
+    #define PROGRESS_SNPRINTF   snprintf
+#endif
+
+#define PROGRESS_INTERVAL_MS    250     // shortest time between two reports
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get a millisecond tick count, only the difference of two ticks
+/// is meaningful
+////////////////////////////////////////////////////////////////////////////////
+static inline uint32_t GetTickMs(void)
+{
+#ifdef _WIN32
+    return (uint32_t) GetTickCount();
+#else
+    struct timespec ts;
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ((uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Progress of a loop over a known number of items
+////////////////////////////////////////////////////////////////////////////////
+struct PROGRESS_METER
+{
+    PROGRESS_METER() : total(0), done(0), startTick(0), lastTick(0),
+                       intervalMs(PROGRESS_INTERVAL_MS)
+    {
+    }
+
+    /* Start measuring a loop over totalItems items */
+    void Start(uint64_t totalItems, uint32_t interval = PROGRESS_INTERVAL_MS)
+    {
+        total = totalItems;
+        done = 0;
+        intervalMs = interval;
+        startTick = lastTick = GetTickMs();
+    }
+
+    /* Set the items done, true when a report is due */
+    bool Update(uint64_t doneItems)
+    {
+        done = doneItems;
+
+        uint32_t now = GetTickMs();
+        if ((uint32_t) (now - lastTick) < intervalMs)
+        {
+            return false;
+        }
+        lastTick = now;
+        return true;
+    }
+
+    /* Items per second since Start, as of the last report */
+    uint64_t GetRate() const
+    {
+        uint32_t elapsed = lastTick - startTick;
+        return (elapsed > 0) ? done * 1000 / elapsed : 0;
+    }
+
+    /* Seconds left at the rate so far, as of the last report */
+    uint64_t GetSecondsLeft() const
+    {
+        uint32_t elapsed = lastTick - startTick;
+        if ((0 == done) || (done >= total))
+        {
+            return 0;
+        }
+        return (total - done) * elapsed / done / 1000;
+    }
+
+    /* Format "done of total unit (percent), rate unit/s, time left" */
+    void Format(char *pszBuf, size_t size, const char *pszUnit) const
+    {
+        uint64_t left = GetSecondsLeft();
+        unsigned int percent = (total > 0) ? (unsigned int) (done * 100 / total) : 100;
+
+        int len = PROGRESS_SNPRINTF(pszBuf, size,
+                                    "%lu of %lu %s (%u%%), %lu %s/s, %lu:%02lu left",
+                                    (unsigned long) done, (unsigned long) total, pszUnit,
+                                    percent, (unsigned long) GetRate(), pszUnit,
+                                    (unsigned long) (left / 60), (unsigned long) (left % 60));
+        if ((len < 0) || ((size_t) len >= size))
+        {
+            pszBuf[size - 1] = '\0';
+        }
+    }
+
+private:
+    uint64_t total;
+    uint64_t done;
+    uint32_t startTick;
+    uint32_t lastTick;
+    uint32_t intervalMs;
+};
+
+#endif  // __COMMON_PROGRESS_H__
@@ -0,0 +1,161 @@
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file sdkdb.h
+ * The IDA_DB of the plugins, each call is the IDA SDK call it is named
+ * after. Include it after the IDA SDK headers.
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __COMMON_SDKDB_H__
+#define __COMMON_SDKDB_H__
+
+#pragma once
+
+#include <string.h>
+
+#include "idadb.h"
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief The open IDA database, only for the main thread
+////////////////////////////////////////////////////////////////////////////////
+struct SDK_DB : public IDA_DB
+{
+    virtual size_t GetSegmentCount() const
+    {
+        int qty = get_segm_qty();
+        return (qty > 0) ? (size_t) qty : 0;
+    }
+
+    virtual bool GetSegment(size_t n, DB_SEGMENT &seg) const
+    {
+        segment_t *pSeg = getnseg((int) n);
+        if (NULL == pSeg)
+        {
+            return false;
+        }
+        seg.startEA = pSeg->startEA;
+        seg.endEA = pSeg->endEA;
+        seg.bCode = (SEG_CODE == pSeg->type);
+        return true;
+    }
+
+    virtual size_t GetSegmentName(db_ea_t ea, char *pszBuf, size_t size) const
+    {
+        pszBuf[0] = '\0';
+        (void) get_segm_name(ea, pszBuf, size);
+        return strlen(pszBuf);
+    }
+
+    virtual void GetBytes(db_ea_t ea, uint8_t *pBuf, size_t size) const
+    {
+        if ((size > 0) && !get_many_bytes(ea, pBuf, (ssize_t) size))
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                pBuf[i] = get_byte(ea + i);
+            }
+        }
+    }
+
+    virtual uint32_t GetFlags(db_ea_t ea) const
+    {
+        flags_t f = getFlags(ea);
+        uint32_t flags = 0;
+        flags |= has_name(f) ? DB_HAS_NAME : 0;
+        flags |= has_dummy_name(f) ? DB_HAS_DUMMY_NAME : 0;
+        flags |= has_auto_name(f) ? DB_HAS_AUTO_NAME : 0;
+        flags |= has_user_name(f) ? DB_HAS_USER_NAME : 0;
+        flags |= has_cmt(f) ? DB_HAS_CMT : 0;
+        return flags;
+    }
+
+    virtual db_ea_t GetItemEnd(db_ea_t ea) const
+    {
+        return get_item_end(ea);
+    }
+
+    virtual db_ea_t NextHead(db_ea_t ea) const
+    {
+        return next_not_tail(ea);
+    }
+
+    virtual const char *GetName(db_ea_t ea, char *pszBuf, size_t size) const
+    {
+        return get_true_name(BADADDR, ea, pszBuf, size);
+    }
+
+    virtual bool IsUserName(const char *pszName) const
+    {
+        return is_uname(pszName);
+    }
+
+    virtual bool IsPublicName(db_ea_t ea) const
+    {
+        return is_public_name(ea);
+    }
+
+    virtual db_ea_t GetFirstDref(db_ea_t ea) const
+    {
+        return get_first_dref_from(ea);
+    }
+
+    virtual db_ea_t GetNextDref(db_ea_t ea, db_ea_t current) const
+    {
+        return get_next_dref_from(ea, current);
+    }
+
+    virtual db_ea_t GetFirstFcref(db_ea_t ea) const
+    {
+        return get_first_fcref_from(ea);
+    }
+
+    virtual size_t GetFuncCount() const
+    {
+        return (size_t) get_func_qty();
+    }
+
+    virtual bool GetFunc(size_t n, DB_FUNC &func) const
+    {
+        return GetFuncOf(getn_func((int) n), func);
+    }
+
+    virtual bool GetFuncAt(db_ea_t ea, DB_FUNC &func) const
+    {
+        return GetFuncOf(get_func(ea), func);
+    }
+
+    virtual size_t GetEntryCount() const
+    {
+        return (size_t) get_entry_qty();
+    }
+
+    virtual db_ea_t GetEntry(size_t n) const
+    {
+        return get_entry(get_entry_ordinal(n));
+    }
+
+    virtual bool SetName(db_ea_t ea, const char *pszName)
+    {
+        return set_name(ea, pszName, SN_NOWARN);
+    }
+
+    virtual bool SetCmt(db_ea_t ea, const char *pszCmt)
+    {
+        return set_cmt(ea, pszCmt, false);
+    }
+
+    /* The DB_FUNC of a func_t, false for NULL */
+    static bool GetFuncOf(const func_t *pFunc, DB_FUNC &func)
+    {
+        if (NULL == pFunc)
+        {
+            return false;
+        }
+        func.startEA = pFunc->startEA;
+        func.endEA = pFunc->endEA;
+        func.bLib = (0 != (pFunc->flags & FUNC_LIB));
+        return true;
+    }
+};
+
+#endif  // __COMMON_SDKDB_H__
@@ -0,0 +1,348 @@
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * @file threads.h
+ * Portable threading primitives shared by the IDB2SIG and LoadMap plugins.
+ * Win32 threads and condition variables on Windows, pthreads elsewhere,
+ * so the plugin engines also build and run on Linux.
+ */
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __COMMON_THREADS_H__
+#define __COMMON_THREADS_H__
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef _WIN32_WINNT
+        #define _WIN32_WINNT 0x0600     // Condition variables need Windows Vista
+    #endif
+    #include <windows.h>
+#else
+    #include <pthread.h>
+    #include <unistd.h>
+#endif
+
+#define MAX_WORKER_THREADS  64
+
+/* Thread procedure, runs on its own thread */
+typedef void (*PFN_THREAD_PROC)(void *ctx);
+
+/* Job procedure, called once for each index in [0, count) */
+typedef void (*PFN_JOB_PROC)(void *ctx, size_t index);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the number of logical processors, at least 1
+////////////////////////////////////////////////////////////////////////////////
+static inline unsigned int GetCpuCount(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return (si.dwNumberOfProcessors > 0) ? (unsigned int) si.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (unsigned int) n : 1;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Atomically increment a counter
+/// @return The incremented value
+////////////////////////////////////////////////////////////////////////////////
+static inline long AtomicIncrement(volatile long *pValue)
+{
+#ifdef _WIN32
+    return InterlockedIncrement(pValue);
+#else
+    return __sync_add_and_fetch(pValue, 1);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Non recursive mutex
+////////////////////////////////////////////////////////////////////////////////
+struct MUTEX
+{
+#ifdef _WIN32
+    CRITICAL_SECTION cs;
+    MUTEX()         { InitializeCriticalSection(&cs); }
+    ~MUTEX()        { DeleteCriticalSection(&cs); }
+    void Lock()     { EnterCriticalSection(&cs); }
+    void Unlock()   { LeaveCriticalSection(&cs); }
+#else
+    pthread_mutex_t mtx;
+    MUTEX()         { (void) pthread_mutex_init(&mtx, NULL); }
+    ~MUTEX()        { (void) pthread_mutex_destroy(&mtx); }
+    void Lock()     { (void) pthread_mutex_lock(&mtx); }
+    void Unlock()   { (void) pthread_mutex_unlock(&mtx); }
+#endif
+
+private:
+    MUTEX(const MUTEX &);
+    MUTEX &operator=(const MUTEX &);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Condition variable, always used together with a locked MUTEX
+////////////////////////////////////////////////////////////////////////////////
+struct CONDVAR
+{
+#ifdef _WIN32
+    CONDITION_VARIABLE cv;
+    CONDVAR()                   { InitializeConditionVariable(&cv); }
+    void Wait(MUTEX &m)         { (void) SleepConditionVariableCS(&cv, &m.cs, INFINITE); }
+    void Signal()               { WakeConditionVariable(&cv); }
+    void Broadcast()            { WakeAllConditionVariable(&cv); }
+#else
+    pthread_cond_t cv;
+    CONDVAR()                   { (void) pthread_cond_init(&cv, NULL); }
+    ~CONDVAR()                  { (void) pthread_cond_destroy(&cv); }
+    void Wait(MUTEX &m)         { (void) pthread_cond_wait(&cv, &m.mtx); }
+    void Signal()               { (void) pthread_cond_signal(&cv); }
+    void Broadcast()            { (void) pthread_cond_broadcast(&cv); }
+#endif
+
+private:
+    CONDVAR(const CONDVAR &);
+    CONDVAR &operator=(const CONDVAR &);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A joinable thread
+////////////////////////////////////////////////////////////////////////////////
+struct THREAD
+{
+    PFN_THREAD_PROC pfnProc;
+    void *pCtx;
+    bool bStarted;
+#ifdef _WIN32
+    HANDLE hThread;
+#else
+    pthread_t thread;
+#endif
+
+    THREAD() : pfnProc(NULL), pCtx(NULL), bStarted(false)
+    {
+#ifdef _WIN32
+        hThread = NULL;
+#endif
+    }
+
+    bool Start(PFN_THREAD_PROC pfn, void *ctx)
+    {
+        pfnProc = pfn;
+        pCtx = ctx;
+#ifdef _WIN32
+        hThread = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+        bStarted = (NULL != hThread);
+#else
+        bStarted = (0 == pthread_create(&thread, NULL, ThreadProc, this));
+#endif
+        return bStarted;
+    }
+
+    void Join()
+    {
+        if (!bStarted)
+        {
+            return;
+        }
+#ifdef _WIN32
+        (void) WaitForSingleObject(hThread, INFINITE);
+        (void) CloseHandle(hThread);
+        hThread = NULL;
+#else
+        (void) pthread_join(thread, NULL);
+#endif
+        bStarted = false;
+    }
+
+private:
+#ifdef _WIN32
+    static DWORD WINAPI ThreadProc(LPVOID param)
+    {
+        THREAD *pThis = (THREAD *) param;
+        pThis->pfnProc(pThis->pCtx);
+        return 0;
+    }
+#else
+    static void *ThreadProc(void *param)
+    {
+        THREAD *pThis = (THREAD *) param;
+        pThis->pfnProc(pThis->pCtx);
+        return NULL;
+    }
+#endif
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A fixed set of worker threads running indexed jobs.
+/// Run() hands out indexes [0, count) to the workers and to the calling
+/// thread, and returns when all of them have been processed.
+/// With one thread, Run() just loops on the calling thread.
+////////////////////////////////////////////////////////////////////////////////
+struct WORKER_POOL
+{
+    WORKER_POOL() : numThreads(0), bQuit(false), generation(0),
+                    pfnJob(NULL), pJobCtx(NULL), jobCount(0), nextIndex(0), busyWorkers(0)
+    {
+    }
+
+    ~WORKER_POOL()
+    {
+        Stop();
+    }
+
+    /* Start the pool, 0 threads means one per logical processor */
+    void Start(unsigned int threads)
+    {
+        Stop();
+
+        if (0 == threads)
+        {
+            threads = GetCpuCount();
+        }
+        if (threads > MAX_WORKER_THREADS)
+        {
+            threads = MAX_WORKER_THREADS;
+        }
+
+        // The old workers have joined, the new ones start at generation 0
+        // and must not take the last Run() of the old ones for a new one
+        numThreads = 1;
+        bQuit = false;
+        generation = 0;
+        busyWorkers = 0;
+        for (unsigned int i = 1; i < threads; i++)
+        {
+            if (!workers[numThreads - 1].Start(WorkerProc, this))
+            {
+                break;
+            }
+            numThreads++;
+        }
+    }
+
+    void Stop()
+    {
+        if (numThreads > 1)
+        {
+            lock.Lock();
+            bQuit = true;
+            wakeWorkers.Broadcast();
+            lock.Unlock();
+
+            for (unsigned int i = 0; i + 1 < numThreads; i++)
+            {
+                workers[i].Join();
+            }
+        }
+        numThreads = 0;
+    }
+
+    unsigned int GetThreadCount() const
+    {
+        return numThreads;
+    }
+
+    void Run(size_t count, PFN_JOB_PROC pfn, void *ctx)
+    {
+        if (numThreads <= 1)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                pfn(ctx, i);
+            }
+            return;
+        }
+
+        lock.Lock();
+        pfnJob = pfn;
+        pJobCtx = ctx;
+        jobCount = count;
+        nextIndex = 0;
+        busyWorkers = numThreads - 1;
+        generation++;
+        wakeWorkers.Broadcast();
+        lock.Unlock();
+
+        DoJobs();
+
+        lock.Lock();
+        while (busyWorkers > 0)
+        {
+            jobsDone.Wait(lock);
+        }
+        pfnJob = NULL;
+        lock.Unlock();
+    }
+
+private:
+    void DoJobs()
+    {
+        for (;;)
+        {
+            size_t i = (size_t) AtomicIncrement(&nextIndex) - 1;
+            if (i >= jobCount)
+            {
+                break;
+            }
+            pfnJob(pJobCtx, i);
+        }
+    }
+
+    static void WorkerProc(void *ctx)
+    {
+        WORKER_POOL *pThis = (WORKER_POOL *) ctx;
+        unsigned long seen = 0;
+
+        pThis->lock.Lock();
+        for (;;)
+        {
+            while (!pThis->bQuit && (seen == pThis->generation))
+            {
+                pThis->wakeWorkers.Wait(pThis->lock);
+            }
+            if (pThis->bQuit)
+            {
+                break;
+            }
+            seen = pThis->generation;
+            pThis->lock.Unlock();
+
+            pThis->DoJobs();
+
+            pThis->lock.Lock();
+            if (0 == --pThis->busyWorkers)
+            {
+                pThis->jobsDone.Signal();
+            }
+        }
+        pThis->lock.Unlock();
+    }
+
+    THREAD workers[MAX_WORKER_THREADS - 1];
+    unsigned int numThreads;
+
+    MUTEX lock;
+    CONDVAR wakeWorkers;
+    CONDVAR jobsDone;
+    bool bQuit;
+    unsigned long generation;
+
+    PFN_JOB_PROC pfnJob;
+    void *pJobCtx;
+    size_t jobCount;
+    volatile long nextIndex;
+    unsigned int busyWorkers;
+
+    WORKER_POOL(const WORKER_POOL &);
+    WORKER_POOL &operator=(const WORKER_POOL &);
+};
+
+#endif  // __COMMON_THREADS_H__
@@ -0,0 +1,114 @@
+/*************************************************************************
+    IDB2SIG crc16 microbenchmark
+    Compares the bytewise reference, the slicing-by-8 crc16 and the
+    multi-buffer crc16_multi on random CRC blocks of pattern lines, and
+    checks that all of them return the same CRCs.
+    Does not need IDA, build it from the idb2sig directory with
+        cl /O2 /EHsc /I. bench\crc16bench.cpp crc16.cpp
+    or
+        g++ -O2 -I. bench/crc16bench.cpp crc16.cpp -o crc16bench
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+#include "crc16.h"
+
+#define BLOCK_COUNT     4096        // CRC blocks per pass
+#define BLOCK_MAX_LEN   255         // the CRC block of a pattern line is at most 255 bytes
+#define PASSES          200
+
+using namespace std;
+
+static double Now(void)
+{
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[])
+{
+    int passes = (argc > 1) ? atoi(argv[1]) : PASSES;
+    if (passes <= 0)
+    {
+        passes = PASSES;
+    }
+
+    vector<uint8_t> data(BLOCK_COUNT * BLOCK_MAX_LEN);
+    vector<const uint8_t *> blocks(BLOCK_COUNT);
+    vector<uint16_t> lens(BLOCK_COUNT);
+    vector<uint16_t> ref(BLOCK_COUNT), crc(BLOCK_COUNT);
+    size_t totalBytes = 0;
+
+    srand(1);
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = (uint8_t) rand();
+    }
+    for (size_t i = 0; i < BLOCK_COUNT; i++)
+    {
+        blocks[i] = &data[i * BLOCK_MAX_LEN];
+        lens[i] = (uint16_t) (rand() % (BLOCK_MAX_LEN + 1));
+        totalBytes += lens[i];
+    }
+
+    for (size_t i = 0; i < BLOCK_COUNT; i++)
+    {
+        ref[i] = crc16_bytewise(blocks[i], lens[i]);
+    }
+
+    int errors = 0;
+    for (size_t i = 0; i < BLOCK_COUNT; i++)
+    {
+        if (crc16(blocks[i], lens[i]) != ref[i])
+        {
+            errors++;
+        }
+    }
+    crc16_multi(&blocks[0], &lens[0], &crc[0], BLOCK_COUNT);
+    for (size_t i = 0; i < BLOCK_COUNT; i++)
+    {
+        if (crc[i] != ref[i])
+        {
+            errors++;
+        }
+    }
+    if (errors > 0)
+    {
+        printf("FAILED: %d CRCs differ from crc16_bytewise\n", errors);
+        return 1;
+    }
+
+    unsigned int sink = 0;
+    double t0 = Now();
+    for (int p = 0; p < passes; p++)
+    {
+        for (size_t i = 0; i < BLOCK_COUNT; i++)
+        {
+            sink += crc16_bytewise(blocks[i], lens[i]);
+        }
+    }
+    double t1 = Now();
+    for (int p = 0; p < passes; p++)
+    {
+        for (size_t i = 0; i < BLOCK_COUNT; i++)
+        {
+            sink += crc16(blocks[i], lens[i]);
+        }
+    }
+    double t2 = Now();
+    for (int p = 0; p < passes; p++)
+    {
+        crc16_multi(&blocks[0], &lens[0], &crc[0], BLOCK_COUNT);
+        sink += crc[p % BLOCK_COUNT];
+    }
+    double t3 = Now();
+
+    double mb = (double) totalBytes * passes / (1024.0 * 1024.0);
+    printf("%d blocks, %.1f MB per kernel (sink %u)\n", BLOCK_COUNT, mb, sink);
+    printf("crc16_bytewise : %8.1f MB/s\n", mb / (t1 - t0 + 1e-9));
+    printf("crc16          : %8.1f MB/s\n", mb / (t2 - t1 + 1e-9));
+    printf("crc16_multi    : %8.1f MB/s\n", mb / (t3 - t2 + 1e-9));
+    return 0;
+}
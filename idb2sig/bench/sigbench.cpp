@@ -0,0 +1,1063 @@
+/*************************************************************************
+    IDB2SIG pattern generation benchmarks
+    Measures the kernels of the pattern line generation, and the encoding
+    of whole batches, on synthetic functions: two function size
+    distributions, each with three reference densities. Num2HexStr and
+    set_v_bytes are inlined into write_func_sig and prepare_func_sigs and
+    are measured with them. All kernels are first checked against their
+    reference implementations. The encoding is measured with and without
+    the deduplication of the lines. The functions are also put in a MEM_DB,
+    and collect_func_sig collects them from it as the plugin does from
+    the open database; collecting and encoding a batch a second time must
+    not allocate (g_sigAllocCount). SIG_PAT_CACHE::Load must refuse
+    truncated and damaged cache files, replay_snapshot truncated and
+    damaged function dumps. A worker pool must run its jobs
+    again after Stop() and Start().
+    Reports ns per byte and pattern lines per second, and writes the
+    results as CSV. The CSV files of two builds can be compared:
+        sigbench [-p passes] [-t threads] [-o results.csv]
+        sigbench -c base.csv new.csv
+    Does not need IDA, build it from the idb2sig directory with
+        g++ -O2 -pthread -I. -I../common bench/sigbench.cpp patgen.cpp patout.cpp
+            crc16.cpp hexenc.cpp refscan.cpp snapshot.cpp sigcollect.cpp
+            patindex.cpp patcache.cpp -o sigbench
+    or
+        cl /O2 /EHsc /I. /I..\common bench\sigbench.cpp patgen.cpp patout.cpp
+            crc16.cpp hexenc.cpp refscan.cpp snapshot.cpp sigcollect.cpp
+            patindex.cpp patcache.cpp
+    Add -D__EA64__ (/D__EA64__) to measure the 64-bit build.
+*************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "patgen.h"
+#include "patindex.h"
+#include "patcache.h"
+#include "crc16.h"
+#include "hexenc.h"
+#include "refscan.h"
+#include "sigcollect.h"
+#include "memdb.h"
+#include "threads.h"
+#include "benchres.h"
+
+#define PASSES          5           // default passes of each kernel
+#define SET_BYTES       (4 * 1024 * 1024)   // function bytes of a benchmark set
+#define BENCH_BASE_EA   0x401000    // first function
+#define BENCH_DATA_EA   0x8000000   // first referenced target
+
+using namespace std;
+
+/* Function sizes, log-uniform between min and max bytes */
+typedef struct tagBENCH_SIZES {
+    const char *pszName;
+    uint32_t minLen;
+    uint32_t maxLen;
+} BENCH_SIZES;
+
+/* Reference density, one reference item per bytesPerRef bytes, 0 for none */
+typedef struct tagBENCH_DENSITY {
+    const char *pszName;
+    uint32_t bytesPerRef;
+} BENCH_DENSITY;
+
+static const BENCH_SIZES g_sizes[] = {
+    { "typical", 8, 4096 },
+    { "large", 1024, 32768 },
+};
+
+static const BENCH_DENSITY g_densities[] = {
+    { "norefs", 0 },
+    { "sparse", 64 },
+    { "dense", 12 },
+};
+
+/* Synthetic functions of one size distribution and reference density */
+struct BENCH_SET
+{
+    string name;
+    vector<uint8_t> code;           // bytes of all functions, the jobs refer to them
+    vector<SIG_BATCH> batches;
+    MEM_DB db;                      // the same functions as a database
+    size_t numFuncs;
+    size_t numBytes;
+    size_t numRefs;
+    size_t refBytes;                // bytes of the referencing items
+    size_t maxLineLen;
+};
+
+static BENCH_RESULTS g_results;
+static int g_passes = PASSES;
+static volatile size_t g_sink;      // keeps the results of the timed loops
+
+static uint32_t Rand(void)
+{
+    static uint64_t s_state = 0x9E3779B97F4A7C15ULL;
+    s_state = s_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t) (s_state >> 33);
+}
+
+static uint32_t RandomLength(const BENCH_SIZES &sizes)
+{
+    double lo = log((double) sizes.minLen);
+    double hi = log((double) sizes.maxLen);
+    double x = lo + (hi - lo) * ((double) Rand() / 2147483648.0);
+    return (uint32_t) exp(x);
+}
+
+/**********************************************************************
+* Function:     AddFunction
+* Description:  makes a random function at ea and adds it to the batch:
+*               random items, some of them a call rel32 or an absolute
+*               data reference, a public name at the start and names
+*               for half of the referenced targets, and adds them to
+*               the database
+**********************************************************************/
+static void AddFunction(BENCH_SET &set, SIG_BATCH &batch, sig_ea_t ea, uint32_t len,
+                        const BENCH_DENSITY &density)
+{
+    size_t off = set.code.size();
+    set.code.resize(off + len);
+    uint8_t *pBytes = &set.code[off];
+    for (uint32_t i = 0; i < len; i++)
+    {
+        pBytes[i] = (uint8_t) Rand();
+    }
+
+    char szName[32];
+    (void) batch.AddJob(ea, len);
+
+    DB_FUNC func = { ea, (sig_ea_t) (ea + len), false };
+    set.db.AddFunc(func);
+
+    sprintf(szName, "func_%X", (unsigned int) ea);
+    SIG_PUBLIC pub;
+    pub.ea = ea;
+    pub.bUserName = true;
+    pub.nameOff = batch.AddName(szName);
+    batch.AddPublic(pub);
+    set.db.AddName(ea, szName, DB_HAS_NAME | DB_HAS_USER_NAME, true);
+
+    uint32_t pos = 0;
+    while (pos < len)
+    {
+        uint32_t size = 1 + Rand() % 7;
+        if ((0 != density.bytesPerRef) && (pos + 6 <= len) &&
+            (Rand() % density.bytesPerRef < size))
+        {
+            SIG_XREF xref;
+            memset(&xref, 0, sizeof(xref));
+            xref.item = ea + pos;
+            // The targets are above the code, as the data and imports of a module
+            xref.target = (sig_ea_t) (BENCH_DATA_EA + Rand() % (64 * 1024 * 1024));
+            if (Rand() & 1)
+            {
+                // call rel32
+                size = 5;
+                uint32_t rel = (uint32_t) (xref.target - (xref.item + size));
+                pBytes[pos] = 0xE8;
+                memcpy(pBytes + pos + 1, &rel, 4);
+                set.db.AddItem(xref.item, xref.item + size);
+                set.db.SetFcref(xref.target);
+            }
+            else
+            {
+                // mov reg, [abs32]
+                size = 6;
+                uint32_t abs = (uint32_t) xref.target;
+                pBytes[pos] = 0x8B;
+                memcpy(pBytes + pos + 2, &abs, 4);
+                set.db.AddItem(xref.item, xref.item + size);
+                set.db.AddDref(xref.target);
+            }
+            xref.itemEnd = xref.item + size;
+            xref.loc = SIG_BADADDR;
+            xref.nameOff = NO_SIG_NAME;
+            // A target has a name or not for all its references
+            if (0 != (xref.target & 0x10))
+            {
+                sprintf(szName, "data_%X", (unsigned int) xref.target);
+                xref.nameOff = batch.AddName(szName);
+                xref.bUserName = true;
+                set.db.AddName(xref.target, szName, DB_HAS_NAME | DB_HAS_USER_NAME, false);
+            }
+            batch.AddXref(xref);
+            set.numRefs++;
+            set.refBytes += size;
+        }
+        else
+        {
+            set.db.AddItem(ea + pos, ea + min(pos + size, len));
+        }
+        pos += size;
+    }
+
+    batch.SetBytesRef(pBytes, len);
+    set.numFuncs++;
+    set.numBytes += len;
+    size_t lineLen = max_func_sig_len(batch.jobs.back());
+    if (lineLen > set.maxLineLen)
+    {
+        set.maxLineLen = lineLen;
+    }
+}
+
+static void MakeSet(BENCH_SET &set, const BENCH_SIZES &sizes, const BENCH_DENSITY &density)
+{
+    set.name = string(sizes.pszName) + "/" + density.pszName;
+    set.numFuncs = set.numBytes = set.numRefs = set.refBytes = set.maxLineLen = 0;
+
+    // The jobs point into the code, it must not move
+    set.code.reserve(SET_BYTES + sizes.maxLen);
+    set.batches.reserve(SET_BYTES / SIG_BATCH_SIZE / sizes.minLen + 2);
+
+    sig_ea_t ea = BENCH_BASE_EA;
+    while (set.numBytes < SET_BYTES)
+    {
+        if (set.batches.empty() || set.batches.back().IsFull())
+        {
+            set.batches.push_back(SIG_BATCH());
+        }
+        uint32_t len = RandomLength(sizes);
+        AddFunction(set, set.batches.back(), ea, len, density);
+        ea += len;
+    }
+
+    uint8_t *pSegBytes = set.db.AddSegment(BENCH_BASE_EA, ea, true, ".text");
+    memcpy(pSegBytes, &set.code[0], set.code.size());
+}
+
+static void AddResult(const char *pszKernel, const BENCH_SET &set, double bytes, double lines,
+                      double seconds)
+{
+    g_results.Add(pszKernel, set.name.c_str(), bytes * g_passes, lines * g_passes, seconds,
+                  "lines");
+}
+
+static void PrepareAll(BENCH_SET &set)
+{
+    for (size_t b = 0; b < set.batches.size(); b++)
+    {
+        for (size_t g = 0; g < set.batches[b].GetGroupCount(); g++)
+        {
+            prepare_func_sigs(set.batches[b], g);
+        }
+    }
+}
+
+/* The CRC blocks of the prepared jobs */
+static void GetCrcBlocks(const BENCH_SET &set, vector<const uint8_t *> &blocks,
+                         vector<uint16_t> &lens, size_t &bytes)
+{
+    bytes = 0;
+    for (size_t b = 0; b < set.batches.size(); b++)
+    {
+        const SIG_BATCH &batch = set.batches[b];
+        for (size_t i = 0; i < batch.GetCount(); i++)
+        {
+            const FUNC_SIG_JOB &job = batch.jobs[i];
+            if (job.alen > 0)
+            {
+                blocks.push_back(batch.GetBytes(job) + 32);
+                lens.push_back((uint16_t) job.alen);
+                bytes += job.alen;
+            }
+        }
+    }
+}
+
+static int BenchCrc(BENCH_SET &set)
+{
+    vector<const uint8_t *> blocks;
+    vector<uint16_t> lens;
+    size_t bytes = 0;
+    GetCrcBlocks(set, blocks, lens, bytes);
+    size_t count = blocks.size();
+    if (0 == count)
+    {
+        return 0;
+    }
+
+    vector<uint16_t> ref(count), crc(count);
+    int errors = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        ref[i] = crc16_bytewise(blocks[i], lens[i]);
+        errors += (crc16(blocks[i], lens[i]) != ref[i]);
+    }
+    crc16_multi(&blocks[0], &lens[0], &crc[0], count);
+    for (size_t i = 0; i < count; i++)
+    {
+        errors += (crc[i] != ref[i]);
+    }
+
+    unsigned int sink = 0;
+    double t0 = BenchNow();
+    for (int p = 0; p < g_passes; p++)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            sink += crc16_bytewise(blocks[i], lens[i]);
+        }
+    }
+    double t1 = BenchNow();
+    for (int p = 0; p < g_passes; p++)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            sink += crc16(blocks[i], lens[i]);
+        }
+    }
+    double t2 = BenchNow();
+    for (int p = 0; p < g_passes; p++)
+    {
+        // The plugin computes SIG_CRC_GROUP blocks at once
+        for (size_t i = 0; i < count; i += SIG_CRC_GROUP)
+        {
+            size_t n = (count - i < SIG_CRC_GROUP) ? count - i : SIG_CRC_GROUP;
+            crc16_multi(&blocks[i], &lens[i], &crc[i], n);
+        }
+        sink += crc[p % count];
+    }
+    double t3 = BenchNow();
+
+    g_sink = sink;
+
+    AddResult("crc16_bytewise", set, (double) bytes, 0, t1 - t0);
+    AddResult("crc16", set, (double) bytes, 0, t2 - t1);
+    AddResult("crc16_multi", set, (double) bytes, 0, t3 - t2);
+    return errors;
+}
+
+static int BenchHex(BENCH_SET &set)
+{
+    vector<char> ref(2 * set.numBytes), out(2 * set.numBytes);
+    int errors = 0;
+
+    for (int id = 0; id < HEX_ENC_COUNT; id++)
+    {
+        PFN_HEX_ENCODE pfnEncode = hex_encoder_get((HEX_ENCODER) id);
+        if (NULL == pfnEncode)
+        {
+            continue;
+        }
+
+        double t0 = 0;
+        for (int p = -1; p < g_passes; p++)
+        {
+            // Pass -1 checks the output and warms up
+            if (0 == p)
+            {
+                t0 = BenchNow();
+            }
+            char *pc = (HEX_ENC_SCALAR == id) ? &ref[0] : &out[0];
+            for (size_t b = 0; b < set.batches.size(); b++)
+            {
+                const SIG_BATCH &batch = set.batches[b];
+                for (size_t i = 0; i < batch.GetCount(); i++)
+                {
+                    const FUNC_SIG_JOB &job = batch.jobs[i];
+                    const SIG_SCRATCH &scratch = batch.GetScratch(i);
+                    pc = pfnEncode(pc, batch.GetBytes(job), &scratch.mask[job.maskOff], job.len);
+                }
+            }
+            if ((p < 0) && (HEX_ENC_SCALAR != id) &&
+                (0 != memcmp(&ref[0], &out[0], (size_t) (pc - &out[0]))))
+            {
+                errors++;
+            }
+        }
+
+        string kernel = string("hex_encode/") + hex_encoder_name((HEX_ENCODER) id);
+        AddResult(kernel.c_str(), set, (double) set.numBytes, 0, BenchNow() - t0);
+    }
+
+    return errors;
+}
+
+#define REF_LONG_ITEM   256         // bytes of the data items of find_ref_locs/long
+
+static int BenchRefScan(BENCH_SET &set)
+{
+    int errors = 0;
+    size_t found = 0;
+    size_t longBytes = 0;
+    vector<sig_ea_t> longLocs;
+    double t[5];
+
+    // Kernels 0 and 1 search the items of the references, 2 and 3 up to
+    // REF_LONG_ITEM bytes before the item end, as data items
+    for (int k = 0; k < 4; k++)
+    {
+        t[k] = BenchNow();
+        for (int p = 0; p < g_passes; p++)
+        {
+            size_t n = 0;
+            for (size_t b = 0; b < set.batches.size(); b++)
+            {
+                const SIG_BATCH &batch = set.batches[b];
+                for (size_t i = 0; i < batch.GetCount(); i++)
+                {
+                    const FUNC_SIG_JOB &job = batch.jobs[i];
+                    const uint8_t *pBytes = batch.GetBytes(job);
+                    for (size_t x = job.firstXref; x < job.firstXref + job.numXrefs; x++, n++)
+                    {
+                        const SIG_XREF &xref = batch.xrefs[x];
+                        sig_ea_t item = xref.item;
+                        if ((k >= 2) && (xref.itemEnd - job.startEA > REF_LONG_ITEM))
+                        {
+                            item = xref.itemEnd - REF_LONG_ITEM;
+                        }
+                        else if (k >= 2)
+                        {
+                            item = job.startEA;
+                        }
+                        uint32_t refLen = 0;
+                        sig_ea_t loc;
+                        if (0 == (k & 1))
+                        {
+                            loc = find_ref_loc(pBytes, job.bytesLen, job.startEA, item,
+                                               xref.itemEnd, xref.target, &refLen);
+                        }
+                        else
+                        {
+                            find_ref_locs(pBytes, job.bytesLen, job.startEA, item,
+                                          xref.itemEnd, &xref.target, 1, &loc, &refLen);
+                        }
+                        if ((0 == p) && (k < 2))
+                        {
+                            // The prepared xrefs have the locations found by find_ref_locs
+                            errors += (loc != xref.loc);
+                            found += (SIG_BADADDR != loc);
+                        }
+                        else if ((0 == p) && (2 == k))
+                        {
+                            longLocs.push_back(loc);
+                            longBytes += (size_t) (xref.itemEnd - item);
+                        }
+                        else if (0 == p)
+                        {
+                            errors += (loc != longLocs[n]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    t[4] = BenchNow();
+
+    if (found != 2 * set.numRefs)
+    {
+        printf("FAILED: %u of %u references not found in %s\n",
+               (unsigned int) (2 * set.numRefs - found), (unsigned int) (2 * set.numRefs),
+               set.name.c_str());
+        errors++;
+    }
+    if (set.numRefs > 0)
+    {
+        AddResult("find_ref_loc", set, (double) set.refBytes, 0, t[1] - t[0]);
+        AddResult("find_ref_locs", set, (double) set.refBytes, 0, t[2] - t[1]);
+        AddResult("find_ref_loc/long", set, (double) longBytes, 0, t[3] - t[2]);
+        AddResult("find_ref_locs/long", set, (double) longBytes, 0, t[4] - t[3]);
+    }
+    return errors;
+}
+
+static void BenchPrepare(BENCH_SET &set)
+{
+    double t0 = BenchNow();
+    for (int p = 0; p < g_passes; p++)
+    {
+        PrepareAll(set);
+    }
+    AddResult("prepare_func_sigs", set, (double) set.numBytes, 0, BenchNow() - t0);
+}
+
+static void BenchWrite(BENCH_SET &set)
+{
+    vector<char> line(set.maxLineLen);
+    size_t sink = 0;
+
+    double t0 = BenchNow();
+    for (int p = 0; p < g_passes; p++)
+    {
+        for (size_t b = 0; b < set.batches.size(); b++)
+        {
+            for (size_t i = 0; i < set.batches[b].GetCount(); i++)
+            {
+                sink += write_func_sig(set.batches[b], i, &line[0]);
+            }
+        }
+    }
+    double seconds = BenchNow() - t0;
+    g_sink = sink;
+
+    AddResult("write_func_sig", set, (double) set.numBytes, (double) set.numFuncs, seconds);
+}
+
+/* Digest of the PAT output, to compare the thread counts */
+typedef struct tagBENCH_OUTPUT {
+    uint64_t hash;
+    size_t size;
+} BENCH_OUTPUT;
+
+static bool BenchWriteProc(void *ctx, const char *pData, size_t len)
+{
+    BENCH_OUTPUT *pOut = (BENCH_OUTPUT *) ctx;
+    for (size_t i = 0; i < len; i++)
+    {
+        pOut->hash = (pOut->hash ^ (uint8_t) pData[i]) * 0x100000001B3ULL;
+    }
+    pOut->size += len;
+    return true;
+}
+
+static bool DiscardWriteProc(void *, const char *, size_t)
+{
+    return true;
+}
+
+/* Returns a digest of the output of the first pass, each pass skips the
+   lines equal to an earlier line of the pass with bSkipDupLines */
+static uint64_t BenchEncode(BENCH_SET &set, unsigned int threads, bool bSkipDupLines)
+{
+    WORKER_POOL workers;
+    workers.Start(threads);
+
+    BENCH_OUTPUT out = { 0xCBF29CE484222325ULL, 0 };
+    double seconds = 0;
+    for (int p = -1; p < g_passes; p++)
+    {
+        // Pass -1 hashes the output and is not timed
+        SIG_WRITER writer;
+        if (p < 0)
+        {
+            writer.Start(BenchWriteProc, &out);
+        }
+        else
+        {
+            writer.Start(DiscardWriteProc, NULL);
+        }
+
+        PAT_LINE_INDEX lines;
+        double t0 = BenchNow();
+        for (size_t b = 0; b < set.batches.size(); b++)
+        {
+            SIG_BATCH &batch = set.batches[b];
+            batch.pLines = bSkipDupLines ? &lines : NULL;
+            (void) encode_func_sigs(batch, workers, writer);
+            batch.collisions.clear();
+            batch.pLines = NULL;
+        }
+        (void) writer.Finish();
+        if (p >= 0)
+        {
+            seconds += BenchNow() - t0;
+        }
+    }
+
+    char kernel[40];
+    sprintf(kernel, bSkipDupLines ? "encode_func_sigs/%ut/dedup" : "encode_func_sigs/%ut",
+            workers.GetThreadCount());
+    AddResult(kernel, set, (double) set.numBytes, (double) set.numFuncs, seconds);
+    workers.Stop();
+
+    return out.hash ^ out.size;
+}
+
+/* Returns a digest of the output of the functions collected from the database */
+static uint64_t BenchCollect(BENCH_SET &set)
+{
+    SIG_SNAPSHOT snapshot;
+    capture_snapshot(set.db, snapshot);
+
+    SIG_COLLECT collect;
+    collect.pDb = &set.db;
+    collect.pSnapshot = &snapshot;
+    collect.minFuncLen = 0;
+    collect.bAllNames = false;
+    collect.pDiag = NULL;
+
+    WORKER_POOL workers;
+    workers.Start(1);
+    BENCH_OUTPUT out = { 0xCBF29CE484222325ULL, 0 };
+    SIG_BATCH batch;
+    double seconds = 0;
+    size_t numFuncs = set.db.GetFuncCount();
+    for (int p = -1; p < g_passes; p++)
+    {
+        // Pass -1 encodes the collected functions and is not timed
+        SIG_WRITER writer;
+        writer.Start(BenchWriteProc, &out);
+
+        double t0 = BenchNow();
+        for (size_t i = 0; i < numFuncs; i++)
+        {
+            DB_FUNC func;
+            if (!set.db.GetFunc(i, func))
+            {
+                continue;
+            }
+            (void) collect_func_sig(collect, func.startEA, (size_t) (func.endEA - func.startEA),
+                                    batch, false);
+            if (batch.IsFull() || (i + 1 == numFuncs))
+            {
+                if (p < 0)
+                {
+                    (void) encode_func_sigs(batch, workers, writer);
+                }
+                batch.Clear();
+            }
+        }
+        if (p >= 0)
+        {
+            seconds += BenchNow() - t0;
+        }
+        (void) writer.Finish();
+    }
+
+    AddResult("collect_func_sig", set, (double) set.numBytes, (double) set.numFuncs, seconds);
+    workers.Stop();
+
+    return out.hash ^ out.size;
+}
+
+/* Returns 1 if collecting and encoding a batch a second time allocates */
+static int BenchAllocs(BENCH_SET &set, unsigned int threads)
+{
+    SIG_SNAPSHOT snapshot;
+    capture_snapshot(set.db, snapshot);
+
+    SIG_COLLECT collect;
+    collect.pDb = &set.db;
+    collect.pSnapshot = &snapshot;
+    collect.minFuncLen = 0;
+    collect.bAllNames = false;
+    collect.pDiag = NULL;
+
+    WORKER_POOL workers;
+    workers.Start(threads);
+    SIG_BATCH batch;
+    long allocs = 0;
+    size_t numFuncs = set.db.GetFuncCount();
+    for (int p = 0; p < 2; p++)
+    {
+        // Pass 0 grows the batch, pass 1 must reuse its memory
+        SIG_WRITER writer;
+        writer.Start(DiscardWriteProc, NULL);
+        long count = g_sigAllocCount;
+
+        batch.Clear();
+        for (size_t i = 0; (i < numFuncs) && !batch.IsFull(); i++)
+        {
+            DB_FUNC func;
+            if (set.db.GetFunc(i, func))
+            {
+                (void) collect_func_sig(collect, func.startEA,
+                                        (size_t) (func.endEA - func.startEA), batch, false);
+            }
+        }
+        (void) encode_func_sigs(batch, workers, writer);
+        (void) writer.Finish();
+
+        allocs = g_sigAllocCount - count;
+    }
+    workers.Stop();
+
+    if (0 != allocs)
+    {
+        printf("FAILED: the second batch made %ld allocations\n", allocs);
+        return 1;
+    }
+    return 0;
+}
+
+/* A file in memory, size bytes of it can be read */
+typedef struct tagBENCH_FILE {
+    vector<char> data;
+    size_t size;
+    size_t pos;
+} BENCH_FILE;
+
+static bool BenchFileWriteProc(void *ctx, const char *pData, size_t len)
+{
+    BENCH_FILE *pFile = (BENCH_FILE *) ctx;
+    pFile->data.insert(pFile->data.end(), pData, pData + len);
+    return true;
+}
+
+static bool BenchFileReadProc(void *ctx, void *pData, size_t len)
+{
+    BENCH_FILE *pFile = (BENCH_FILE *) ctx;
+    if (len > pFile->size - pFile->pos)
+    {
+        return false;
+    }
+    memcpy(pData, &pFile->data[pFile->pos], len);
+    pFile->pos += len;
+    return true;
+}
+
+/* Loads the first size bytes of a cache file, given as a file of fileSize bytes */
+static bool BenchLoadCache(BENCH_FILE &file, size_t size, uint64_t fileSize)
+{
+    SIG_PAT_CACHE cache;
+    file.size = size;
+    file.pos = 0;
+    return cache.Load(BenchFileReadProc, &file, fileSize);
+}
+
+/* Returns 1 if a truncated or damaged cache file is loaded, or the saved one is not */
+static int BenchCacheLoad(BENCH_SET &set)
+{
+    // The cache file of the first batch
+    WORKER_POOL workers;
+    workers.Start(1);
+    SIG_PAT_CACHE cache;
+    SIG_BATCH &batch = set.batches[0];
+    SIG_WRITER writer;
+    writer.Start(DiscardWriteProc, NULL);
+    cache.Lookup(batch, workers);
+    (void) encode_func_sigs(batch, workers, writer);
+    (void) writer.Finish();
+    cache.Update(batch);
+    batch.bKeepLines = false;
+    workers.Stop();
+
+    BENCH_FILE file;
+    (void) cache.Save(BenchFileWriteProc, &file);
+    size_t size = file.data.size();
+    if (!BenchLoadCache(file, size, size))
+    {
+        printf("FAILED: the saved pattern cache could not be loaded\n");
+        return 1;
+    }
+
+    // Truncated, with the size of the part and with the size of the whole file
+    for (size_t len = 0; len < size; len += (len < 64) ? 1 : size / 61 + 1)
+    {
+        if (BenchLoadCache(file, len, len) || BenchLoadCache(file, len, size))
+        {
+            printf("FAILED: a pattern cache cut to %u bytes was loaded\n", (unsigned int) len);
+            return 1;
+        }
+    }
+
+    // Bytes after the last entry
+    file.data.resize(size + 16, 'X');
+    if (BenchLoadCache(file, size + 16, size + 16))
+    {
+        printf("FAILED: a pattern cache with bytes after its entries was loaded\n");
+        return 1;
+    }
+
+    // Large counts: the entries, the locations and the line length of the first entry
+    const size_t entriesOff = 8 + 2 * sizeof(uint32_t);
+    const size_t locsOff = entriesOff + sizeof(uint32_t) + sizeof(uint64_t) + sizeof(sig_ea_t) +
+                           sizeof(uint32_t);
+    uint32_t numLocs;
+    memcpy(&numLocs, &file.data[locsOff], sizeof(numLocs));
+    const size_t countOffs[] = {
+        entriesOff, locsOff, locsOff + sizeof(uint32_t) + numLocs * sizeof(sig_ea_t)
+    };
+    const uint32_t counts[] = { 0xFFFFFFFF, 0x7FFFFFFF, 0x40000000, (uint32_t) size };
+    for (size_t o = 0; o < sizeof(countOffs) / sizeof(countOffs[0]); o++)
+    {
+        for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+        {
+            BENCH_FILE bad;
+            bad.data.assign(file.data.begin(), file.data.begin() + size);
+            memcpy(&bad.data[countOffs[o]], &counts[c], sizeof(counts[c]));
+            if (BenchLoadCache(bad, size, size))
+            {
+                printf("FAILED: a pattern cache with the count 0x%X at %u was loaded\n",
+                       counts[c], (unsigned int) countOffs[o]);
+                return 1;
+            }
+        }
+    }
+
+    // Random bytes after the header must not crash
+    for (int n = 0; n < 100; n++)
+    {
+        BENCH_FILE bad;
+        bad.data.assign(file.data.begin(), file.data.begin() + size);
+        for (size_t i = entriesOff; i < size; i++)
+        {
+            bad.data[i] = (char) Rand();
+        }
+        (void) BenchLoadCache(bad, size, size);
+    }
+    return 0;
+}
+
+/* Replays the first size bytes of a function dump, false if it is refused */
+static bool BenchReplay(const BENCH_FILE &dump, size_t size)
+{
+    WORKER_POOL workers;
+    workers.Start(1);
+    SIG_WRITER writer;
+    writer.Start(DiscardWriteProc, NULL);
+    SIG_SELECT select;
+    select.mode = SIG_SELECT_ALL;
+    select.minFuncLen = 0;
+    select.bSkipDupLines = false;
+    SIG_REPLAY_STATS stats;
+    bool bOk = replay_snapshot((const uint8_t *) &dump.data[0], size, select, workers, writer,
+                               &stats);
+    if (bOk)
+    {
+        bOk = writer.Finish();
+    }
+    else
+    {
+        writer.Abort();
+    }
+    workers.Stop();
+    return bOk;
+}
+
+/* Returns 1 if a truncated or damaged function dump is replayed, or the written one is not */
+static int BenchSnapshotLoad(BENCH_SET &set)
+{
+    // The dump of all functions, as the plugin exports it
+    SIG_SNAPSHOT snapshot;
+    capture_snapshot(set.db, snapshot);
+    SIG_COLLECT collect;
+    collect.pDb = &set.db;
+    collect.pSnapshot = &snapshot;
+    collect.minFuncLen = 0;
+    collect.bAllNames = true;
+    collect.pDiag = NULL;
+
+    BENCH_FILE dump;
+    (void) write_snapshot_header(snapshot, BenchFileWriteProc, &dump);
+    SIG_BATCH batch;
+    for (size_t i = 0; i < set.db.GetFuncCount(); i++)
+    {
+        DB_FUNC func;
+        set.db.GetFunc(i, func);
+        (void) collect_func_sig(collect, func.startEA, (size_t) (func.endEA - func.startEA),
+                                batch, false);
+        if (batch.IsFull() || (i + 1 == set.db.GetFuncCount()))
+        {
+            (void) write_snapshot_batch(batch, BenchFileWriteProc, &dump);
+            batch.Clear();
+        }
+    }
+    (void) write_snapshot_end(BenchFileWriteProc, &dump);
+    size_t size = dump.data.size();
+    if (!BenchReplay(dump, size))
+    {
+        printf("FAILED: the written function dump could not be replayed\n");
+        return 1;
+    }
+
+    // Truncated
+    for (size_t len = 0; len < size; len += (len < 64) ? 1 : size / 61 + 1)
+    {
+        if (BenchReplay(dump, len))
+        {
+            printf("FAILED: a function dump cut to %u bytes was replayed\n", (unsigned int) len);
+            return 1;
+        }
+    }
+
+    // Large counts and lengths: the segments, the end of the first segment
+    // and the entries
+    const size_t segmentsOff = 8 + 2 * sizeof(uint32_t);
+    uint32_t numSegments;
+    memcpy(&numSegments, &dump.data[segmentsOff], sizeof(numSegments));
+    size_t entriesOff = segmentsOff + sizeof(uint32_t);
+    for (uint32_t i = 0; i < numSegments; i++)
+    {
+        sig_ea_t ea[2];
+        memcpy(ea, &dump.data[entriesOff], sizeof(ea));
+        entriesOff += sizeof(ea) + (size_t) (ea[1] - ea[0]);
+    }
+    const size_t countOffs[] = { segmentsOff, entriesOff };
+    const uint32_t counts[] = { 0xFFFFFFFF, 0x7FFFFFFF, 0x40000000, (uint32_t) size };
+    for (size_t o = 0; o < sizeof(countOffs) / sizeof(countOffs[0]); o++)
+    {
+        for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+        {
+            BENCH_FILE bad;
+            bad.data = dump.data;
+            memcpy(&bad.data[countOffs[o]], &counts[c], sizeof(counts[c]));
+            if (BenchReplay(bad, size))
+            {
+                printf("FAILED: a function dump with the count 0x%X at %u was replayed\n",
+                       counts[c], (unsigned int) countOffs[o]);
+                return 1;
+            }
+        }
+    }
+    if (numSegments > 0)
+    {
+        BENCH_FILE bad;
+        bad.data = dump.data;
+        memset(&bad.data[segmentsOff + sizeof(uint32_t) + sizeof(sig_ea_t)], 0xFF,
+               sizeof(sig_ea_t));
+        if (BenchReplay(bad, size))
+        {
+            printf("FAILED: a function dump with a segment past its end was replayed\n");
+            return 1;
+        }
+    }
+
+    // Random bytes after the header must not crash
+    for (int n = 0; n < 20; n++)
+    {
+        BENCH_FILE bad;
+        bad.data = dump.data;
+        for (size_t i = segmentsOff; i < size; i++)
+        {
+            bad.data[i] = (char) Rand();
+        }
+        (void) BenchReplay(bad, size);
+    }
+    return 0;
+}
+
+#define RESTART_THREADS 4
+#define RESTART_ROUNDS  200
+#define RESTART_JOBS    64
+
+/* Jobs started and finished by the workers of BenchRestart */
+typedef struct tagRESTART_JOB {
+    volatile long started;
+    volatile long finished;
+} RESTART_JOB;
+
+static void RestartJobProc(void *ctx, size_t index)
+{
+    RESTART_JOB *pJob = (RESTART_JOB *) ctx;
+    (void) AtomicIncrement(&pJob->started);
+    volatile uint32_t x = (uint32_t) index;
+    for (int i = 0; i < 2000; i++)
+    {
+        x = x * 1103515245 + 12345;
+    }
+    (void) AtomicIncrement(&pJob->finished);
+}
+
+/* Returns 1 if Run() of a restarted pool returns before all of its jobs finished */
+static int BenchRestart(void)
+{
+    WORKER_POOL workers;
+    RESTART_JOB job = { 0, 0 };
+    for (long r = 0; r < RESTART_ROUNDS; r++)
+    {
+        workers.Start(RESTART_THREADS);
+        for (long n = 0; n < 2; n++)
+        {
+            workers.Run(RESTART_JOBS, RestartJobProc, &job);
+            long expected = (2 * r + n + 1) * RESTART_JOBS;
+            if ((job.finished != expected) || (job.started != expected))
+            {
+                printf("FAILED: Run() of a restarted worker pool returned with %ld of %ld "
+                       "jobs finished\n", job.finished, expected);
+                workers.Stop();
+                return 1;
+            }
+        }
+        workers.Stop();
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *pszCsv = NULL;
+    unsigned int threads = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((0 == strcmp(argv[i], "-c")) && (i + 2 < argc))
+        {
+            return BENCH_RESULTS::Compare(argv[i + 1], argv[i + 2]);
+        }
+        else if ((0 == strcmp(argv[i], "-p")) && (i + 1 < argc))
+        {
+            g_passes = atoi(argv[++i]);
+        }
+        else if ((0 == strcmp(argv[i], "-t")) && (i + 1 < argc))
+        {
+            threads = (unsigned int) atoi(argv[++i]);
+        }
+        else if ((0 == strcmp(argv[i], "-o")) && (i + 1 < argc))
+        {
+            pszCsv = argv[++i];
+        }
+        else
+        {
+            printf("Usage: sigbench [-p passes] [-t threads] [-o results.csv]\n"
+                   "       sigbench -c base.csv new.csv\n");
+            return 1;
+        }
+    }
+    if (g_passes <= 0)
+    {
+        g_passes = PASSES;
+    }
+
+    (void) InitHexEncoder();
+    InitRefScan();
+
+    int errors = BenchRestart();
+    for (size_t s = 0; s < sizeof(g_sizes) / sizeof(g_sizes[0]); s++)
+    {
+        for (size_t d = 0; d < sizeof(g_densities) / sizeof(g_densities[0]); d++)
+        {
+            BENCH_SET set;
+            MakeSet(set, g_sizes[s], g_densities[d]);
+            printf("%s: %u functions, %u bytes, %u references\n", set.name.c_str(),
+                   (unsigned int) set.numFuncs, (unsigned int) set.numBytes,
+                   (unsigned int) set.numRefs);
+
+            // The kernels after the prepare use its masks and locations
+            BenchPrepare(set);
+            errors += BenchRefScan(set);
+            errors += BenchCrc(set);
+            errors += BenchHex(set);
+            BenchWrite(set);
+            uint64_t digest = BenchEncode(set, 1, false);
+            if (digest != BenchEncode(set, threads, false))
+            {
+                printf("FAILED: the PAT output depends on the thread count\n");
+                errors++;
+            }
+            if (BenchEncode(set, 1, true) != BenchEncode(set, threads, true))
+            {
+                printf("FAILED: the deduplicated PAT output depends on the thread count\n");
+                errors++;
+            }
+            if (digest != BenchCollect(set))
+            {
+                printf("FAILED: the functions collected from the database differ\n");
+                errors++;
+            }
+            errors += BenchAllocs(set, 1);
+            errors += BenchAllocs(set, threads);
+            errors += BenchCacheLoad(set);
+            errors += BenchSnapshotLoad(set);
+        }
+    }
+
+    if (errors > 0)
+    {
+        printf("FAILED: %d kernel results differ from their references\n", errors);
+        return 1;
+    }
+    if ((NULL != pszCsv) && !g_results.WriteCsv(pszCsv))
+    {
+        printf("Could not write %s\n", pszCsv);
+        return 1;
+    }
+    return 0;
+}
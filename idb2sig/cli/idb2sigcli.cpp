@@ -0,0 +1,350 @@
+/*************************************************************************
+    IDB2SIG command line tool
+    Creates FLAIR PAT files from the function dumps (.sigsnap) and the
+    database snapshots (.dbsnap) exported by the plugin ("Export Function
+    Dump" option), without IDA. The output is the same as the PAT file of
+    a plugin run in the same function mode. A database snapshot runs the
+    function collection of the plugin too. Several dumps are processed in
+    parallel, one dump per worker thread. With "-d 1" a pattern line equal
+    to an earlier line of the same dump is not written.
+    Build it from the idb2sig directory with
+        g++ -O2 -pthread -I. -I../common cli/idb2sigcli.cpp patgen.cpp patout.cpp
+            crc16.cpp hexenc.cpp refscan.cpp snapshot.cpp sigcollect.cpp
+            patindex.cpp -o idb2sig
+    or
+        cl /O2 /EHsc /I. /I..\common cli\idb2sigcli.cpp patgen.cpp patout.cpp
+            crc16.cpp hexenc.cpp refscan.cpp snapshot.cpp sigcollect.cpp
+            patindex.cpp
+    Add -D__EA64__ (/D__EA64__) for the dumps of 64-bit databases.
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "snapshot.h"
+#include "sigcollect.h"
+#include "memdb.h"
+#include "hexenc.h"
+#include "refscan.h"
+#include "threads.h"
+
+#define DEF_MIN_FUNC_LENGTH 6
+
+using namespace std;
+
+/* Options and results of all dumps */
+typedef struct tagCLI_RUN {
+    SIG_SELECT select;
+    unsigned int threads;           // per dump when there is only one dump
+    const char *pOutDir;            // NULL: next to the dump
+    vector<const char *> dumps;
+    vector<int> results;            // not vector<bool>, set by several threads
+    MUTEX printLock;
+} CLI_RUN;
+
+static const char *g_modeNames[SIG_SELECT_MODE_MAX + 1] = {
+    "nonauto", "library", "public", "entry", "all"
+};
+
+static void Usage(void)
+{
+    (void) fprintf(stderr,
+        "Usage: idb2sig [-m mode] [-l length] [-t threads] [-d 1|0] [-o dir]"
+        " dump.sigsnap|db.dbsnap...\n"
+        "  -m mode     nonauto, library, public, entry or all (default nonauto)\n"
+        "  -l length   minimum function length (default %d)\n"
+        "  -t threads  worker threads, 0 is one per processor (default 0)\n"
+        "  -d 1|0      skip the lines equal to an earlier line (default 0)\n"
+        "  -o dir      directory of the PAT files (default next to each dump)\n",
+        DEF_MIN_FUNC_LENGTH);
+}
+
+/* Writes a block to a PAT file */
+static bool WriteFileProc(void *ctx, const char *pData, size_t len)
+{
+    return (len == fwrite(pData, 1, len, (FILE *) ctx));
+}
+
+/* Reads a whole file */
+static bool ReadWholeFile(const char *pPath, vector<uint8_t> &data)
+{
+    FILE *fp = fopen(pPath, "rb");
+    if (NULL == fp)
+    {
+        return false;
+    }
+
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+        data.insert(data.end(), buf, buf + n);
+    }
+    bool bOk = !ferror(fp);
+    (void) fclose(fp);
+    return bOk;
+}
+
+/* A file read from memory */
+typedef struct tagMEM_READ {
+    const uint8_t *pData;
+    size_t size;
+    size_t pos;
+} MEM_READ;
+
+/* Reads a block of a file in memory */
+static bool ReadMemProc(void *ctx, void *pData, size_t len)
+{
+    MEM_READ *pFile = (MEM_READ *) ctx;
+    if (len > pFile->size - pFile->pos)
+    {
+        return false;
+    }
+    memcpy(pData, pFile->pData + pFile->pos, len);
+    pFile->pos += len;
+    return true;
+}
+
+/* Encodes a database snapshot, with the function collection of the plugin */
+static bool CollectDbSnapshot(const vector<uint8_t> &data, const SIG_SELECT &select,
+                              WORKER_POOL &workers, SIG_WRITER &writer,
+                              SIG_REPLAY_STATS *pStats)
+{
+    MEM_READ file = { &data[0], data.size(), 0 };
+    MEM_DB db;
+    if (!db.Load(ReadMemProc, &file))
+    {
+        return false;
+    }
+
+    return collect_db_sigs(db, select, workers, writer, pStats);
+}
+
+/* The PAT file name of a dump */
+static string GetPatPath(const char *pDump, const char *pOutDir)
+{
+    string path(pDump);
+    size_t slash = path.find_last_of("/\\");
+    size_t dot = path.find_last_of('.');
+    if ((string::npos != dot) && ((string::npos == slash) || (dot > slash)))
+    {
+        path.erase(dot);
+    }
+    path += ".pat";
+
+    if (NULL != pOutDir)
+    {
+        string name = (string::npos == slash) ? path : path.substr(slash + 1);
+        path = pOutDir;
+        if (!path.empty() && ('/' != path[path.size() - 1]) && ('\\' != path[path.size() - 1]))
+        {
+            path += '/';
+        }
+        path += name;
+    }
+
+    return path;
+}
+
+/**********************************************************************
+* Function:     ProcessDump
+* Description:  creates the PAT file of one dump. It is written to a
+*               .part file first, so a failed run leaves no partly
+*               written PAT file and does not touch an existing one.
+* Parameters:   CLI_RUN &run
+*               size_t index - the dump
+*               unsigned int threads - encoding threads for this dump
+* Returns:      false on error
+**********************************************************************/
+static bool ProcessDump(CLI_RUN &run, size_t index, unsigned int threads)
+{
+    const char *pDump = run.dumps[index];
+    string patPath = GetPatPath(pDump, run.pOutDir);
+    string partPath = patPath + ".part";
+    const char *pError = NULL;
+    SIG_REPLAY_STATS stats;
+    memset(&stats, 0, sizeof(stats));
+
+    vector<uint8_t> data;
+    FILE *fp = NULL;
+    if (!ReadWholeFile(pDump, data))
+    {
+        pError = "could not read the dump";
+    }
+    else if (NULL == (fp = fopen(partPath.c_str(), "wb")))
+    {
+        pError = "could not create the PAT file";
+    }
+    else
+    {
+        WORKER_POOL workers;
+        SIG_WRITER writer;
+        workers.Start(threads);
+        writer.Start(WriteFileProc, fp);
+
+        bool bOk;
+        if ((data.size() >= 8) && (0 == memcmp(&data[0], MEM_DB_MAGIC, 8)))
+        {
+            bOk = CollectDbSnapshot(data, run.select, workers, writer, &stats);
+        }
+        else
+        {
+            bOk = replay_snapshot(data.empty() ? NULL : &data[0], data.size(), run.select,
+                                  workers, writer, &stats);
+        }
+        workers.Stop();
+        if (!writer.Finish())
+        {
+            pError = "writing the PAT file failed";
+        }
+        else if (!bOk)
+        {
+            pError = "not a dump or a database snapshot of this address size, or out of memory";
+        }
+
+        if ((0 != fclose(fp)) && (NULL == pError))
+        {
+            pError = "writing the PAT file failed";
+        }
+        if (NULL == pError)
+        {
+            (void) remove(patPath.c_str());
+            if (0 != rename(partPath.c_str(), patPath.c_str()))
+            {
+                pError = "could not rename the PAT file";
+            }
+        }
+        if (NULL != pError)
+        {
+            (void) remove(partPath.c_str());
+        }
+    }
+
+    run.printLock.Lock();
+    if (NULL != pError)
+    {
+        (void) fprintf(stderr, "%s: %s\n", pDump, pError);
+    }
+    else
+    {
+        (void) printf("%s: %u functions, %u references not found, %u duplicate lines,"
+                      " %u collisions -> %s\n", pDump,
+                      (unsigned int) stats.numFuncs, (unsigned int) stats.numRefsNotFound,
+                      (unsigned int) stats.numDuplicates, (unsigned int) stats.numCollisions,
+                      patPath.c_str());
+    }
+    run.printLock.Unlock();
+
+    return (NULL == pError);
+}
+
+/* Worker job, one dump */
+static void ProcessDumpProc(void *ctx, size_t index)
+{
+    CLI_RUN &run = *(CLI_RUN *) ctx;
+    run.results[index] = ProcessDump(run, index, 1);
+}
+
+int main(int argc, char *argv[])
+{
+    CLI_RUN run;
+    run.select.mode = SIG_SELECT_NON_AUTO;
+    run.select.minFuncLen = DEF_MIN_FUNC_LENGTH;
+    run.select.bSkipDupLines = false;
+    run.threads = 0;
+    run.pOutDir = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *pArg = argv[i];
+        if (('-' != pArg[0]) || ('\0' == pArg[1]))
+        {
+            run.dumps.push_back(pArg);
+            continue;
+        }
+        if (('\0' != pArg[2]) || (i + 1 >= argc))
+        {
+            Usage();
+            return 2;
+        }
+
+        const char *pValue = argv[++i];
+        switch (pArg[1])
+        {
+            case 'm':
+            {
+                int mode = 0;
+                while ((mode <= SIG_SELECT_MODE_MAX) && (0 != strcmp(pValue, g_modeNames[mode])))
+                {
+                    mode++;
+                }
+                if (mode > SIG_SELECT_MODE_MAX)
+                {
+                    Usage();
+                    return 2;
+                }
+                run.select.mode = (SIG_SELECT_MODE) mode;
+                break;
+            }
+
+            case 'l':
+                run.select.minFuncLen = (uint32_t) strtoul(pValue, NULL, 0);
+                break;
+
+            case 't':
+                run.threads = (unsigned int) strtoul(pValue, NULL, 0);
+                break;
+
+            case 'd':
+                run.select.bSkipDupLines = (0 != strtoul(pValue, NULL, 0));
+                break;
+
+            case 'o':
+                run.pOutDir = pValue;
+                break;
+
+            default:
+                Usage();
+                return 2;
+        }
+    }
+
+    if (run.dumps.empty())
+    {
+        Usage();
+        return 2;
+    }
+
+    // Pick the SIMD kernels before any worker thread uses them
+    (void) InitHexEncoder();
+    InitRefScan();
+
+    run.results.assign(run.dumps.size(), 0);
+    if (1 == run.dumps.size())
+    {
+        // One dump, its batches are encoded in parallel
+        run.results[0] = ProcessDump(run, 0, run.threads);
+    }
+    else
+    {
+        // One dump per worker thread
+        WORKER_POOL workers;
+        workers.Start(run.threads);
+        workers.Run(run.dumps.size(), ProcessDumpProc, &run);
+        workers.Stop();
+    }
+
+    int failed = 0;
+    for (size_t i = 0; i < run.results.size(); i++)
+    {
+        if (!run.results[i])
+        {
+            failed++;
+        }
+    }
+
+    return (0 == failed) ? 0 : 1;
+}
@@ -0,0 +1,172 @@
+/*************************************************************************
+    IDB2SIG CRC_CCITT 16 kernels
+    Slicing-by-8 with tables built at compile time (crc16tab.h), and a
+    multi-buffer version computing the CRCs of four functions at once,
+    interleaved so their table lookups overlap.
+    All of them return exactly what the FLAIR crc16 returns.
+*************************************************************************/
+
+#include "crc16.h"
+#include "crc16tab.h"
+
+#define CRC16_LANES     4
+
+/* Feed one byte to the running CRC */
+static inline uint32_t crc16_update1(uint32_t crc, uint8_t data)
+{
+    return (crc >> 8) ^ CRC16_TABLE[0][(crc ^ data) & 0xFF];
+}
+
+/* Feed eight bytes to the running CRC */
+static inline uint32_t crc16_update8(uint32_t crc, const uint8_t *p)
+{
+    crc ^= (uint32_t) p[0] | ((uint32_t) p[1] << 8);
+    return CRC16_TABLE[7][crc & 0xFF] ^ CRC16_TABLE[6][crc >> 8] ^
+           CRC16_TABLE[5][p[2]] ^ CRC16_TABLE[4][p[3]] ^
+           CRC16_TABLE[3][p[4]] ^ CRC16_TABLE[2][p[5]] ^
+           CRC16_TABLE[1][p[6]] ^ CRC16_TABLE[0][p[7]];
+}
+
+/* Feed len bytes to the running CRC */
+static inline uint32_t crc16_update(uint32_t crc, const uint8_t *p, uint32_t len)
+{
+    for (; len >= 8; len -= 8, p += 8)
+    {
+        crc = crc16_update8(crc, p);
+    }
+    for (; len > 0; len--)
+    {
+        crc = crc16_update1(crc, *p++);
+    }
+    return crc;
+}
+
+/* Invert and swap the bytes of the running CRC, like FLAIR does */
+static inline uint16_t crc16_final(uint32_t crc)
+{
+    crc = ~crc & 0xFFFF;
+    return (uint16_t) ((crc << 8) | (crc >> 8));
+}
+
+/**********************************************************************
+* Function:     crc16_bytewise
+* Description:
+*   crc16 is ripped straight out the c file that comes with the
+*   FLAIR package
+*                                        16   12   5
+*   this is the CCITT CRC 16 polynomial X  + X  + X  + 1.
+*   This works out to be 0x1021, but the way the algorithm works
+*   lets us use 0x8408 (the reverse of the bit pattern).  The high
+*   bit is always assumed to be set, thus we only use 16 bits to
+*   represent the 17 bit value.
+*   One table lookup per byte, kept as the reference for crc16.
+* Parameters: uchar *pdata - pointer to data
+*             uint16 len - data length
+* Returns:    CRC
+* Optimize by TQN, run faster about 12 times
+**********************************************************************/
+uint16_t crc16_bytewise(const uint8_t *pdata, uint16_t len)
+{
+    _ASSERTE(pdata != NULL);
+    if ((NULL == pdata) || (0 == len))
+    {
+        return 0;
+    }
+
+    uint32_t data;
+    uint32_t crc = 0xFFFF;
+    do
+    {
+        data = *pdata++;
+        crc = (crc >> 8) ^ CRC16_TABLE[0][(crc ^ data) & 0xFF];
+    } while (--len);
+
+    crc = ~crc;
+    data = crc;
+    crc = (crc << 8) | ((data >> 8) & 0xFF);
+
+    return (uint16_t) crc;
+}
+
+/**********************************************************************
+* Function:     crc16
+* Description:  same as crc16_bytewise, eight bytes per step
+* Parameters:   uchar *pdata - pointer to data
+*               uint16 len - data length
+* Returns:      CRC
+**********************************************************************/
+uint16_t crc16(const uint8_t *pdata, uint16_t len)
+{
+    _ASSERTE(pdata != NULL);
+    if ((NULL == pdata) || (0 == len))
+    {
+        return 0;
+    }
+
+    return crc16_final(crc16_update(0xFFFF, pdata, len));
+}
+
+/**********************************************************************
+* Function:     crc16_x4
+* Description:  CRCs of four blocks, the common length is processed
+*               interleaved, the rest of each block alone
+* Parameters:   const uint8_t *const *ppData - four blocks
+*               const uint16_t *pLen - their lengths
+*               uint16_t *pCrc - out: their CRCs
+* Returns:      none
+**********************************************************************/
+static void crc16_x4(const uint8_t *const *ppData, const uint16_t *pLen, uint16_t *pCrc)
+{
+    const uint8_t *p0 = ppData[0], *p1 = ppData[1], *p2 = ppData[2], *p3 = ppData[3];
+    uint32_t c0 = 0xFFFF, c1 = 0xFFFF, c2 = 0xFFFF, c3 = 0xFFFF;
+
+    uint32_t common = pLen[0];
+    for (int i = 1; i < CRC16_LANES; i++)
+    {
+        if (pLen[i] < common)
+        {
+            common = pLen[i];
+        }
+    }
+    common &= ~7U;
+
+    for (uint32_t pos = 0; pos < common; pos += 8)
+    {
+        c0 = crc16_update8(c0, p0 + pos);
+        c1 = crc16_update8(c1, p1 + pos);
+        c2 = crc16_update8(c2, p2 + pos);
+        c3 = crc16_update8(c3, p3 + pos);
+    }
+
+    c0 = crc16_update(c0, p0 + common, pLen[0] - common);
+    c1 = crc16_update(c1, p1 + common, pLen[1] - common);
+    c2 = crc16_update(c2, p2 + common, pLen[2] - common);
+    c3 = crc16_update(c3, p3 + common, pLen[3] - common);
+
+    pCrc[0] = (0 == pLen[0]) ? 0 : crc16_final(c0);
+    pCrc[1] = (0 == pLen[1]) ? 0 : crc16_final(c1);
+    pCrc[2] = (0 == pLen[2]) ? 0 : crc16_final(c2);
+    pCrc[3] = (0 == pLen[3]) ? 0 : crc16_final(c3);
+}
+
+/**********************************************************************
+* Function:     crc16_multi
+* Description:  CRCs of many blocks, four at a time
+* Parameters:   const uint8_t *const *ppData - the blocks
+*               const uint16_t *pLen - their lengths
+*               uint16_t *pCrc - out: their CRCs
+*               size_t count - number of blocks
+* Returns:      none
+**********************************************************************/
+void crc16_multi(const uint8_t *const *ppData, const uint16_t *pLen, uint16_t *pCrc, size_t count)
+{
+    size_t i = 0;
+    for (; i + CRC16_LANES <= count; i += CRC16_LANES)
+    {
+        crc16_x4(ppData + i, pLen + i, pCrc + i);
+    }
+    for (; i < count; i++)
+    {
+        pCrc[i] = crc16(ppData[i], pLen[i]);
+    }
+}
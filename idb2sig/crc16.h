@@ -0,0 +1,23 @@
+#ifndef __IDB2SIG_CRC16_H__
+#define __IDB2SIG_CRC16_H__
+
+#pragma once
+
+/*
+ * CRC_CCITT 16 of the pattern CRC blocks, as computed by FLAIR.
+ * Portable, does not call the IDA SDK.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _ASSERTE
+    #include <assert.h>
+    #define _ASSERTE(x) assert(x)
+#endif
+
+uint16_t crc16(const uint8_t *pdata, uint16_t len);
+uint16_t crc16_bytewise(const uint8_t *pdata, uint16_t len);
+void crc16_multi(const uint8_t *const *ppData, const uint16_t *pLen, uint16_t *pCrc, size_t count);
+
+#endif  // __IDB2SIG_CRC16_H__
@@ -0,0 +1,239 @@
+/*************************************************************************
+    IDB2SIG masked hex encoder
+    Writes the "..XXXX.." bodies of pattern lines, 16 or 32 bytes per step
+    instead of one Num2HexStr call per byte. The kernel is picked once,
+    by InitHexEncoder, from the CPU features.
+*************************************************************************/
+
+#include "hexenc.h"
+#include "cpufeat.h"
+
+#define DOT     0x2E
+
+static const char HEXSTR[] = "0123456789ABCDEF";
+
+/**********************************************************************
+* Function:     hex_encode_scalar
+* Description:  one byte at a time, the fallback kernel
+* Parameters:   char *pOut - receives 2 * len characters
+*               const uint8_t *pData - bytes
+*               const uint8_t *pMask - non zero for variable bytes
+*               size_t len
+* Returns:      pointer after the last written character
+**********************************************************************/
+static char *hex_encode_scalar(char *pOut, const uint8_t *pData, const uint8_t *pMask, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (pMask[i])
+        {
+            *pOut++ = DOT;
+            *pOut++ = DOT;
+        }
+        else
+        {
+            *pOut++ = HEXSTR[pData[i] >> 4];
+            *pOut++ = HEXSTR[pData[i] & 0x0F];
+        }
+    }
+
+    return pOut;
+}
+
+#ifdef CPU_X86
+
+/* Convert 16 nibbles to their hex digits */
+CPU_TARGET("sse2")
+static inline __m128i hex_digits_sse2(__m128i n)
+{
+    // '0' + n, and 'A' - '0' - 10 more when n > 9
+    __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(n, _mm_set1_epi8(9)), _mm_set1_epi8(7));
+    return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')), letter);
+}
+
+/**********************************************************************
+* Function:     hex_encode_sse2
+* Description:  16 bytes per step, the rest by the scalar kernel
+* Parameters:   see hex_encode_scalar
+* Returns:      pointer after the last written character
+**********************************************************************/
+CPU_TARGET("sse2")
+static char *hex_encode_sse2(char *pOut, const uint8_t *pData, const uint8_t *pMask, size_t len)
+{
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i dots = _mm_set1_epi8(DOT);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i b = _mm_loadu_si128((const __m128i *) (pData + i));
+        __m128i m = _mm_loadu_si128((const __m128i *) (pMask + i));
+
+        __m128i hi = hex_digits_sse2(_mm_and_si128(_mm_srli_epi16(b, 4), nibble));
+        __m128i lo = hex_digits_sse2(_mm_and_si128(b, nibble));
+
+        // keep is all ones for the bytes written as hex
+        __m128i keep = _mm_cmpeq_epi8(m, zero);
+        __m128i keep0 = _mm_unpacklo_epi8(keep, keep);
+        __m128i keep1 = _mm_unpackhi_epi8(keep, keep);
+        __m128i out0 = _mm_unpacklo_epi8(hi, lo);
+        __m128i out1 = _mm_unpackhi_epi8(hi, lo);
+
+        out0 = _mm_or_si128(_mm_and_si128(keep0, out0), _mm_andnot_si128(keep0, dots));
+        out1 = _mm_or_si128(_mm_and_si128(keep1, out1), _mm_andnot_si128(keep1, dots));
+
+        _mm_storeu_si128((__m128i *) pOut, out0);
+        _mm_storeu_si128((__m128i *) (pOut + 16), out1);
+        pOut += 32;
+    }
+
+    return hex_encode_scalar(pOut, pData + i, pMask + i, len - i);
+}
+
+#ifdef CPU_AVX2
+
+/**********************************************************************
+* Function:     hex_encode_avx2
+* Description:  32 bytes per step, the rest by the SSE2 kernel
+* Parameters:   see hex_encode_scalar
+* Returns:      pointer after the last written character
+**********************************************************************/
+CPU_TARGET("avx2")
+static char *hex_encode_avx2(char *pOut, const uint8_t *pData, const uint8_t *pMask, size_t len)
+{
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i dots = _mm256_set1_epi8(DOT);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i table = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+                                           '8', '9', 'A', 'B', 'C', 'D', 'E', 'F',
+                                           '0', '1', '2', '3', '4', '5', '6', '7',
+                                           '8', '9', 'A', 'B', 'C', 'D', 'E', 'F');
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32)
+    {
+        // Unpacking works inside 128 bit lanes, so order the quadwords
+        // 0 2 1 3 first, then the low and high unpacks give bytes 0..15
+        // and 16..31 in order
+        __m256i b = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *) (pData + i)), 0xD8);
+        __m256i m = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *) (pMask + i)), 0xD8);
+
+        __m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(b, 4), nibble));
+        __m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(b, nibble));
+
+        __m256i keep = _mm256_cmpeq_epi8(m, zero);
+        __m256i out0 = _mm256_blendv_epi8(dots, _mm256_unpacklo_epi8(hi, lo),
+                                          _mm256_unpacklo_epi8(keep, keep));
+        __m256i out1 = _mm256_blendv_epi8(dots, _mm256_unpackhi_epi8(hi, lo),
+                                          _mm256_unpackhi_epi8(keep, keep));
+
+        _mm256_storeu_si256((__m256i *) pOut, out0);
+        _mm256_storeu_si256((__m256i *) (pOut + 32), out1);
+        pOut += 64;
+    }
+
+    return hex_encode_sse2(pOut, pData + i, pMask + i, len - i);
+}
+
+#endif  // CPU_AVX2
+
+#endif  // CPU_X86
+
+/**********************************************************************
+* Function:     hex_encoder_detect
+* Description:  finds the fastest kernel built in and supported by the CPU
+* Parameters:   none
+* Returns:      HEX_ENCODER
+**********************************************************************/
+HEX_ENCODER hex_encoder_detect(void)
+{
+#ifdef CPU_X86
+#ifdef CPU_AVX2
+    if (CpuHasAVX2())
+    {
+        return HEX_ENC_AVX2;
+    }
+#endif
+    if (CpuHasSSE2())
+    {
+        return HEX_ENC_SSE2;
+    }
+#endif
+    return HEX_ENC_SCALAR;
+}
+
+/**********************************************************************
+* Function:     hex_encoder_get
+* Description:  gets a kernel, for the benchmark and for testing them
+*               against each other
+* Parameters:   HEX_ENCODER id
+* Returns:      the kernel, NULL if not built in or not supported
+**********************************************************************/
+PFN_HEX_ENCODE hex_encoder_get(HEX_ENCODER id)
+{
+    if (id > hex_encoder_detect())
+    {
+        return NULL;
+    }
+
+    switch (id)
+    {
+    case HEX_ENC_SCALAR:
+        return hex_encode_scalar;
+#ifdef CPU_X86
+    case HEX_ENC_SSE2:
+        return hex_encode_sse2;
+#ifdef CPU_AVX2
+    case HEX_ENC_AVX2:
+        return hex_encode_avx2;
+#endif
+#endif
+    default:
+        return NULL;
+    }
+}
+
+const char *hex_encoder_name(HEX_ENCODER id)
+{
+    static const char *const NAMES[HEX_ENC_COUNT] = { "scalar", "sse2", "avx2" };
+    return ((unsigned int) id < HEX_ENC_COUNT) ? NAMES[id] : "?";
+}
+
+static PFN_HEX_ENCODE g_pfnHexEncode = NULL;
+
+/**********************************************************************
+* Function:     InitHexEncoder
+* Description:  selects the kernel used by hex_encode, must be called
+*               before worker threads use hex_encode
+* Parameters:   none
+* Returns:      the selected kernel
+**********************************************************************/
+HEX_ENCODER InitHexEncoder(void)
+{
+    HEX_ENCODER id = hex_encoder_detect();
+    g_pfnHexEncode = hex_encoder_get(id);
+    if (NULL == g_pfnHexEncode)
+    {
+        id = HEX_ENC_SCALAR;
+        g_pfnHexEncode = hex_encode_scalar;
+    }
+    return id;
+}
+
+/**********************************************************************
+* Function:     hex_encode
+* Description:  writes two hex digits for each byte, or ".." when the
+*               mask byte is not zero
+* Parameters:   char *pOut - receives 2 * len characters
+*               const uint8_t *pData - bytes
+*               const uint8_t *pMask - non zero for variable bytes
+*               size_t len
+* Returns:      pointer after the last written character
+**********************************************************************/
+char *hex_encode(char *pOut, const uint8_t *pData, const uint8_t *pMask, size_t len)
+{
+    _ASSERTE((NULL != pOut) && (NULL != pData) && (NULL != pMask));
+    _ASSERTE(NULL != g_pfnHexEncode);
+    return g_pfnHexEncode(pOut, pData, pMask, len);
+}
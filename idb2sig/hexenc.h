@@ -0,0 +1,47 @@
+#ifndef __IDB2SIG_HEXENC_H__
+#define __IDB2SIG_HEXENC_H__
+
+#pragma once
+
+/*
+ * Masked hex encoding of pattern line bytes.
+ * Every byte becomes two upper case hex digits, or ".." when its mask
+ * byte is not zero. SSE2 and AVX2 kernels are chosen at runtime by the
+ * CPU features, the scalar kernel is the fallback.
+ * Portable, does not call the IDA SDK.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _ASSERTE
+    #include <assert.h>
+    #define _ASSERTE(x) assert(x)
+#endif
+
+/* Encoder kernels, ordered by speed */
+enum HEX_ENCODER {
+    HEX_ENC_SCALAR = 0,
+    HEX_ENC_SSE2,
+    HEX_ENC_AVX2,
+    HEX_ENC_COUNT
+};
+
+/* Encode len bytes to 2 * len characters, returns the end of the output, not NULL terminated */
+typedef char *(*PFN_HEX_ENCODE)(char *pOut, const uint8_t *pData, const uint8_t *pMask, size_t len);
+
+/* Select the best kernel the CPU supports, call it before hex_encode */
+HEX_ENCODER InitHexEncoder(void);
+
+/* Encode with the kernel selected by InitHexEncoder */
+char *hex_encode(char *pOut, const uint8_t *pData, const uint8_t *pMask, size_t len);
+
+/* Best kernel the CPU supports */
+HEX_ENCODER hex_encoder_detect(void);
+
+/* Kernel by id, NULL if not built in or not supported by the CPU */
+PFN_HEX_ENCODE hex_encoder_get(HEX_ENCODER id);
+
+const char *hex_encoder_name(HEX_ENCODER id);
+
+#endif  // __IDB2SIG_HEXENC_H__
@@ -0,0 +1,337 @@
+/*************************************************************************
+    IDB2SIG pattern line cache
+    Renamed functions change only a few pattern lines, so a run reuses
+    the lines of all functions whose bytes, names and references did not
+    change since the previous run, and encodes only the others.
+
+    File layout, integers in little endian, addresses sizeof(sig_ea_t):
+        "IDB2SIGC", uint32 version, uint32 address size, uint32 entries
+        per entry: uint64 key, start, uint32 len, uint32 xrefs,
+            one location per xref (SIG_BADADDR if not found),
+            uint32 line length, line
+*************************************************************************/
+
+#include <string.h>
+#include <algorithm>
+
+#include "patcache.h"
+
+using namespace std;
+
+#define NO_NAME_MARK    0xFFu
+
+/**********************************************************************
+* Function:     func_sig_key
+* Description:  hashes the collected job: address, length, bytes, the
+*               publics and the references with their names
+* Parameters:   const SIG_BATCH &batch
+*               size_t index
+* Returns:      uint64_t key
+**********************************************************************/
+uint64_t func_sig_key(const SIG_BATCH &batch, size_t index)
+{
+    const FUNC_SIG_JOB &job = batch.jobs[index];
+    SIG_HASH hash;
+
+    hash.AddValue(job.startEA);
+    hash.AddValue(job.len);
+    hash.Add(batch.GetBytes(job), job.bytesLen);
+
+    hash.AddValue(job.numPublics);
+    for (size_t p = job.firstPublic; p < job.firstPublic + job.numPublics; p++)
+    {
+        const char *pName = batch.GetName(batch.publics[p].nameOff);
+        hash.AddValue(batch.publics[p].ea);
+        hash.Add(pName, strlen(pName));
+    }
+
+    hash.AddValue(job.numXrefs);
+    for (size_t x = job.firstXref; x < job.firstXref + job.numXrefs; x++)
+    {
+        const SIG_XREF &xref = batch.xrefs[x];
+        hash.AddValue(xref.item);
+        hash.AddValue(xref.itemEnd);
+        hash.AddValue(xref.target);
+        if (NO_SIG_NAME == xref.nameOff)
+        {
+            hash.AddValue(NO_NAME_MARK);
+        }
+        else
+        {
+            const char *pName = batch.GetName(xref.nameOff);
+            hash.Add(pName, strlen(pName));
+        }
+    }
+
+    return hash.Final();
+}
+
+static inline bool entry_less(const SIG_CACHE_ENTRY &a, const SIG_CACHE_ENTRY &b)
+{
+    return (a.key < b.key);
+}
+
+void SIG_PAT_CACHE::Clear()
+{
+    m_old.Clear();
+    m_new.Clear();
+    m_numReused = 0;
+    m_numEncoded = 0;
+}
+
+/* Read a value */
+template <class T>
+static inline bool get_value(PFN_SIG_READ pfnRead, void *ctx, T *pValue)
+{
+    return pfnRead(ctx, pValue, sizeof(*pValue));
+}
+
+/* Append a value to a record buffer */
+template <class T>
+static inline void put_value(vector<char> &buf, T value)
+{
+    const char *p = (const char *) &value;
+    buf.insert(buf.end(), p, p + sizeof(value));
+}
+
+/**********************************************************************
+* Function:     SIG_PAT_CACHE::Load
+* Description:  reads the cache file of the previous run. Every count
+*               read from the file is checked against the bytes left in
+*               it before anything is allocated, so a truncated or
+*               damaged file is rejected.
+* Parameters:   PFN_SIG_READ pfnRead
+*               void *ctx
+*               uint64_t size - size of the file
+* Returns:      false if the file is bad or of another version, the
+*               cache is then empty
+**********************************************************************/
+bool SIG_PAT_CACHE::Load(PFN_SIG_READ pfnRead, void *ctx, uint64_t size)
+{
+    const uint64_t headerSize = 8 + 3 * sizeof(uint32_t);
+    const uint64_t entrySize = sizeof(uint64_t) + sizeof(sig_ea_t) + 3 * sizeof(uint32_t);
+    char magic[8];
+    uint32_t version = 0, eaSize = 0, numEntries = 0;
+
+    Clear();
+    if ((size < headerSize) || (size > SIG_CACHE_MAX_SIZE) ||
+        !pfnRead(ctx, magic, sizeof(magic)) || (0 != memcmp(magic, SIG_CACHE_MAGIC, 8)) ||
+        !get_value(pfnRead, ctx, &version) || (SIG_CACHE_VERSION != version) ||
+        !get_value(pfnRead, ctx, &eaSize) || (sizeof(sig_ea_t) != eaSize) ||
+        !get_value(pfnRead, ctx, &numEntries) || (numEntries > (size - headerSize) / entrySize))
+    {
+        return false;
+    }
+
+    // Up to SIG_CACHE_MAX_SIZE, the sizes below do not overflow a size_t
+    size_t left = (size_t) (size - headerSize);
+    m_old.entries.reserve(numEntries);
+    for (uint32_t i = 0; i < numEntries; i++)
+    {
+        SIG_CACHE_ENTRY e;
+        uint32_t numLocs, lineLen;
+        if ((left < entrySize) ||
+            !get_value(pfnRead, ctx, &e.key) || !get_value(pfnRead, ctx, &e.startEA) ||
+            !get_value(pfnRead, ctx, &e.len) || !get_value(pfnRead, ctx, &numLocs) ||
+            (numLocs > (left - entrySize) / sizeof(sig_ea_t)))
+        {
+            Clear();
+            return false;
+        }
+        left -= (size_t) entrySize + numLocs * sizeof(sig_ea_t);
+
+        e.locOff = m_old.locs.size();
+        e.numLocs = numLocs;
+        m_old.locs.resize(e.locOff + numLocs);
+        if (((numLocs > 0) && !pfnRead(ctx, &m_old.locs[e.locOff], numLocs * sizeof(sig_ea_t))) ||
+            !get_value(pfnRead, ctx, &lineLen) || (lineLen > left))
+        {
+            Clear();
+            return false;
+        }
+        left -= lineLen;
+
+        e.lineOff = m_old.lines.size();
+        e.lineLen = lineLen;
+        m_old.lines.resize(e.lineOff + lineLen);
+        if ((lineLen > 0) && !pfnRead(ctx, &m_old.lines[e.lineOff], lineLen))
+        {
+            Clear();
+            return false;
+        }
+
+        m_old.entries.push_back(e);
+    }
+
+    if (0 != left)
+    {
+        // Not the file that was saved
+        Clear();
+        return false;
+    }
+
+    sort(m_old.entries.begin(), m_old.entries.end(), entry_less);
+    return true;
+}
+
+/**********************************************************************
+* Function:     SIG_PAT_CACHE::Save
+* Description:  writes the entries of the current run
+* Parameters:   PFN_SIG_WRITE pfnWrite
+*               void *ctx
+* Returns:      false if writing failed
+**********************************************************************/
+bool SIG_PAT_CACHE::Save(PFN_SIG_WRITE pfnWrite, void *ctx) const
+{
+    const size_t blockSize = 0x10000;
+    vector<char> buf(SIG_CACHE_MAGIC, SIG_CACHE_MAGIC + 8);
+
+    put_value(buf, (uint32_t) SIG_CACHE_VERSION);
+    put_value(buf, (uint32_t) sizeof(sig_ea_t));
+    put_value(buf, (uint32_t) m_new.entries.size());
+
+    for (vector<SIG_CACHE_ENTRY>::const_iterator e = m_new.entries.begin();
+         e != m_new.entries.end(); e++)
+    {
+        put_value(buf, e->key);
+        put_value(buf, e->startEA);
+        put_value(buf, e->len);
+        put_value(buf, (uint32_t) e->numLocs);
+        if (e->numLocs > 0)
+        {
+            const char *p = (const char *) &m_new.locs[e->locOff];
+            buf.insert(buf.end(), p, p + e->numLocs * sizeof(sig_ea_t));
+        }
+        put_value(buf, (uint32_t) e->lineLen);
+        if (e->lineLen > 0)
+        {
+            const char *p = &m_new.lines[e->lineOff];
+            buf.insert(buf.end(), p, p + e->lineLen);
+        }
+
+        if (buf.size() >= blockSize)
+        {
+            if (!pfnWrite(ctx, &buf[0], buf.size()))
+            {
+                return false;
+            }
+            buf.clear();
+        }
+    }
+
+    return buf.empty() || pfnWrite(ctx, &buf[0], buf.size());
+}
+
+const SIG_CACHE_ENTRY *SIG_PAT_CACHE::Find(uint64_t key, sig_ea_t startEA, uint32_t len) const
+{
+    SIG_CACHE_ENTRY value;
+    value.key = key;
+
+    vector<SIG_CACHE_ENTRY>::const_iterator e =
+        lower_bound(m_old.entries.begin(), m_old.entries.end(), value, entry_less);
+    for (; (e != m_old.entries.end()) && (e->key == key); e++)
+    {
+        if ((e->startEA == startEA) && (e->len == len))
+        {
+            return &*e;
+        }
+    }
+
+    return NULL;
+}
+
+/* Worker job, hashes a group of SIG_CRC_GROUP jobs */
+static void hash_func_sigs_proc(void *ctx, size_t group)
+{
+    SIG_BATCH &batch = *(SIG_BATCH *) ctx;
+
+    size_t first = group * SIG_CRC_GROUP;
+    size_t last = min(first + SIG_CRC_GROUP, batch.GetCount());
+    for (size_t i = first; i < last; i++)
+    {
+        batch.jobs[i].key = func_sig_key(batch, i);
+    }
+}
+
+/**********************************************************************
+* Function:     SIG_PAT_CACHE::Lookup
+* Description:  computes the keys of the batch on the worker threads,
+*               then gives the jobs found in the cache their line and
+*               their reference locations, so they are not encoded
+* Parameters:   SIG_BATCH &batch
+*               WORKER_POOL &workers
+* Returns:      none
+**********************************************************************/
+void SIG_PAT_CACHE::Lookup(SIG_BATCH &batch, WORKER_POOL &workers)
+{
+    // The lines stay in the scratch for Update
+    batch.bKeepLines = true;
+    workers.Run(batch.GetGroupCount(), hash_func_sigs_proc, &batch);
+
+    if (m_old.entries.empty())
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < batch.GetCount(); i++)
+    {
+        FUNC_SIG_JOB &job = batch.jobs[i];
+        const SIG_CACHE_ENTRY *e = Find(job.key, job.startEA, job.len);
+        if ((NULL == e) || (e->numLocs != job.numXrefs))
+        {
+            continue;
+        }
+
+        job.pCachedLine = m_old.lines.empty() ? "" : &m_old.lines[e->lineOff];
+        job.cachedLen = e->lineLen;
+        for (size_t x = 0; x < job.numXrefs; x++)
+        {
+            batch.xrefs[job.firstXref + x].loc = m_old.locs[e->locOff + x];
+        }
+    }
+}
+
+/**********************************************************************
+* Function:     SIG_PAT_CACHE::Update
+* Description:  adds all jobs of an encoded batch to the current run
+* Parameters:   const SIG_BATCH &batch - encoded after Lookup
+* Returns:      none
+**********************************************************************/
+void SIG_PAT_CACHE::Update(const SIG_BATCH &batch)
+{
+    _ASSERTE(batch.bKeepLines);
+
+    for (size_t i = 0; i < batch.GetCount(); i++)
+    {
+        const FUNC_SIG_JOB &job = batch.jobs[i];
+        const char *pLine = batch.GetLine(i);
+
+        SIG_CACHE_ENTRY e;
+        e.key = job.key;
+        e.startEA = job.startEA;
+        e.len = job.len;
+        e.lineOff = m_new.lines.size();
+        e.lineLen = (NULL != job.pCachedLine) ? job.cachedLen : job.lineLen;
+        e.locOff = m_new.locs.size();
+        e.numLocs = job.numXrefs;
+
+        if (e.lineLen > 0)
+        {
+            m_new.lines.insert(m_new.lines.end(), pLine, pLine + e.lineLen);
+        }
+        for (size_t x = job.firstXref; x < job.firstXref + job.numXrefs; x++)
+        {
+            m_new.locs.push_back(batch.xrefs[x].loc);
+        }
+        m_new.entries.push_back(e);
+
+        if (NULL != job.pCachedLine)
+        {
+            m_numReused++;
+        }
+        else
+        {
+            m_numEncoded++;
+        }
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef __IDB2SIG_PATCACHE_H__
+#define __IDB2SIG_PATCACHE_H__
+
+#pragma once
+
+/*
+ * Pattern line cache.
+ * Keeps the pattern line of every function of the last run, keyed by a
+ * hash of its bytes, names and references, in a side file next to the
+ * PAT file. Functions whose key did not change reuse their line and are
+ * not encoded again.
+ * Portable, does not call the IDA SDK.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "patgen.h"
+#include "patout.h"
+#include "threads.h"
+
+#define SIG_CACHE_MAGIC     "IDB2SIGC"
+#define SIG_CACHE_VERSION   1           // change when the pattern lines change
+#define SIG_CACHE_MAX_SIZE  ((uint64_t) ((size_t) -1 / 4))  // larger files are not loaded
+
+/* The line of one function, in SIG_PAT_CACHE */
+typedef struct tagSIG_CACHE_ENTRY {
+    uint64_t key;           // func_sig_key of the function
+    sig_ea_t startEA;       // checked together with the key
+    uint32_t len;
+    size_t lineOff;         // pattern line with CRLF, in SIG_PAT_CACHE::lines
+    size_t lineLen;
+    size_t locOff;          // reference locations, one per xref, in SIG_PAT_CACHE::locs
+    size_t numLocs;
+} SIG_CACHE_ENTRY;
+
+/* The entries of one run */
+struct SIG_CACHE_SET
+{
+    std::vector<SIG_CACHE_ENTRY> entries;
+    std::vector<char> lines;
+    std::vector<sig_ea_t> locs;
+
+    void Clear()
+    {
+        entries.clear();
+        lines.clear();
+        locs.clear();
+    }
+};
+
+/*
+ * Loaded from the previous run, the lines of the current run are added
+ * to a new set, which is saved at the end. Functions not seen in the
+ * current run drop out of the cache.
+ */
+struct SIG_PAT_CACHE
+{
+    SIG_PAT_CACHE() : m_numReused(0), m_numEncoded(0)
+    {
+    }
+
+    void Clear();
+
+    /* Load the entries of the previous run from a file of size bytes,
+       false if the file is bad */
+    bool Load(PFN_SIG_READ pfnRead, void *ctx, uint64_t size);
+
+    /* Save the entries of the current run */
+    bool Save(PFN_SIG_WRITE pfnWrite, void *ctx) const;
+
+    /* Hash all jobs of the batch and give them their cached lines */
+    void Lookup(SIG_BATCH &batch, WORKER_POOL &workers);
+
+    /* Add the lines of an encoded batch to the current run */
+    void Update(const SIG_BATCH &batch);
+
+    size_t GetReusedCount() const
+    {
+        return m_numReused;
+    }
+
+    size_t GetEncodedCount() const
+    {
+        return m_numEncoded;
+    }
+
+private:
+    const SIG_CACHE_ENTRY *Find(uint64_t key, sig_ea_t startEA, uint32_t len) const;
+
+    SIG_CACHE_SET m_old;    // sorted by key
+    SIG_CACHE_SET m_new;    // in run order
+    size_t m_numReused;
+    size_t m_numEncoded;
+};
+
+/* Hash of everything the pattern line of a collected job depends on */
+uint64_t func_sig_key(const SIG_BATCH &batch, size_t index);
+
+#endif  // __IDB2SIG_PATCACHE_H__
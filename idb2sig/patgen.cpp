@@ -0,0 +1,571 @@
+/*************************************************************************
+    IDB2SIG pattern generation engine
+    make_func_sig moved out of idb2sig.cpp, it now works on functions
+    collected from the database beforehand, so many functions can be
+    encoded at the same time on worker threads.
+*************************************************************************/
+
+#include <string.h>
+#include <algorithm>
+
+#include "patgen.h"
+#include "patindex.h"
+#include "crc16.h"
+#include "hexenc.h"
+
+using namespace std;
+
+#define DOT             0x2E
+#define SPACE           0x20
+
+volatile long g_sigAllocCount = 0;
+
+/**********************************************************************
+* Function:     Num2HexStr
+* Description:  Convert a number to a hex string
+* Parameters:   pBuf: Pointer to buffer to store the result hex string.
+*               The caller must ensure buffer have enough space to store
+*               len of hex characters and a NULL character.
+*               len: number of hex character required. The buffer will be
+*               add 0 to the left to ensure have have len hex characters
+*               num: number will be converted
+* Returns:      The pointer to the next last written character to pBuf
+**********************************************************************/
+static inline char* Num2HexStr(char *pBuf, uint32_t len, uint32_t num)
+{
+    static const char HEXSTR[] = "0123456789ABCDEF";
+
+    _ASSERTE(pBuf != NULL);
+
+    char *p = pBuf + len;
+    *p-- = '\0';
+    while (p >= pBuf)
+    {
+        int digit = num & 0x0F;
+        num >>= 4;
+        *p-- = HEXSTR[digit];
+    }
+
+    return (pBuf + len);
+}
+
+/**********************************************************************
+* Function:     set_v_bytes
+* Description:  marks off a string of bytes as variable
+* Parameters:   uint8_t *pMask
+*               uint32_t size
+*               uint32_t pos
+*               uint32_t len
+* Returns:      none
+**********************************************************************/
+static inline void set_v_bytes(uint8_t *pMask, uint32_t size, uint32_t pos, uint32_t len)
+{
+    _ASSERTE(pos + len <= size);
+    if (pos + len <= size)
+    {
+        memset(pMask + pos, 1, len);
+    }
+}
+
+/* Orders references by location, then by xref index */
+static inline bool ref_less(const SIG_REF &a, const SIG_REF &b)
+{
+    return (a.loc < b.loc) || ((a.loc == b.loc) && (a.xref < b.xref));
+}
+
+/**********************************************************************
+* Function:     sort_refs
+* Description:  sorts the references found for a job by location. When
+*               several xrefs were found at the same location, the last
+*               one is kept, like the reference map used to do.
+* Parameters:   sig_ref_vec &refs
+*               size_t first - first reference of the job, the job
+*               references are at the end of refs
+* Returns:      none
+**********************************************************************/
+static void sort_refs(sig_ref_vec &refs, size_t first)
+{
+    size_t count = refs.size();
+    if (count - first < 2)
+    {
+        return;
+    }
+
+    // Usually a few references, found in increasing order
+    bool bSorted = true;
+    for (size_t i = first + 1; bSorted && (i < count); i++)
+    {
+        bSorted = ref_less(refs[i - 1], refs[i]);
+    }
+    if (!bSorted)
+    {
+        sort(refs.begin() + first, refs.end(), ref_less);
+    }
+
+    size_t n = first;
+    for (size_t i = first; i < count; i++)
+    {
+        if ((i + 1 < count) && (refs[i + 1].loc == refs[i].loc))
+        {
+            continue;
+        }
+        refs[n++] = refs[i];
+    }
+    refs.resize(n);
+}
+
+/**********************************************************************
+* Function:     max_func_sig_len
+* Description:  upper bound of the pattern line length of a job
+* Parameters:   const FUNC_SIG_JOB &job
+* Returns:      size_t
+**********************************************************************/
+size_t max_func_sig_len(const FUNC_SIG_JOB &job)
+{
+    if (NULL != job.pCachedLine)
+    {
+        return job.cachedLen;
+    }
+
+    // 64 prefix chars, " XX XXXX XXXX", per name " :-XXXX ",
+    // " " and 2 chars per remaining byte, CRLF and a NULL
+    return 64 + 14 + (job.numPublics + job.numXrefs) * 8 + job.namesLen +
+           1 + 2 * (size_t) job.len + 3;
+}
+
+/**********************************************************************
+* Function:     prepare_func_sig
+* Description:  finds the references of a job, marks their bytes as
+*               variable and measures the crc data. The crc itself is
+*               computed by prepare_func_sigs for a group of jobs at once.
+* Parameters:   SIG_BATCH &batch
+*               FUNC_SIG_JOB &job
+*               SIG_SCRATCH &scratch - the group working set, the mask
+*               must already have room for the job
+* Returns:      false if the job has not enough bytes
+**********************************************************************/
+static bool prepare_func_sig(SIG_BATCH &batch, FUNC_SIG_JOB &job, SIG_SCRATCH &scratch)
+{
+    sig_ea_t start_ea = job.startEA;
+    uint32_t len = job.len;
+
+    job.firstRef = scratch.refs.size();
+    job.numRefs = 0;
+    job.alen = 0;
+    job.crc = 0;
+
+    _ASSERTE(start_ea != SIG_BADADDR);
+    _ASSERTE(job.bytesLen >= len);
+    if ((SIG_BADADDR == start_ea) || (job.bytesLen < len))
+    {
+        return false;
+    }
+
+    const uint8_t *pBytes = batch.GetBytes(job);
+    uint8_t *pMask = &scratch.mask[job.maskOff];
+
+    // The references of an item are next to each other, they are
+    // searched in one scan of the item bytes
+    size_t lastXref = job.firstXref + job.numXrefs;
+    for (size_t x = job.firstXref; x < lastXref; )
+    {
+        sig_ea_t targets[REF_SCAN_MAX];
+        sig_ea_t locs[REF_SCAN_MAX];
+        uint32_t lens[REF_SCAN_MAX];
+        const SIG_XREF &first = batch.xrefs[x];
+
+        size_t n = 0;
+        while ((x + n < lastXref) && (n < REF_SCAN_MAX) &&
+               (batch.xrefs[x + n].item == first.item) &&
+               (batch.xrefs[x + n].itemEnd == first.itemEnd))
+        {
+            targets[n] = batch.xrefs[x + n].target;
+            n++;
+        }
+
+        find_ref_locs(pBytes, job.bytesLen, start_ea, first.item, first.itemEnd,
+                      targets, n, locs, lens);
+
+        for (size_t i = 0; i < n; i++, x++)
+        {
+            SIG_XREF &xref = batch.xrefs[x];
+            xref.loc = locs[i];
+            if (SIG_BADADDR != xref.loc)
+            {
+                set_v_bytes(pMask, len, (uint32_t)(xref.loc - start_ea), lens[i]);
+                SIG_REF ref = { xref.loc, x };
+                scratch.refs.push_back(ref);
+            }
+        }
+    }
+    sort_refs(scratch.refs, job.firstRef);
+    job.numRefs = scratch.refs.size() - job.firstRef;
+
+    // the crc data starts after the first 32 bytes and stops at the first
+    // variable byte, the end of the function or after 255 bytes
+    uint32_t pos = 32;
+    while ((pos < len) && !pMask[pos] && (pos < 255 + 32))
+    {
+        pos++;
+    }
+
+    // alen is length of the crc data
+    job.alen = (len > 32) ? pos - 32 : 0;
+    return true;
+}
+
+/**********************************************************************
+* Function:     prepare_func_sigs
+* Description:  prepares a group of SIG_CRC_GROUP jobs for write_func_sig,
+*               their crc blocks go through crc16_multi together
+* Parameters:   SIG_BATCH &batch
+*               size_t group
+* Returns:      none
+**********************************************************************/
+void prepare_func_sigs(SIG_BATCH &batch, size_t group)
+{
+    static const uint8_t NO_CRC_DATA = 0;
+    const uint8_t *crcData[SIG_CRC_GROUP];
+    uint16_t crcLen[SIG_CRC_GROUP];
+    uint16_t crc[SIG_CRC_GROUP];
+
+    size_t first = group * SIG_CRC_GROUP;
+    _ASSERTE(first < batch.GetCount());
+    size_t n = batch.GetCount() - first;
+    if (n > SIG_CRC_GROUP)
+    {
+        n = SIG_CRC_GROUP;
+    }
+
+    SIG_SCRATCH &scratch = batch.groups[group];
+    FUNC_SIG_JOB *pJobs = &batch.jobs[first];
+
+    size_t maskSize = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        pJobs[i].maskOff = maskSize;
+        if (NULL == pJobs[i].pCachedLine)
+        {
+            maskSize += pJobs[i].len;
+        }
+    }
+    scratch.mask.assign(maskSize + 1, 0);
+    scratch.refs.clear();
+
+    for (size_t i = 0; i < n; i++)
+    {
+        FUNC_SIG_JOB &job = pJobs[i];
+        if ((NULL == job.pCachedLine) && prepare_func_sig(batch, job, scratch) &&
+            (job.alen > 0))
+        {
+            crcData[i] = batch.GetBytes(job) + 32;
+            crcLen[i] = (uint16_t) job.alen;
+        }
+        else
+        {
+            crcData[i] = &NO_CRC_DATA;
+            crcLen[i] = 0;
+        }
+    }
+
+    crc16_multi(crcData, crcLen, crc, n);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        pJobs[i].crc = crc[i];
+    }
+}
+
+/**********************************************************************
+* Function:     write_func_sig
+* Description:
+*       this is what does the real work
+*       given a prepared job, it writes a pattern line to the buffer
+*       the buffer must hold at least max_func_sig_len characters
+* Parameters:   const SIG_BATCH &batch
+*               size_t index - job index in the batch
+*               char *pSigBuf
+* Returns:      length of the pattern line
+**********************************************************************/
+size_t write_func_sig(const SIG_BATCH &batch, size_t index, char *pSigBuf)
+{
+    const FUNC_SIG_JOB &job = batch.jobs[index];
+    const SIG_SCRATCH &scratch = batch.GetScratch(index);
+    sig_ea_t start_ea = job.startEA;
+    uint32_t len = job.len;
+
+    uint32_t first_string = 0;
+    uint32_t i = 0;
+    const char *pName = NULL;
+
+    // A line from the pattern cache is copied as is
+    if (NULL != job.pCachedLine)
+    {
+        memcpy(pSigBuf, job.pCachedLine, job.cachedLen);
+        return job.cachedLen;
+    }
+
+    if ((SIG_BADADDR == start_ea) || (job.bytesLen < len))
+    {
+        return 0;
+    }
+
+    const uint8_t *pBytes = batch.GetBytes(job);
+    const uint8_t *pMask = &scratch.mask[job.maskOff];
+
+    char *pc = pSigBuf;     // The increment pointer
+
+    // write out the first string of bytes, making sure not to go past
+    // the end of the function
+    first_string = (len < 32 ? len : 32);
+    if (first_string > 0)
+    {
+        pc = hex_encode(pc, pBytes, pMask, first_string);
+    }
+
+    // fill in anything less than 32
+    for (i = 0; i < 32 - first_string; i++)
+    {
+        *pc++ = DOT;
+        *pc++ = DOT;
+    }
+
+    // Format alen, crc and len to " %02X %04X %04X" format
+    *pc++ = SPACE;
+    pc = Num2HexStr(pc, 2, job.alen);
+    *pc++ = SPACE;
+    pc = Num2HexStr(pc, 4, job.crc);
+    *pc++ = SPACE;
+    pc = Num2HexStr(pc, 4, len);
+
+    // write the publics
+    for (size_t p = job.firstPublic; p < job.firstPublic + job.numPublics; p++)
+    {
+        const SIG_PUBLIC &pub = batch.publics[p];
+        pName = batch.GetName(pub.nameOff);
+
+        // Format pSigBuf with " :%04X " or " :-%04X " format
+        // Check for negative offset and adjust output
+        *pc++ = SPACE;
+        *pc++ = ':';
+        if (pub.ea >= start_ea)
+        {
+            pc = Num2HexStr(pc, 4, (uint32_t)(pub.ea - start_ea));
+            *pc++ = SPACE;
+        }
+        else
+        {
+            *pc++ = '-';
+            pc = Num2HexStr(pc, 4, (uint32_t)(start_ea - pub.ea));
+            *pc ++ = SPACE;
+        }
+
+        while (*pName != '\0')
+        {
+            *pc++= *pName++;
+        }
+    }
+
+    // write the references
+    for (size_t r = job.firstRef; r < job.firstRef + job.numRefs; r++)
+    {
+        const SIG_REF &ref = scratch.refs[r];
+        const SIG_XREF &xref = batch.xrefs[ref.xref];
+
+        // The collector only named the targets with a user-specified name,
+        // or any name when all functions mode specified
+        if (NO_SIG_NAME != xref.nameOff)
+        {
+            pName = batch.GetName(xref.nameOff);
+
+            // Format pSigBuf with " ^%04X " or " ^-%04X " format
+            // Check for negative offset and adjust output
+            *pc++ = SPACE;
+            *pc++ = '^';
+            if (ref.loc >= start_ea)
+            {
+                pc = Num2HexStr(pc, 4, (uint32_t)(ref.loc - start_ea));
+                *pc++ = SPACE;
+            }
+            else
+            {
+                *pc++ = '-';
+                pc = Num2HexStr(pc, 4, (uint32_t)(start_ea - ref.loc));
+                *pc++ = SPACE;
+            }
+
+            while (*pName != '\0')
+            {
+                *pc++= *pName++;
+            }
+        }
+    }
+
+    // and finally write out the last string with the rest of the function
+    *pc++ = SPACE;
+    i = 32 + job.alen;
+    if (i < len)
+    {
+        pc = hex_encode(pc, pBytes + i, pMask + i, len - i);
+    }
+
+    *pc++ = '\r';
+    *pc++ = '\n';
+
+    return (size_t) (pc - pSigBuf);
+}
+
+/* Keys the line of a job when the batch skips the duplicate lines */
+static inline void set_func_sig_key(const SIG_BATCH &batch, FUNC_SIG_JOB &job, const char *pLine,
+                                    size_t lineLen)
+{
+    if ((NULL != batch.pLines) && !get_pat_line_key(pLine, lineLen, job.lineKey))
+    {
+        job.lineKey.key = 0;
+    }
+}
+
+/**********************************************************************
+* Function:     make_func_sigs
+* Description:  prepares a group of SIG_CRC_GROUP jobs and writes their
+*               pattern lines to the lines of the group scratch, with
+*               their keys when the batch skips the duplicate lines
+* Parameters:   SIG_BATCH &batch
+*               size_t group
+* Returns:      none
+**********************************************************************/
+void make_func_sigs(SIG_BATCH &batch, size_t group)
+{
+    prepare_func_sigs(batch, group);
+
+    size_t first = group * SIG_CRC_GROUP;
+    size_t last = first + SIG_CRC_GROUP;
+    if (last > batch.GetCount())
+    {
+        last = batch.GetCount();
+    }
+
+    SIG_SCRATCH &scratch = batch.groups[group];
+    size_t maxLen = 0;
+    for (size_t i = first; i < last; i++)
+    {
+        maxLen += max_func_sig_len(batch.jobs[i]);
+    }
+    if (scratch.lines.size() < maxLen)
+    {
+        scratch.lines.resize(maxLen);
+    }
+
+    size_t used = 0;
+    for (size_t i = first; i < last; i++)
+    {
+        FUNC_SIG_JOB &job = batch.jobs[i];
+        job.lineOff = used;
+        job.lineLen = write_func_sig(batch, i, &scratch.lines[used]);
+        set_func_sig_key(batch, job, &scratch.lines[used], job.lineLen);
+        used += job.lineLen;
+    }
+}
+
+/**********************************************************************
+* Function:     add_func_sig_line
+* Description:  adds the line of a job to the lines written before, and
+*               records it when it collides with one of them
+* Parameters:   SIG_BATCH &batch
+*               size_t index
+* Returns:      false if the same line was written before
+**********************************************************************/
+static bool add_func_sig_line(SIG_BATCH &batch, size_t index)
+{
+    const FUNC_SIG_JOB &job = batch.jobs[index];
+    if ((NULL == batch.pLines) || (0 == job.lineKey.key))
+    {
+        return true;
+    }
+
+    SIG_COLLISION collision;
+    collision.job = index;
+    switch (batch.pLines->AddKey(job.lineKey, job.startEA, &collision.otherEA))
+    {
+        case PAT_LINE_DUPLICATE:
+            return false;
+
+        case PAT_LINE_COLLISION:
+            batch.collisions.push_back(collision);
+            return true;
+
+        default:
+            return true;
+    }
+}
+
+/* Worker thread job procedure, encodes one group of a batch */
+static void encode_func_sig_proc(void *ctx, size_t index)
+{
+    make_func_sigs(*(SIG_BATCH *) ctx, index);
+}
+
+/**********************************************************************
+* Function:     encode_func_sigs
+* Description:
+*       encodes all functions of the batch on the worker threads, one
+*       group of SIG_CRC_GROUP functions per job, then appends their
+*       pattern lines to the output in collection order.
+*       Without worker threads, the batch is prepared at once and the
+*       lines are encoded straight into the output chunk, unless the
+*       batch keeps its lines.
+*       When the batch has the lines written before, their keys are
+*       hashed on the worker threads and looked up here in collection
+*       order, the first of the same lines is written whatever the
+*       number of threads.
+* Parameters:   SIG_BATCH &batch
+*               WORKER_POOL &workers
+*               SIG_WRITER &writer
+* Returns:      false if out of memory or writing failed
+**********************************************************************/
+bool encode_func_sigs(SIG_BATCH &batch, WORKER_POOL &workers, SIG_WRITER &writer)
+{
+    bool bDirect = (workers.GetThreadCount() <= 1) && !batch.bKeepLines;
+    size_t numGroups = batch.GetGroupCount();
+
+    if (0 == batch.GetCount())
+    {
+        return true;
+    }
+
+    if (!bDirect)
+    {
+        workers.Run(numGroups, encode_func_sig_proc, &batch);
+    }
+    else
+    {
+        for (size_t g = 0; g < numGroups; g++)
+        {
+            prepare_func_sigs(batch, g);
+        }
+    }
+
+    for (size_t i = 0; i < batch.GetCount(); i++)
+    {
+        const FUNC_SIG_JOB &job = batch.jobs[i];
+
+        if (bDirect)
+        {
+            char *pSigBuf = writer.Reserve(max_func_sig_len(job));
+            if (NULL == pSigBuf)
+            {
+                return false;
+            }
+            size_t lineLen = write_func_sig(batch, i, pSigBuf);
+            set_func_sig_key(batch, batch.jobs[i], pSigBuf, lineLen);
+            writer.Commit(add_func_sig_line(batch, i) ? lineLen : 0);
+        }
+        else if ((job.lineLen > 0) && add_func_sig_line(batch, i) &&
+                 !writer.Append(&batch.GetScratch(i).lines[job.lineOff], job.lineLen))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,354 @@
+#ifndef __IDB2SIG_PATGEN_H__
+#define __IDB2SIG_PATGEN_H__
+
+#pragma once
+
+/*
+ * Pattern line generation engine.
+ * Everything here works on data collected from the database beforehand,
+ * so it does not call the IDA SDK, may run on worker threads and builds
+ * on Linux without IDA.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "threads.h"
+#include "refscan.h"
+#include "patout.h"
+
+#ifndef _ASSERTE
+    #include <assert.h>
+    #define _ASSERTE(x) assert(x)
+#endif
+
+/* A public name inside the function, emitted as " :XXXX name" */
+typedef struct tagSIG_PUBLIC {
+    sig_ea_t ea;            // address of the name
+    size_t nameOff;         // offset of the name in SIG_BATCH::names
+    bool bUserName;         // a user-specified name, kept in all modes
+} SIG_PUBLIC;
+
+/* A data or code reference made by an item of the function */
+typedef struct tagSIG_XREF {
+    sig_ea_t item;          // address of the referencing item
+    sig_ea_t itemEnd;       // end address of the referencing item
+    sig_ea_t target;        // referenced address
+    size_t nameOff;         // offset of the target name in names, NO_SIG_NAME if not emitted
+    bool bUserName;         // the target has a user-specified name
+    sig_ea_t loc;           // out: location of the reference, SIG_BADADDR if not found
+} SIG_XREF;
+
+#define NO_SIG_NAME     ((size_t) -1)
+
+/* Function flags, the plugin modes select functions by them */
+#define SIG_FUNC_LIB        0x01    // library function
+#define SIG_FUNC_NAMED      0x02    // the start has a non dummy name
+#define SIG_FUNC_PUBLIC     0x04    // the start has a public name
+
+#define SIG_CRC_GROUP   64      // jobs whose crc blocks are computed together
+#define SIG_BATCH_SIZE  4096    // functions collected before encoding them in parallel
+
+/* A found reference, the references of a job are sorted by location */
+typedef struct tagSIG_REF {
+    sig_ea_t loc;           // location of the reference
+    size_t xref;            // index in SIG_BATCH::xrefs
+} SIG_REF;
+
+#define SIG_HASH_SEED   0x6A09E667F3BCC908ULL
+#define SIG_HASH_MUL    0x9E3779B97F4A7C15ULL
+
+/* 64 bit hash, one multiply per 8 bytes */
+struct SIG_HASH
+{
+    uint64_t h;
+
+    SIG_HASH() : h(SIG_HASH_SEED)
+    {
+    }
+
+    void AddWord(uint64_t w)
+    {
+        h = (h ^ w) * SIG_HASH_MUL;
+        h ^= h >> 29;
+    }
+
+    void Add(const void *pData, size_t len)
+    {
+        const uint8_t *p = (const uint8_t *) pData;
+        uint64_t w;
+
+        AddWord(len);
+        for (; len >= 8; p += 8, len -= 8)
+        {
+            memcpy(&w, p, 8);
+            AddWord(w);
+        }
+        if (len > 0)
+        {
+            w = 0;
+            memcpy(&w, p, len);
+            AddWord(w);
+        }
+    }
+
+    template <class T>
+    void AddValue(T value)
+    {
+        AddWord((uint64_t) value);
+    }
+
+    uint64_t Final() const
+    {
+        // fmix64 of MurmurHash3
+        uint64_t k = h;
+        k ^= k >> 33;
+        k *= 0xFF51AFD7ED558CCDULL;
+        k ^= k >> 33;
+        k *= 0xC4CEB9FE1A85EC53ULL;
+        k ^= k >> 33;
+        return k;
+    }
+};
+
+/* Number of heap allocations made by the SIG_BATCH containers. The
+   SIG_PAT_CACHE sets are not counted, they grow with the whole run. */
+extern volatile long g_sigAllocCount;
+
+/* Allocator of the SIG_BATCH containers, counts the allocations */
+template <class T>
+struct SIG_ALLOCATOR : public std::allocator<T>
+{
+    typedef typename std::allocator<T>::pointer pointer;
+    typedef typename std::allocator<T>::size_type size_type;
+
+    template <class U>
+    struct rebind
+    {
+        typedef SIG_ALLOCATOR<U> other;
+    };
+
+    SIG_ALLOCATOR() {}
+    SIG_ALLOCATOR(const SIG_ALLOCATOR &a) : std::allocator<T>(a) {}
+    template <class U>
+    SIG_ALLOCATOR(const SIG_ALLOCATOR<U> &a) : std::allocator<T>(a) {}
+
+    pointer allocate(size_type n, const void * = 0)
+    {
+        (void) AtomicIncrement(&g_sigAllocCount);
+        return std::allocator<T>::allocate(n);
+    }
+};
+
+typedef std::vector<uint8_t, SIG_ALLOCATOR<uint8_t> > sig_byte_vec;
+typedef std::vector<char, SIG_ALLOCATOR<char> > sig_char_vec;
+typedef std::vector<SIG_PUBLIC, SIG_ALLOCATOR<SIG_PUBLIC> > sig_public_vec;
+typedef std::vector<SIG_XREF, SIG_ALLOCATOR<SIG_XREF> > sig_xref_vec;
+typedef std::vector<SIG_REF, SIG_ALLOCATOR<SIG_REF> > sig_ref_vec;
+typedef std::basic_string<char, std::char_traits<char>, SIG_ALLOCATOR<char> > sig_string;
+
+/* The identity of a pattern line, see get_pat_line_key */
+typedef struct tagPAT_LINE_KEY {
+    uint64_t key;           // hash of the prefix, alen, crc and len, 0: not a pattern line
+    uint64_t names;         // hash of the public names with their offsets
+} PAT_LINE_KEY;
+
+/*
+ * One function of a SIG_BATCH. Its bytes, publics, xrefs and names are
+ * stored in the batch arenas, its working set in the SIG_SCRATCH of its
+ * group, so the jobs themselves do not own any memory.
+ */
+struct FUNC_SIG_JOB
+{
+    sig_ea_t startEA;               // function start address
+    uint32_t len;                   // function length
+    uint8_t funcFlags;              // SIG_FUNC_*
+    const uint8_t *pExtBytes;       // bytes from startEA in a SIG_SNAPSHOT, or NULL
+    size_t bytesOff;                // else bytes from startEA in SIG_BATCH::bytes
+    size_t bytesLen;                // at least len and up to the last item end
+    size_t firstPublic, numPublics; // in SIG_BATCH::publics
+    size_t firstXref, numXrefs;     // in SIG_BATCH::xrefs
+    size_t namesLen;                // length of all names added for the job
+
+    uint64_t key;                   // hash of all the above, see func_sig_key
+    const char *pCachedLine;        // pattern line with CRLF from a SIG_PAT_CACHE,
+    size_t cachedLen;               // NULL if the job must be encoded
+
+    size_t maskOff;                 // work: 1 for variable bytes, in SIG_SCRATCH::mask
+    size_t firstRef, numRefs;       // work: found references, in SIG_SCRATCH::refs
+    uint32_t alen;                  // work: length of the crc data
+    uint16_t crc;                   // work: crc of the crc data
+
+    size_t lineOff, lineLen;        // out: the pattern line with CRLF, in SIG_SCRATCH::lines
+    PAT_LINE_KEY lineKey;           // out: with SIG_BATCH::pLines, the identity of the line
+};
+
+typedef std::vector<FUNC_SIG_JOB, SIG_ALLOCATOR<FUNC_SIG_JOB> > sig_job_vec;
+
+/* Working set and output of a group of SIG_CRC_GROUP jobs */
+struct SIG_SCRATCH
+{
+    sig_byte_vec mask;
+    sig_ref_vec refs;
+    sig_char_vec lines;             // pattern lines of the group, in job order
+};
+
+typedef std::vector<SIG_SCRATCH, SIG_ALLOCATOR<SIG_SCRATCH> > sig_scratch_vec;
+
+/* A line with the same prefix, alen, crc and len as an earlier line, and other names */
+typedef struct tagSIG_COLLISION {
+    size_t job;             // index in SIG_BATCH::jobs
+    sig_ea_t otherEA;       // function of the earlier line, SIG_BADADDR: a line of the PAT file
+} SIG_COLLISION;
+
+typedef std::vector<SIG_COLLISION, SIG_ALLOCATOR<SIG_COLLISION> > sig_collision_vec;
+
+struct PAT_LINE_INDEX;
+
+/*
+ * Functions collected from the database, waiting to be encoded.
+ * Clear() keeps all memory, so once the arenas have grown to the size
+ * of the largest batch, collecting and encoding do not allocate.
+ */
+struct SIG_BATCH
+{
+    sig_job_vec jobs;
+    sig_byte_vec bytes;
+    sig_public_vec publics;
+    sig_xref_vec xrefs;
+    sig_string names;               // NULL separated name pool
+    sig_scratch_vec groups;         // one per SIG_CRC_GROUP jobs
+    bool bKeepLines;                // keep the lines in the scratch after encoding
+    PAT_LINE_INDEX *pLines;         // lines written before are skipped, NULL: write all lines
+    sig_collision_vec collisions;   // out: with pLines, in job order
+
+    SIG_BATCH() : bKeepLines(false), pLines(NULL)
+    {
+        jobs.reserve(SIG_BATCH_SIZE);
+        groups.resize((SIG_BATCH_SIZE + SIG_CRC_GROUP - 1) / SIG_CRC_GROUP);
+    }
+
+    void Clear()
+    {
+        jobs.clear();
+        bytes.clear();
+        publics.clear();
+        xrefs.clear();
+        names.clear();
+        collisions.clear();
+    }
+
+    size_t GetCount() const
+    {
+        return jobs.size();
+    }
+
+    bool IsFull() const
+    {
+        return (jobs.size() >= SIG_BATCH_SIZE);
+    }
+
+    size_t GetGroupCount() const
+    {
+        return (jobs.size() + SIG_CRC_GROUP - 1) / SIG_CRC_GROUP;
+    }
+
+    /* Start a new job, the following Add calls belong to it */
+    FUNC_SIG_JOB &AddJob(sig_ea_t ea, uint32_t length)
+    {
+        _ASSERTE(!IsFull());
+
+        FUNC_SIG_JOB job;
+        memset(&job, 0, sizeof(job));
+        job.startEA = ea;
+        job.len = length;
+        job.bytesOff = bytes.size();
+        job.firstPublic = publics.size();
+        job.firstXref = xrefs.size();
+        jobs.push_back(job);
+        return jobs.back();
+    }
+
+    size_t AddName(const char *pName)
+    {
+        _ASSERTE(!jobs.empty());
+
+        size_t off = names.size();
+        names.append(pName);
+        names.push_back('\0');
+        jobs.back().namesLen += names.size() - off;
+        return off;
+    }
+
+    void AddPublic(const SIG_PUBLIC &pub)
+    {
+        publics.push_back(pub);
+        jobs.back().numPublics++;
+    }
+
+    void AddXref(const SIG_XREF &xref)
+    {
+        xrefs.push_back(xref);
+        jobs.back().numXrefs++;
+    }
+
+    /* Get space for len bytes of the last job */
+    uint8_t *SetBytes(size_t len)
+    {
+        FUNC_SIG_JOB &job = jobs.back();
+        job.pExtBytes = NULL;
+        job.bytesLen = len;
+        bytes.resize(job.bytesOff + len);
+        return (len > 0) ? &bytes[job.bytesOff] : NULL;
+    }
+
+    /* Use len bytes of a snapshot for the last job, they are not copied */
+    void SetBytesRef(const uint8_t *pBytes, size_t len)
+    {
+        FUNC_SIG_JOB &job = jobs.back();
+        job.pExtBytes = pBytes;
+        job.bytesLen = len;
+    }
+
+    const char *GetName(size_t off) const
+    {
+        return names.c_str() + off;
+    }
+
+    const uint8_t *GetBytes(const FUNC_SIG_JOB &job) const
+    {
+        if (NULL != job.pExtBytes)
+        {
+            return job.pExtBytes;
+        }
+        return (job.bytesLen > 0) ? &bytes[job.bytesOff] : NULL;
+    }
+
+    const SIG_SCRATCH &GetScratch(size_t index) const
+    {
+        return groups[index / SIG_CRC_GROUP];
+    }
+
+    /* The encoded line of a job, only after encoding with bKeepLines */
+    const char *GetLine(size_t index) const
+    {
+        const FUNC_SIG_JOB &job = jobs[index];
+        if (NULL != job.pCachedLine)
+        {
+            return job.pCachedLine;
+        }
+        return (job.lineLen > 0) ? &GetScratch(index).lines[job.lineOff] : NULL;
+    }
+};
+
+size_t max_func_sig_len(const FUNC_SIG_JOB &job);
+void prepare_func_sigs(SIG_BATCH &batch, size_t group);
+size_t write_func_sig(const SIG_BATCH &batch, size_t index, char *pSigBuf);
+void make_func_sigs(SIG_BATCH &batch, size_t group);
+bool encode_func_sigs(SIG_BATCH &batch, WORKER_POOL &workers, SIG_WRITER &writer);
+
+#endif  // __IDB2SIG_PATGEN_H__
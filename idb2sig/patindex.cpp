@@ -0,0 +1,327 @@
+/*************************************************************************
+    IDB2SIG pattern line index
+    A pattern line is identified by its first 32 bytes with the variable
+    bytes masked, alen, crc, len and its public names:
+        <prefix> <alen> <crc> <len> :<off> <name>... ^<off> <ref>... <tail>
+    The references and the tail bytes are not part of the identity. Lines
+    with the same prefix, alen, crc and len and other names are collisions
+    for sigmake, they are kept.
+*************************************************************************/
+
+#include <string.h>
+#include <algorithm>
+
+#include "patindex.h"
+
+using namespace std;
+
+#define SPACE               0x20
+#define PAT_INDEX_MIN_SLOTS 1024
+
+/**********************************************************************
+* Function:     find_pat_tail
+* Description:
+*       finds where the lines are appended to a PAT file: at the start of
+*       its last line which is not empty, which must be '---'. The empty
+*       lines after it are overwritten too.
+* Parameters:   const char *pBlock - the last len bytes of the file
+*               size_t len
+*               bool bFileStart - the block starts at the start of the file
+*               size_t *pLineStart - out, offset of the '---' line in the
+*               block, 0 if the file has only empty lines
+* Returns:      PAT_TAIL_RESULT
+**********************************************************************/
+PAT_TAIL_RESULT find_pat_tail(const char *pBlock, size_t len, bool bFileStart,
+                              size_t *pLineStart)
+{
+    size_t end = len;
+    while ((end > 0) && (('\r' == pBlock[end - 1]) || ('\n' == pBlock[end - 1])))
+    {
+        end--;
+    }
+
+    size_t start = end;
+    while ((start > 0) && ('\r' != pBlock[start - 1]) && ('\n' != pBlock[start - 1]))
+    {
+        start--;
+    }
+
+    *pLineStart = start;
+    if ((0 == end) && bFileStart)
+    {
+        // Nothing but empty lines, as an empty file
+        return PAT_TAIL_FOUND;
+    }
+    if ((0 == start) && !bFileStart && (end <= 3))
+    {
+        // The line may start before the block
+        return PAT_TAIL_MORE;
+    }
+    if ((end - start == 3) && (0 == memcmp(pBlock + start, "---", 3)))
+    {
+        return PAT_TAIL_FOUND;
+    }
+    return PAT_TAIL_INVALID;
+}
+
+/* The next field of a line, separated by spaces */
+static inline const char *next_field(const char *p, const char *pEnd, size_t *pLen)
+{
+    while ((p < pEnd) && (SPACE == *p))
+    {
+        p++;
+    }
+    const char *pField = p;
+    while ((p < pEnd) && (SPACE != *p))
+    {
+        p++;
+    }
+    *pLen = (size_t) (p - pField);
+    return pField;
+}
+
+/**********************************************************************
+* Function:     get_pat_line_key
+* Description:  hashes the prefix, alen, crc and len of a pattern line,
+*               and its public names with their offsets
+* Parameters:   const char *pLine - with or without the line end
+*               size_t len
+*               PAT_LINE_KEY &key - out
+* Returns:      false if it is not a pattern line
+**********************************************************************/
+bool get_pat_line_key(const char *pLine, size_t len, PAT_LINE_KEY &key)
+{
+    static const size_t fieldLens[] = { 64, 2, 4, 4 };
+    const char *pEnd = pLine + len;
+    while ((pEnd > pLine) && (('\r' == pEnd[-1]) || ('\n' == pEnd[-1])))
+    {
+        pEnd--;
+    }
+
+    // The fields of the key are written with a fixed width, len may be wider
+    const char *p = pLine;
+    size_t fieldLen = 0;
+    for (size_t f = 0; f < sizeof(fieldLens) / sizeof(fieldLens[0]); f++)
+    {
+        const char *pField = next_field(p, pEnd, &fieldLen);
+        if ((fieldLen < fieldLens[f]) || ((f < 3) && (fieldLen != fieldLens[f])))
+        {
+            return false;
+        }
+        p = pField + fieldLen;
+    }
+
+    SIG_HASH hash;
+    hash.Add(pLine, (size_t) (p - pLine));
+    key.key = hash.Final();
+    if (0 == key.key)
+    {
+        key.key = 1;
+    }
+
+    // The publics come first, each an offset and a name; the references
+    // and the tail bytes, the most of a long line, are not scanned
+    SIG_HASH names;
+    for (;;)
+    {
+        while ((p < pEnd) && (SPACE == *p))
+        {
+            p++;
+        }
+        if ((p == pEnd) || (':' != *p))
+        {
+            break;
+        }
+        const char *pField = next_field(p, pEnd, &fieldLen);
+        const char *pName = next_field(pField + fieldLen, pEnd, &fieldLen);
+        names.Add(pField, (size_t) (pName + fieldLen - pField));
+        p = pName + fieldLen;
+    }
+    key.names = names.Final();
+
+    return true;
+}
+
+void PAT_LINE_INDEX::Clear()
+{
+    m_slots.clear();
+    m_numLines = 0;
+    m_numKnown = 0;
+    m_numDuplicates = 0;
+    m_numCollisions = 0;
+}
+
+/**********************************************************************
+* Function:     PAT_LINE_INDEX::Load
+* Description:  indexes the lines of a PAT file in one pass, a block at
+*               a time; the lines which are not pattern lines are skipped
+* Parameters:   PFN_SIG_READ pfnRead
+*               void *ctx
+*               uint64_t size - bytes to read, up to the '---' line
+* Returns:      false on a read error
+**********************************************************************/
+bool PAT_LINE_INDEX::Load(PFN_SIG_READ pfnRead, void *ctx, uint64_t size)
+{
+    if (0 == size)
+    {
+        return true;
+    }
+
+    vector<char> block((size_t) min(size, (uint64_t) PAT_READ_BLOCK));
+    uint64_t left = size;
+    size_t used = 0;
+
+    while (left > 0)
+    {
+        // A line longer than the block grows it
+        if (used == block.size())
+        {
+            block.resize(block.size() * 2);
+        }
+        size_t len = (size_t) min(left, (uint64_t) (block.size() - used));
+        if (!pfnRead(ctx, &block[used], len))
+        {
+            return false;
+        }
+        used += len;
+        left -= len;
+
+        const char *pStart = &block[0];
+        const char *pEnd = pStart + used;
+        for (;;)
+        {
+            const char *pLineEnd = (const char *) memchr(pStart, '\n', (size_t) (pEnd - pStart));
+            if (NULL == pLineEnd)
+            {
+                break;
+            }
+            AddLine(pStart, (size_t) (pLineEnd - pStart));
+            pStart = pLineEnd + 1;
+        }
+
+        // Keep the part of the last line for the next block
+        used = (size_t) (pEnd - pStart);
+        memmove(&block[0], pStart, used);
+    }
+
+    if (used > 0)
+    {
+        AddLine(&block[0], used);
+    }
+    return true;
+}
+
+/**********************************************************************
+* Function:     PAT_LINE_INDEX::AddLine
+* Description:  adds a line of the PAT file, the lines which are not
+*               pattern lines are ignored
+* Parameters:   const char *pLine
+*               size_t len
+* Returns:      none
+**********************************************************************/
+void PAT_LINE_INDEX::AddLine(const char *pLine, size_t len)
+{
+    PAT_LINE_KEY key;
+    if (get_pat_line_key(pLine, len, key))
+    {
+        (void) AddKey(key, SIG_BADADDR, NULL);
+    }
+}
+
+/**********************************************************************
+* Function:     PAT_LINE_INDEX::AddKey
+* Description:  adds a line unless the same line is in the index, and
+*               counts the duplicates and the collisions of the lines
+*               of functions
+* Parameters:   const PAT_LINE_KEY &key
+*               sig_ea_t ea - function of the line, SIG_BADADDR: a line
+*               of the PAT file
+*               sig_ea_t *pOtherEA - out, the function of the same line or
+*               of the line with other names, may be NULL
+* Returns:      PAT_LINE_RESULT
+**********************************************************************/
+PAT_LINE_RESULT PAT_LINE_INDEX::AddKey(const PAT_LINE_KEY &key, sig_ea_t ea, sig_ea_t *pOtherEA)
+{
+    _ASSERTE(0 != key.key);
+    if ((m_numLines + 1) * 2 > m_slots.size())
+    {
+        Grow();
+    }
+
+    size_t mask = m_slots.size() - 1;
+    size_t i = (size_t) key.key & mask;
+    const PAT_LINE_ENTRY *pOther = NULL;
+    for (; 0 != m_slots[i].key.key; i = (i + 1) & mask)
+    {
+        const PAT_LINE_ENTRY &entry = m_slots[i];
+        if (entry.key.key != key.key)
+        {
+            continue;
+        }
+
+        if (entry.key.names == key.names)
+        {
+            if (NULL != pOtherEA)
+            {
+                *pOtherEA = entry.ea;
+            }
+            // A line repeated in the PAT file is not counted
+            if ((SIG_BADADDR != ea) && (SIG_BADADDR == entry.ea))
+            {
+                m_numKnown++;
+            }
+            else if (SIG_BADADDR != ea)
+            {
+                m_numDuplicates++;
+            }
+            return PAT_LINE_DUPLICATE;
+        }
+
+        if (NULL == pOther)
+        {
+            pOther = &entry;
+        }
+    }
+
+    if (NULL != pOther)
+    {
+        if (NULL != pOtherEA)
+        {
+            *pOtherEA = pOther->ea;
+        }
+        if (SIG_BADADDR != ea)
+        {
+            m_numCollisions++;
+        }
+    }
+
+    m_slots[i].key = key;
+    m_slots[i].ea = ea;
+    m_numLines++;
+    return (NULL != pOther) ? PAT_LINE_COLLISION : PAT_LINE_NEW;
+}
+
+/* Double the slots, the table stays at most half full */
+void PAT_LINE_INDEX::Grow()
+{
+    vector<PAT_LINE_ENTRY> old;
+    old.swap(m_slots);
+
+    PAT_LINE_ENTRY empty;
+    memset(&empty, 0, sizeof(empty));
+    m_slots.assign(max((size_t) PAT_INDEX_MIN_SLOTS, old.size() * 2), empty);
+
+    size_t mask = m_slots.size() - 1;
+    for (size_t n = 0; n < old.size(); n++)
+    {
+        if (0 != old[n].key.key)
+        {
+            size_t i = (size_t) old[n].key.key & mask;
+            while (0 != m_slots[i].key.key)
+            {
+                i = (i + 1) & mask;
+            }
+            m_slots[i] = old[n];
+        }
+    }
+}
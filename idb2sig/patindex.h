@@ -0,0 +1,110 @@
+#ifndef __IDB2SIG_PATINDEX_H__
+#define __IDB2SIG_PATINDEX_H__
+
+#pragma once
+
+/*
+ * Pattern lines written to a PAT file.
+ * A run keeps the identity of every line it writes, so a line equal to an
+ * earlier one, as of thunks and compiler helpers, is not written again;
+ * lines which only differ in their names are kept and reported, sigmake
+ * sees them as collisions. In append mode the lines already in the PAT
+ * file can be indexed first, in one streaming pass, and its '---' line is
+ * found in one block read from the end.
+ * Portable, does not call the IDA SDK.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "patgen.h"
+#include "patout.h"
+
+#define PAT_TAIL_BLOCK  4096                // first block read from the end of the file
+#define PAT_READ_BLOCK  (1024 * 1024)       // block of the streaming pass
+
+/* Result of find_pat_tail */
+typedef enum tagPAT_TAIL_RESULT {
+    PAT_TAIL_FOUND,         // the last line which is not empty is '---'
+    PAT_TAIL_MORE,          // the block has only empty lines, read a larger one
+    PAT_TAIL_INVALID        // the last line which is not empty is not '---'
+} PAT_TAIL_RESULT;
+
+/* Find the '---' line in the last len bytes of a PAT file */
+PAT_TAIL_RESULT find_pat_tail(const char *pBlock, size_t len, bool bFileStart,
+                              size_t *pLineStart);
+
+/* Get the key of a pattern line, false if it is not one */
+bool get_pat_line_key(const char *pLine, size_t len, PAT_LINE_KEY &key);
+
+/* Result of PAT_LINE_INDEX::AddKey */
+typedef enum tagPAT_LINE_RESULT {
+    PAT_LINE_NEW,           // added
+    PAT_LINE_DUPLICATE,     // the same line is in the index
+    PAT_LINE_COLLISION      // added, a line with the same key and other names is in the index
+} PAT_LINE_RESULT;
+
+/* A line in PAT_LINE_INDEX */
+typedef struct tagPAT_LINE_ENTRY {
+    PAT_LINE_KEY key;
+    sig_ea_t ea;            // function of the line, SIG_BADADDR: a line of the PAT file
+} PAT_LINE_ENTRY;
+
+/*
+ * Hash set of pattern lines. Only the keys are kept, not the lines, so the
+ * index of a multi-GB file fits in memory; two different lines have the
+ * same keys with a probability of 2^-128. The lines of one key are all in
+ * the probe sequence of the key, one probe finds a duplicate or a collision.
+ */
+struct PAT_LINE_INDEX
+{
+    PAT_LINE_INDEX() : m_numLines(0), m_numKnown(0), m_numDuplicates(0), m_numCollisions(0)
+    {
+    }
+
+    void Clear();
+
+    /* Index the lines of the first size bytes of a PAT file, false on a read error */
+    bool Load(PFN_SIG_READ pfnRead, void *ctx, uint64_t size);
+
+    /* Add a line of the PAT file */
+    void AddLine(const char *pLine, size_t len);
+
+    /* Add the line of a function unless it is a duplicate, pOtherEA gets
+       the function of the earlier line */
+    PAT_LINE_RESULT AddKey(const PAT_LINE_KEY &key, sig_ea_t ea, sig_ea_t *pOtherEA);
+
+    size_t GetLineCount() const
+    {
+        return m_numLines;
+    }
+
+    /* Duplicates of the lines of the PAT file */
+    size_t GetKnownCount() const
+    {
+        return m_numKnown;
+    }
+
+    /* Duplicates of the lines of the run */
+    size_t GetDuplicateCount() const
+    {
+        return m_numDuplicates;
+    }
+
+    size_t GetCollisionCount() const
+    {
+        return m_numCollisions;
+    }
+
+private:
+    void Grow();
+
+    std::vector<PAT_LINE_ENTRY> m_slots;    // open addressing, key 0 is a free slot
+    size_t m_numLines;
+    size_t m_numKnown;
+    size_t m_numDuplicates;
+    size_t m_numCollisions;
+};
+
+#endif  // __IDB2SIG_PATINDEX_H__
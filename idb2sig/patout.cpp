@@ -0,0 +1,328 @@
+/*************************************************************************
+    IDB2SIG PAT file output buffering
+    Replaces the reserved virtual memory region, which was committed 1 MB
+    at a time from an SEH page fault filter and could run out, and the
+    single write of the whole PAT file at the end of the run.
+*************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "patout.h"
+
+using namespace std;
+
+SIG_WRITER::SIG_WRITER(size_t chunkSize, size_t maxChunks)
+    : m_chunkSize(chunkSize), m_maxChunks((maxChunks < 2) ? 2 : maxChunks),
+      m_allocated(0), m_totalUsed(0), m_pfnWrite(NULL), m_pWriteCtx(NULL),
+      m_bThread(false), m_bStop(false), m_bWriteError(false)
+{
+    m_cur.pData = NULL;
+    m_cur.size = 0;
+    m_cur.used = 0;
+}
+
+SIG_WRITER::~SIG_WRITER()
+{
+    if (m_bThread)
+    {
+        (void) Finish();
+    }
+
+    free(m_cur.pData);
+    for (vector<SIG_CHUNK>::iterator c = m_free.begin(); c != m_free.end(); c++)
+    {
+        free(c->pData);
+    }
+    for (deque<SIG_CHUNK>::iterator c = m_queue.begin(); c != m_queue.end(); c++)
+    {
+        free(c->pData);
+    }
+}
+
+/**********************************************************************
+* Function:     SIG_WRITER::Start
+* Description:  starts the background writer thread. If the thread can
+*               not be created, filled chunks are written synchronously.
+* Parameters:   PFN_SIG_WRITE pfnWrite - writes a block to the PAT file
+*               void *ctx - passed to pfnWrite
+* Returns:      none
+**********************************************************************/
+void SIG_WRITER::Start(PFN_SIG_WRITE pfnWrite, void *ctx)
+{
+    _ASSERTE(!m_bThread);
+
+    m_pfnWrite = pfnWrite;
+    m_pWriteCtx = ctx;
+    m_bStop = false;
+    m_bThread = m_thread.Start(WriterProc, this);
+}
+
+/**********************************************************************
+* Function:     SIG_WRITER::GetFreeChunk
+* Description:  makes m_cur an empty chunk of at least minSize bytes,
+*               reusing a written chunk, allocating a new one while
+*               fewer than m_maxChunks exist, or waiting for the writer
+*               thread to free one
+* Parameters:   size_t minSize
+* Returns:      false if out of memory or a write failed
+**********************************************************************/
+bool SIG_WRITER::GetFreeChunk(size_t minSize)
+{
+    _ASSERTE(NULL == m_cur.pData);
+
+    m_lock.Lock();
+    while (m_free.empty() && (m_allocated >= m_maxChunks) && !m_bWriteError)
+    {
+        m_freed.Wait(m_lock);
+    }
+
+    bool bOk = !m_bWriteError;
+    if (bOk)
+    {
+        if (!m_free.empty())
+        {
+            m_cur = m_free.back();
+            m_free.pop_back();
+        }
+        else
+        {
+            m_cur.pData = NULL;
+            m_cur.size = 0;
+            m_allocated++;
+        }
+    }
+    m_lock.Unlock();
+
+    if (!bOk)
+    {
+        return false;
+    }
+
+    m_cur.used = 0;
+    if (m_cur.size < minSize)
+    {
+        // A line longer than the chunk size gets a chunk of its own size
+        size_t size = (minSize > m_chunkSize) ? minSize : m_chunkSize;
+        char *p = (char *) realloc(m_cur.pData, size);
+        if (NULL == p)
+        {
+            return false;
+        }
+        m_cur.pData = p;
+        m_cur.size = size;
+    }
+
+    return true;
+}
+
+/**********************************************************************
+* Function:     SIG_WRITER::Submit
+* Description:  hands the current chunk to the writer thread, or writes
+*               it now when there is no writer thread
+* Parameters:   none
+* Returns:      none
+**********************************************************************/
+void SIG_WRITER::Submit()
+{
+    if (NULL == m_cur.pData)
+    {
+        return;
+    }
+
+    if (!m_bThread)
+    {
+        if ((m_cur.used > 0) && !m_bWriteError &&
+            !m_pfnWrite(m_pWriteCtx, m_cur.pData, m_cur.used))
+        {
+            m_bWriteError = true;
+        }
+        m_cur.used = 0;
+        m_free.push_back(m_cur);
+    }
+    else
+    {
+        m_lock.Lock();
+        m_queue.push_back(m_cur);
+        m_queued.Signal();
+        m_lock.Unlock();
+    }
+
+    m_cur.pData = NULL;
+    m_cur.size = 0;
+    m_cur.used = 0;
+}
+
+/**********************************************************************
+* Function:     SIG_WRITER::Reserve
+* Description:  returns at least maxLen bytes of contiguous space at the
+*               end of the current chunk. When the chunk is too full, it
+*               goes to the writer thread and another chunk is used.
+* Parameters:   size_t maxLen
+* Returns:      pointer to the space, NULL if out of memory or a write
+*               failed
+**********************************************************************/
+char *SIG_WRITER::Reserve(size_t maxLen)
+{
+    if (m_bWriteError)
+    {
+        return NULL;
+    }
+
+    if ((NULL != m_cur.pData) && (m_cur.size - m_cur.used >= maxLen))
+    {
+        return m_cur.pData + m_cur.used;
+    }
+
+    Submit();
+    if (!GetFreeChunk(maxLen))
+    {
+        return NULL;
+    }
+
+    return m_cur.pData;
+}
+
+/**********************************************************************
+* Function:     SIG_WRITER::Commit
+* Description:  keeps the first used bytes written to the space
+*               returned by the last Reserve call
+* Parameters:   size_t used
+* Returns:      none
+**********************************************************************/
+void SIG_WRITER::Commit(size_t used)
+{
+    _ASSERTE(NULL != m_cur.pData);
+    _ASSERTE(m_cur.used + used <= m_cur.size);
+
+    m_cur.used += used;
+    m_totalUsed += used;
+}
+
+/**********************************************************************
+* Function:     SIG_WRITER::Append
+* Description:  copies a block of data to the output
+* Parameters:   const char *pData
+*               size_t len
+* Returns:      false if out of memory or a write failed
+**********************************************************************/
+bool SIG_WRITER::Append(const char *pData, size_t len)
+{
+    char *p = Reserve(len);
+    if (NULL == p)
+    {
+        return false;
+    }
+
+    memcpy(p, pData, len);
+    Commit(len);
+    return true;
+}
+
+/**********************************************************************
+* Function:     SIG_WRITER::Finish
+* Description:  writes the last chunk, then waits until the writer
+*               thread has written everything and exits
+* Parameters:   none
+* Returns:      false if a write failed
+**********************************************************************/
+bool SIG_WRITER::Finish()
+{
+    Submit();
+
+    if (m_bThread)
+    {
+        m_lock.Lock();
+        m_bStop = true;
+        m_queued.Signal();
+        m_lock.Unlock();
+
+        m_thread.Join();
+        m_bThread = false;
+    }
+
+    return !m_bWriteError;
+}
+
+/**********************************************************************
+* Function:     SIG_WRITER::Abort
+* Description:  drops the chunk being filled and the chunks waiting for
+*               the writer thread, then waits until the writer thread
+*               has finished the chunk it is writing and exits. The
+*               caller undoes what was already written.
+* Parameters:   none
+* Returns:      none
+**********************************************************************/
+void SIG_WRITER::Abort()
+{
+    m_lock.Lock();
+    if (NULL != m_cur.pData)
+    {
+        m_cur.used = 0;
+        m_free.push_back(m_cur);
+        m_cur.pData = NULL;
+        m_cur.size = 0;
+    }
+    while (!m_queue.empty())
+    {
+        SIG_CHUNK chunk = m_queue.front();
+        m_queue.pop_front();
+        chunk.used = 0;
+        m_free.push_back(chunk);
+    }
+    m_bStop = true;
+    m_queued.Signal();
+    m_lock.Unlock();
+
+    if (m_bThread)
+    {
+        m_thread.Join();
+        m_bThread = false;
+    }
+}
+
+/**********************************************************************
+* Function:     SIG_WRITER::WriterProc
+* Description:  writer thread, writes the filled chunks in order and
+*               gives them back for reuse
+* Parameters:   void *ctx - the SIG_WRITER
+* Returns:      none
+**********************************************************************/
+void SIG_WRITER::WriterProc(void *ctx)
+{
+    SIG_WRITER *pThis = (SIG_WRITER *) ctx;
+
+    pThis->m_lock.Lock();
+    for (;;)
+    {
+        while (pThis->m_queue.empty() && !pThis->m_bStop)
+        {
+            pThis->m_queued.Wait(pThis->m_lock);
+        }
+        if (pThis->m_queue.empty())
+        {
+            break;
+        }
+
+        SIG_CHUNK chunk = pThis->m_queue.front();
+        pThis->m_queue.pop_front();
+        bool bError = pThis->m_bWriteError;
+        pThis->m_lock.Unlock();
+
+        // After a failed write, the rest is dropped
+        if (!bError && (chunk.used > 0))
+        {
+            bError = !pThis->m_pfnWrite(pThis->m_pWriteCtx, chunk.pData, chunk.used);
+        }
+
+        pThis->m_lock.Lock();
+        if (bError)
+        {
+            pThis->m_bWriteError = true;
+        }
+        chunk.used = 0;
+        pThis->m_free.push_back(chunk);
+        pThis->m_freed.Signal();
+    }
+    pThis->m_lock.Unlock();
+}
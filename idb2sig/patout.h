@@ -0,0 +1,107 @@
+#ifndef __IDB2SIG_PATOUT_H__
+#define __IDB2SIG_PATOUT_H__
+
+#pragma once
+
+/*
+ * PAT file output buffering.
+ * Portable, does not call the IDA SDK.
+ */
+
+#include <stddef.h>
+#include <deque>
+#include <vector>
+
+#include "threads.h"
+
+#ifndef _ASSERTE
+    #include <assert.h>
+    #define _ASSERTE(x) assert(x)
+#endif
+
+#define SIG_CHUNK_SIZE  (1024 * 1024)   // default size of an output chunk
+#define SIG_MAX_CHUNKS  4               // default number of chunks being filled or written
+
+/* A block of pattern lines */
+typedef struct tagSIG_CHUNK {
+    char *pData;            // chunk memory
+    size_t size;            // allocated size
+    size_t used;            // bytes filled with pattern lines
+} SIG_CHUNK;
+
+/* Write a block of data to the PAT file, returns false on error */
+typedef bool (*PFN_SIG_WRITE)(void *ctx, const char *pData, size_t len);
+
+/* Read exactly len bytes of a side file, returns false on error or end of file */
+typedef bool (*PFN_SIG_READ)(void *ctx, void *pData, size_t len);
+
+/*
+ * Streaming output arena.
+ * Pattern lines are encoded into a chunk, and each filled chunk is handed
+ * to a background thread that writes it while the next one is filled.
+ * At most maxChunks chunks exist at a time, when all of them are waiting
+ * to be written, Reserve() blocks until the writer thread frees one.
+ */
+struct SIG_WRITER
+{
+    SIG_WRITER(size_t chunkSize = SIG_CHUNK_SIZE, size_t maxChunks = SIG_MAX_CHUNKS);
+    ~SIG_WRITER();
+
+    /* Start the writer thread, writes synchronously if it can not start */
+    void Start(PFN_SIG_WRITE pfnWrite, void *ctx);
+
+    /* Get at least maxLen bytes of contiguous space, NULL if out of memory or a write failed */
+    char *Reserve(size_t maxLen);
+
+    /* Keep the first used bytes of the space returned by Reserve */
+    void Commit(size_t used);
+
+    /* Copy a block of data to the output */
+    bool Append(const char *pData, size_t len);
+
+    /* Write the last chunk and wait for the writer thread, false if a write failed */
+    bool Finish();
+
+    /* Drop the chunks not written yet and wait for the writer thread */
+    void Abort();
+
+    /* Total bytes committed */
+    size_t GetSize() const
+    {
+        return m_totalUsed;
+    }
+
+    bool HasWriteError() const
+    {
+        return m_bWriteError;
+    }
+
+private:
+    bool GetFreeChunk(size_t minSize);
+    void Submit();
+    static void WriterProc(void *ctx);
+
+    size_t m_chunkSize;
+    size_t m_maxChunks;
+    size_t m_allocated;
+    size_t m_totalUsed;
+
+    SIG_CHUNK m_cur;                    // chunk being filled
+    std::vector<SIG_CHUNK> m_free;      // written chunks ready for reuse
+    std::deque<SIG_CHUNK> m_queue;      // filled chunks waiting for the writer thread
+
+    PFN_SIG_WRITE m_pfnWrite;
+    void *m_pWriteCtx;
+    THREAD m_thread;
+    MUTEX m_lock;
+    CONDVAR m_queued;
+    CONDVAR m_freed;
+    bool m_bThread;
+    bool m_bStop;
+    volatile bool m_bWriteError;
+
+    SIG_WRITER(const SIG_WRITER &);
+    SIG_WRITER &operator=(const SIG_WRITER &);
+};
+
+#endif  // __IDB2SIG_PATOUT_H__
@@ -0,0 +1,473 @@
+/*************************************************************************
+    IDB2SIG reference location search
+    find_ref_loc read a 32 bit and a 64 bit value from the database at
+    every offset of the item, for every reference of the item.
+    find_ref_locs reads the collected item bytes once and compares 16
+    offsets at a time against the values of all references of the item.
+    Instructions are at most 15 bytes, shorter than one block, so their
+    references are searched byte by byte without any setup; the block
+    scan is for the longer data items.
+*************************************************************************/
+
+#include <string.h>
+
+#include "refscan.h"
+#include "cpufeat.h"
+
+/* Items shorter than this are searched byte by byte, the setup of the
+   block scans pays off from about three blocks (sigbench find_ref_locs) */
+#define REF_BLOCK_ITEM  48
+
+static bool g_bRefScanSSE2 = false;
+
+/**********************************************************************
+* Function:     InitRefScan
+* Description:  selects the SSE2 scan when the CPU supports it, must be
+*               called before worker threads use find_ref_locs
+* Parameters:   none
+* Returns:      none
+**********************************************************************/
+void InitRefScan(void)
+{
+#ifdef CPU_X86
+    g_bRefScanSSE2 = CpuHasSSE2();
+#endif
+}
+
+/* find_ref_loc in the bytes of a checked item */
+static inline sig_ea_t find_ref_in_item(const uint8_t *pItem, sig_ea_t item, sig_ea_t item_end,
+                                        sig_ea_t _ref, uint32_t *ref_len)
+{
+    size_t size = (size_t)(item_end - item);
+
+#ifdef __EA64__
+    for (sig_ea_t i = 0; i + 8 <= size; i++)
+    {
+        uint64_t v;
+        memcpy(&v, pItem + i, sizeof(v));
+        if (v == _ref || v == _ref - item_end)
+        {
+            *ref_len = 8;
+            return item + i;
+        }
+    }
+#endif
+
+    sig_ea_t rel = _ref - item_end;
+    for (sig_ea_t i = 0; i + 4 <= size; i++)
+    {
+        uint32_t v;
+        memcpy(&v, pItem + i, sizeof(v));
+        if ((v == (uint32_t)_ref) || (((int32_t)rel == (int64_t)rel) && (v == (uint32_t)rel)))
+        {
+            *ref_len = 4;
+            return item + i;
+        }
+    }
+
+    return SIG_BADADDR;
+}
+
+/**********************************************************************
+* Function:     find_ref_loc
+* Description:
+*   this function finds the location of a reference within an instruction
+*   or a data item
+*   eg:  00401000 E8 FB 0F 00 00   call sub_402000
+*   find_ref_loc(0x401000, 0x402000) would return 0x401001
+*   it works for both segment relative and self-relative offsets
+*   the item bytes are read from the collected function bytes, not from
+*   the database
+* Parameters:   const uint8_t *pBytes - function bytes
+*               size_t size - number of function bytes
+*               sig_ea_t start_ea - address of pBytes[0]
+*               sig_ea_t item
+*               sig_ea_t item_end
+*               sig_ea_t _ref
+* Returns:      sig_ea_t
+*               *ref_len : length of reference in bytes
+**********************************************************************/
+sig_ea_t find_ref_loc(const uint8_t *pBytes, size_t size, sig_ea_t start_ea,
+                      sig_ea_t item, sig_ea_t item_end, sig_ea_t _ref, uint32_t *ref_len)
+{
+    _ASSERTE(item != SIG_BADADDR);
+    _ASSERTE(_ref != SIG_BADADDR);
+    _ASSERTE((item >= start_ea) && (item_end - start_ea <= size));
+    if ((SIG_BADADDR == item) || (SIG_BADADDR == _ref) ||
+        (item < start_ea) || (item_end < item) ||
+        (item_end - start_ea > size))
+    {
+        return SIG_BADADDR;
+    }
+
+    return find_ref_in_item(pBytes + (item - start_ea), item, item_end, _ref, ref_len);
+}
+
+/* Values searched for one reference: the absolute and the relative value */
+typedef struct tagREF_VALUES {
+    uint64_t v64[2];
+    uint32_t v32[2];
+} REF_VALUES;
+
+/**********************************************************************
+* Function:     scan_ref32
+* Description:  finds the first offset of each pending reference where
+*               the 32 bit value at the offset is one of its values
+* Parameters:   const uint8_t *pItem
+*               size_t pos - first offset to search
+*               size_t size - item size
+*               const REF_VALUES *pValues
+*               size_t count
+*               unsigned int pending - bit set of references to search
+*               size_t *pOffsets - out: offsets of the found references
+* Returns:      bit set of the references still not found
+**********************************************************************/
+static unsigned int scan_ref32(const uint8_t *pItem, size_t pos, size_t size,
+                               const REF_VALUES *pValues, size_t count,
+                               unsigned int pending, size_t *pOffsets)
+{
+    for (size_t i = pos; (0 != pending) && (i + 4 <= size); i++)
+    {
+        uint32_t v;
+        memcpy(&v, pItem + i, sizeof(v));
+        for (size_t r = 0; r < count; r++)
+        {
+            if ((pending & (1U << r)) && ((v == pValues[r].v32[0]) || (v == pValues[r].v32[1])))
+            {
+                pOffsets[r] = i;
+                pending &= ~(1U << r);
+            }
+        }
+    }
+
+    return pending;
+}
+
+#ifdef __EA64__
+/* Same as scan_ref32, with the 64 bit values */
+static unsigned int scan_ref64(const uint8_t *pItem, size_t pos, size_t size,
+                               const REF_VALUES *pValues, size_t count,
+                               unsigned int pending, size_t *pOffsets)
+{
+    for (size_t i = pos; (0 != pending) && (i + 8 <= size); i++)
+    {
+        uint64_t v;
+        memcpy(&v, pItem + i, sizeof(v));
+        for (size_t r = 0; r < count; r++)
+        {
+            if ((pending & (1U << r)) && ((v == pValues[r].v64[0]) || (v == pValues[r].v64[1])))
+            {
+                pOffsets[r] = i;
+                pending &= ~(1U << r);
+            }
+        }
+    }
+
+    return pending;
+}
+#endif
+
+#ifdef CPU_X86
+
+/* Movemask of the dwords of data equal to one of the two values */
+CPU_TARGET("sse2")
+static inline unsigned int match32_sse2(__m128i data, __m128i value0, __m128i value1)
+{
+    return (unsigned int) _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi32(data, value0),
+                                                          _mm_cmpeq_epi32(data, value1)));
+}
+
+/**********************************************************************
+* Function:     scan_ref32_sse2
+* Description:  scan_ref32 for blocks of 16 offsets. The 16 bytes loaded
+*               at offset i + k hold the 32 bit values at offsets
+*               i + k, i + k + 4, i + k + 8 and i + k + 12, so four loads
+*               cover 16 offsets. The loads are kept in registers for
+*               all the references of the block.
+* Parameters:   see scan_ref32
+* Returns:      bit set of the references still not found
+**********************************************************************/
+CPU_TARGET("sse2")
+static unsigned int scan_ref32_sse2(const uint8_t *pItem, size_t size,
+                                    const REF_VALUES *pValues, size_t count,
+                                    unsigned int pending, size_t *pOffsets)
+{
+    __m128i values[REF_SCAN_MAX][2];
+    for (size_t r = 0; r < count; r++)
+    {
+        values[r][0] = _mm_set1_epi32((int) pValues[r].v32[0]);
+        values[r][1] = _mm_set1_epi32((int) pValues[r].v32[1]);
+    }
+
+    if (size < 16 + 3)
+    {
+        return scan_ref32(pItem, 0, size, pValues, count, pending, pOffsets);
+    }
+
+    // The last block ends at the item end and may overlap the one before,
+    // the offsets of the overlap did not match any pending reference
+    size_t last = size - (16 + 3);
+    for (size_t i = 0; 0 != pending; i = (i + 16 < last) ? i + 16 : last)
+    {
+        const uint8_t *p = pItem + i;
+        __m128i data0 = _mm_loadu_si128((const __m128i *) p);
+        __m128i data1 = _mm_loadu_si128((const __m128i *) (p + 1));
+        __m128i data2 = _mm_loadu_si128((const __m128i *) (p + 2));
+        __m128i data3 = _mm_loadu_si128((const __m128i *) (p + 3));
+
+        for (size_t r = 0; r < count; r++)
+        {
+            if (0 == (pending & (1U << r)))
+            {
+                continue;
+            }
+
+            // Bit 4 * j + k of found is the value at offset i + 4 * j + k
+            unsigned int found =
+                (match32_sse2(data0, values[r][0], values[r][1]) & 0x1111) |
+                ((match32_sse2(data1, values[r][0], values[r][1]) & 0x1111) << 1) |
+                ((match32_sse2(data2, values[r][0], values[r][1]) & 0x1111) << 2) |
+                ((match32_sse2(data3, values[r][0], values[r][1]) & 0x1111) << 3);
+            if (0 != found)
+            {
+                pOffsets[r] = i + LowestBit(found);
+                pending &= ~(1U << r);
+            }
+        }
+
+        if (i == last)
+        {
+            break;
+        }
+    }
+
+    return pending;
+}
+
+#ifdef __EA64__
+/* Movemask of the qwords of data equal to one of the two values. SSE2 has
+   no 64 bit compare, both dword halves must be equal. */
+CPU_TARGET("sse2")
+static inline unsigned int match64_sse2(__m128i data, __m128i value0, __m128i value1)
+{
+    __m128i eq0 = _mm_cmpeq_epi32(data, value0);
+    __m128i eq1 = _mm_cmpeq_epi32(data, value1);
+    eq0 = _mm_and_si128(eq0, _mm_shuffle_epi32(eq0, _MM_SHUFFLE(2, 3, 0, 1)));
+    eq1 = _mm_and_si128(eq1, _mm_shuffle_epi32(eq1, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (unsigned int) _mm_movemask_epi8(_mm_or_si128(eq0, eq1)) & 0x0101;
+}
+
+/**********************************************************************
+* Function:     scan_ref64_sse2
+* Description:  scan_ref64 for blocks of 16 offsets, eight loads hold the
+*               64 bit values at offsets i + k and i + k + 8
+* Parameters:   see scan_ref32
+* Returns:      bit set of the references still not found
+**********************************************************************/
+CPU_TARGET("sse2")
+static unsigned int scan_ref64_sse2(const uint8_t *pItem, size_t size,
+                                    const REF_VALUES *pValues, size_t count,
+                                    unsigned int pending, size_t *pOffsets)
+{
+    __m128i values[REF_SCAN_MAX][2];
+    for (size_t r = 0; r < count; r++)
+    {
+        values[r][0] = _mm_set_epi32((int) (pValues[r].v64[0] >> 32), (int) pValues[r].v64[0],
+                                     (int) (pValues[r].v64[0] >> 32), (int) pValues[r].v64[0]);
+        values[r][1] = _mm_set_epi32((int) (pValues[r].v64[1] >> 32), (int) pValues[r].v64[1],
+                                     (int) (pValues[r].v64[1] >> 32), (int) pValues[r].v64[1]);
+    }
+
+    if (size < 16 + 7)
+    {
+        return scan_ref64(pItem, 0, size, pValues, count, pending, pOffsets);
+    }
+
+    // The last block may overlap the one before, as in scan_ref32_sse2
+    size_t last = size - (16 + 7);
+    for (size_t i = 0; 0 != pending; i = (i + 16 < last) ? i + 16 : last)
+    {
+        const uint8_t *p = pItem + i;
+        __m128i data0 = _mm_loadu_si128((const __m128i *) p);
+        __m128i data1 = _mm_loadu_si128((const __m128i *) (p + 1));
+        __m128i data2 = _mm_loadu_si128((const __m128i *) (p + 2));
+        __m128i data3 = _mm_loadu_si128((const __m128i *) (p + 3));
+        __m128i data4 = _mm_loadu_si128((const __m128i *) (p + 4));
+        __m128i data5 = _mm_loadu_si128((const __m128i *) (p + 5));
+        __m128i data6 = _mm_loadu_si128((const __m128i *) (p + 6));
+        __m128i data7 = _mm_loadu_si128((const __m128i *) (p + 7));
+
+        for (size_t r = 0; r < count; r++)
+        {
+            if (0 == (pending & (1U << r)))
+            {
+                continue;
+            }
+
+            // Bit 8 * j + k of found is the value at offset i + 8 * j + k
+            __m128i v0 = values[r][0];
+            __m128i v1 = values[r][1];
+            unsigned int found =
+                match64_sse2(data0, v0, v1) | (match64_sse2(data1, v0, v1) << 1) |
+                (match64_sse2(data2, v0, v1) << 2) | (match64_sse2(data3, v0, v1) << 3) |
+                (match64_sse2(data4, v0, v1) << 4) | (match64_sse2(data5, v0, v1) << 5) |
+                (match64_sse2(data6, v0, v1) << 6) | (match64_sse2(data7, v0, v1) << 7);
+            if (0 != found)
+            {
+                pOffsets[r] = i + LowestBit(found);
+                pending &= ~(1U << r);
+            }
+        }
+
+        if (i == last)
+        {
+            break;
+        }
+    }
+
+    return pending;
+}
+#endif  // __EA64__
+
+#endif  // CPU_X86
+
+/* find_ref_locs of an item with at least one block, kept out of
+   find_ref_locs so the instructions do not pay for its stack frame */
+static void scan_ref_locs(const uint8_t *pBytes, size_t size, sig_ea_t start_ea,
+                          sig_ea_t item, sig_ea_t item_end, const sig_ea_t *pRefs, size_t count,
+                          sig_ea_t *pLocs, uint32_t *pRefLens)
+{
+    for (; count > REF_SCAN_MAX; count -= REF_SCAN_MAX)
+    {
+        scan_ref_locs(pBytes, size, start_ea, item, item_end, pRefs, REF_SCAN_MAX,
+                      pLocs, pRefLens);
+        pRefs += REF_SCAN_MAX;
+        pLocs += REF_SCAN_MAX;
+        pRefLens += REF_SCAN_MAX;
+    }
+
+    unsigned int pending = 0;
+    for (size_t r = 0; r < count; r++)
+    {
+        pLocs[r] = SIG_BADADDR;
+        _ASSERTE(pRefs[r] != SIG_BADADDR);
+        if (SIG_BADADDR != pRefs[r])
+        {
+            pending |= 1U << r;
+        }
+    }
+
+    _ASSERTE(item != SIG_BADADDR);
+    _ASSERTE((item >= start_ea) && (item_end - start_ea <= size));
+    if ((0 == pending) || (SIG_BADADDR == item) ||
+        (item < start_ea) || (item_end < item) ||
+        (item_end - start_ea > size))
+    {
+        return;
+    }
+
+    const uint8_t *pItem = pBytes + (item - start_ea);
+    size_t itemSize = (size_t)(item_end - item);
+    size_t offsets[REF_SCAN_MAX];
+    REF_VALUES values[REF_SCAN_MAX];
+
+    memset(values, 0, sizeof(values));
+    for (size_t r = 0; r < count; r++)
+    {
+        sig_ea_t rel = pRefs[r] - item_end;
+        values[r].v64[0] = pRefs[r];
+        values[r].v64[1] = rel;
+        values[r].v32[0] = (uint32_t) pRefs[r];
+
+        // A relative value that does not fit in 32 bits can not match
+        values[r].v32[1] = ((int32_t)rel == (int64_t)rel) ? (uint32_t) rel : (uint32_t) pRefs[r];
+    }
+
+#ifdef __EA64__
+    unsigned int left;
+#ifdef CPU_X86
+    if (g_bRefScanSSE2)
+    {
+        left = scan_ref64_sse2(pItem, itemSize, values, count, pending, offsets);
+    }
+    else
+#endif
+    {
+        left = scan_ref64(pItem, 0, itemSize, values, count, pending, offsets);
+    }
+
+    for (size_t r = 0; r < count; r++)
+    {
+        if ((pending & ~left) & (1U << r))
+        {
+            pLocs[r] = item + offsets[r];
+            pRefLens[r] = 8;
+        }
+    }
+    pending = left;
+#endif
+
+    unsigned int notFound;
+#ifdef CPU_X86
+    if (g_bRefScanSSE2)
+    {
+        notFound = scan_ref32_sse2(pItem, itemSize, values, count, pending, offsets);
+    }
+    else
+#endif
+    {
+        notFound = scan_ref32(pItem, 0, itemSize, values, count, pending, offsets);
+    }
+
+    for (size_t r = 0; r < count; r++)
+    {
+        if ((pending & ~notFound) & (1U << r))
+        {
+            pLocs[r] = item + offsets[r];
+            pRefLens[r] = 4;
+        }
+    }
+}
+
+/**********************************************************************
+* Function:     find_ref_locs
+* Description:
+*   finds the locations of several references made by the same item,
+*   with the same result as calling find_ref_loc for each of them:
+*   the first offset holding the 64 bit absolute or self-relative value
+*   (__EA64__ only), else the first offset holding the 32 bit absolute
+*   or self-relative value
+* Parameters:   const uint8_t *pBytes - function bytes
+*               size_t size - number of function bytes
+*               sig_ea_t start_ea - address of pBytes[0]
+*               sig_ea_t item
+*               sig_ea_t item_end
+*               const sig_ea_t *pRefs - referenced addresses
+*               size_t count
+*               sig_ea_t *pLocs - out: reference locations, SIG_BADADDR
+*               if not found
+*               uint32_t *pRefLens - out: reference lengths
+* Returns:      none
+**********************************************************************/
+void find_ref_locs(const uint8_t *pBytes, size_t size, sig_ea_t start_ea,
+                   sig_ea_t item, sig_ea_t item_end, const sig_ea_t *pRefs, size_t count,
+                   sig_ea_t *pLocs, uint32_t *pRefLens)
+{
+    if ((SIG_BADADDR != item) && (item >= start_ea) && (item_end >= item) &&
+        (item_end - start_ea <= size) && (item_end - item < REF_BLOCK_ITEM))
+    {
+        const uint8_t *pItem = pBytes + (item - start_ea);
+        for (size_t r = 0; r < count; r++)
+        {
+            _ASSERTE(pRefs[r] != SIG_BADADDR);
+            pLocs[r] = SIG_BADADDR;
+            if (SIG_BADADDR != pRefs[r])
+            {
+                pLocs[r] = find_ref_in_item(pItem, item, item_end, pRefs[r], &pRefLens[r]);
+            }
+        }
+        return;
+    }
+
+    scan_ref_locs(pBytes, size, start_ea, item, item_end, pRefs, count, pLocs, pRefLens);
+}
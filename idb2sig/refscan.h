@@ -0,0 +1,41 @@
+#ifndef __IDB2SIG_REFSCAN_H__
+#define __IDB2SIG_REFSCAN_H__
+
+#pragma once
+
+/*
+ * Reference location search in the collected bytes of an item.
+ * Portable, does not call the IDA SDK.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _ASSERTE
+    #include <assert.h>
+    #define _ASSERTE(x) assert(x)
+#endif
+
+#ifdef __EA64__
+typedef uint64_t sig_ea_t;
+#else
+typedef uint32_t sig_ea_t;
+#endif
+
+#define SIG_BADADDR     ((sig_ea_t) -1)
+
+#define REF_SCAN_MAX    4       // references of an item searched in one scan
+
+/* Select the SSE2 scan when the CPU supports it, call it before find_ref_locs */
+void InitRefScan(void);
+
+/* Find one reference, byte by byte, the reference for find_ref_locs */
+sig_ea_t find_ref_loc(const uint8_t *pBytes, size_t size, sig_ea_t start_ea,
+                      sig_ea_t item, sig_ea_t item_end, sig_ea_t _ref, uint32_t *ref_len);
+
+/* Find several references of the same item in one scan */
+void find_ref_locs(const uint8_t *pBytes, size_t size, sig_ea_t start_ea,
+                   sig_ea_t item, sig_ea_t item_end, const sig_ea_t *pRefs, size_t count,
+                   sig_ea_t *pLocs, uint32_t *pRefLens);
+
+#endif  // __IDB2SIG_REFSCAN_H__
@@ -0,0 +1,332 @@
+/*************************************************************************
+    IDB2SIG function collection
+    Everything a pattern line needs is read from the database here: the
+    function bytes, the public names inside the function and the first
+    references of its items. The plugin calls it on the main thread with
+    the open database, the encoders then run on the worker threads.
+*************************************************************************/
+
+#include <string.h>
+#include <algorithm>
+
+#include "sigcollect.h"
+#include "patindex.h"
+
+using namespace std;
+
+/**********************************************************************
+* Function:     add_sig_xref
+* Description:  records a reference made by an item of the function,
+*               with the target name if it should go to the pattern
+* Parameters:   const IDA_DB &db
+*               SIG_BATCH &batch
+*               sig_ea_t item
+*               sig_ea_t ref
+*               bool bAllNames - any target name, not only user names
+* Returns:      none
+**********************************************************************/
+static void add_sig_xref(const IDA_DB &db, SIG_BATCH &batch, sig_ea_t item, sig_ea_t ref,
+                         bool bAllNames)
+{
+    char szName[SIG_NAME_SIZE] = { 0 };
+    const char *pName = db.GetName(ref, szName, sizeof(szName));
+
+    SIG_XREF xref;
+    xref.item = item;
+    xref.itemEnd = db.GetItemEnd(item);
+    xref.target = ref;
+    xref.loc = SIG_BADADDR;
+    xref.bUserName = (0 != (db.GetFlags(ref) & DB_HAS_USER_NAME));
+
+    // Make sure we have a name when all functions mode specified or
+    // it is a user-specified name
+    if ((NULL != pName) && (xref.bUserName || bAllNames))
+    {
+        xref.nameOff = batch.AddName(pName);
+    }
+    else
+    {
+        xref.nameOff = NO_SIG_NAME;
+    }
+
+    batch.AddXref(xref);
+}
+
+/**********************************************************************
+* Function:     collect_func_sig
+* Description:
+*       reads everything make_func_sigs needs from the database: the
+*       function bytes, the public names and the references, and adds
+*       them to the batch
+*       with the SDK_DB it must run on the main thread, the IDA SDK is
+*       not thread safe
+* Parameters:   const SIG_COLLECT &collect
+*               sig_ea_t start_ea
+*               size_t len
+*               SIG_BATCH &batch
+*               bool bDump - for the function dump: any length, and all
+*               names, the user names marked
+* Returns:      true if the function should get a pattern line
+**********************************************************************/
+bool collect_func_sig(const SIG_COLLECT &collect, sig_ea_t start_ea, size_t len,
+                      SIG_BATCH &batch, bool bDump)
+{
+    const IDA_DB &db = *collect.pDb;
+    sig_ea_t ea, ref;
+    uint32_t flags = 0;
+    char szName[SIG_NAME_SIZE] = { 0 };
+    const char *pName = szName;
+
+    _ASSERTE(start_ea != SIG_BADADDR);
+    if (SIG_BADADDR == start_ea)
+    {
+        return false;
+    }
+
+    bool bAllNames = bDump || collect.bAllNames;
+    if (!bDump && (len < collect.minFuncLen))
+    {
+        if (NULL != collect.pDiag)
+        {
+            size_t nameLen = db.GetSegmentName(start_ea, szName, sizeof(szName));
+            collect.pDiag->Add(0, SIG_DIAG_SHORT_FUNC, start_ea, szName, nameLen,
+                               len, collect.minFuncLen);
+        }
+        return false;
+    }
+
+    (void) batch.AddJob(start_ea, (uint32_t) len);
+
+    sig_ea_t end_ea = start_ea + len;
+    ea = start_ea;
+    while ((ea != SIG_BADADDR) && (ea - start_ea < len))
+    {
+        flags = db.GetFlags(ea);
+        if ((0 != (flags & DB_HAS_NAME)) || (bAllNames && (0 != (flags & DB_HAS_ANY_NAME))))
+        {
+            pName = db.GetName(ea, szName, sizeof(szName));
+
+            // Make sure we have a name when all functions mode specified or
+            // it is a user-specified name (valid name & !dummy prefix)
+            bool bUserName = (NULL != pName) && (0 != (flags & DB_HAS_NAME)) &&
+                             db.IsUserName(pName);
+            if ((NULL != pName) && (bUserName || bAllNames))
+            {
+                SIG_PUBLIC pub;
+                pub.ea = ea;
+                pub.bUserName = bUserName;
+                pub.nameOff = batch.AddName(pName);
+                batch.AddPublic(pub);
+            }
+        }
+
+        ref = db.GetFirstDref(ea);
+        if (SIG_BADADDR != ref)
+        {
+            // a data location is referenced
+            add_sig_xref(db, batch, ea, ref, bAllNames);
+
+            // check if there is a second data location ref'd
+            ref = db.GetNextDref(ea, ref);
+            if (SIG_BADADDR != ref)
+            {
+                add_sig_xref(db, batch, ea, ref, bAllNames);
+            }
+        }
+        else
+        {
+            // do we have a code ref?
+            ref = db.GetFirstFcref(ea);
+            if (SIG_BADADDR != ref)
+            {
+                // if so, make sure it is outside of function
+                if ((ref < start_ea) || (ref >= start_ea + len))
+                {
+                    add_sig_xref(db, batch, ea, ref, bAllNames);
+                }
+            }
+        }
+
+        if ((batch.jobs.back().numXrefs > 0) && (batch.xrefs.back().itemEnd > end_ea))
+        {
+            end_ea = batch.xrefs.back().itemEnd;
+        }
+
+        ea = db.NextHead(ea);
+    }
+
+    // Use the function bytes in the snapshot, or copy them, with the tail
+    // of an item crossing the end
+    size_t size = (size_t)(end_ea - start_ea);
+    const uint8_t *pSnapBytes = (NULL != collect.pSnapshot) ?
+                                collect.pSnapshot->GetBytes(start_ea, size) : NULL;
+    if (NULL != pSnapBytes)
+    {
+        batch.SetBytesRef(pSnapBytes, size);
+        return true;
+    }
+
+    db.GetBytes(start_ea, batch.SetBytes(size), size);
+    return true;
+}
+
+/**********************************************************************
+* Function:     capture_snapshot
+* Description:  copies the bytes of all code segments to the snapshot,
+*               so the functions in them need no database reads
+* Parameters:   const IDA_DB &db
+*               SIG_SNAPSHOT &snapshot
+* Returns:      none
+**********************************************************************/
+void capture_snapshot(const IDA_DB &db, SIG_SNAPSHOT &snapshot)
+{
+    const size_t chunkSize = 0x10000;
+    size_t numOfSegs = db.GetSegmentCount();
+
+    snapshot.Clear();
+    snapshot.Reserve(numOfSegs);
+    for (size_t n = 0; n < numOfSegs; n++)
+    {
+        DB_SEGMENT seg;
+        if (!db.GetSegment(n, seg) || !seg.bCode || (seg.endEA <= seg.startEA))
+        {
+            continue;
+        }
+
+        // Chunk by chunk, the bytes which are not loaded are read one by one
+        uint8_t *pBytes = snapshot.AddSegment(seg.startEA, seg.endEA);
+        size_t size = (size_t)(seg.endEA - seg.startEA);
+        for (size_t off = 0; off < size; off += chunkSize)
+        {
+            db.GetBytes(seg.startEA + off, pBytes + off, min(chunkSize, size - off));
+        }
+    }
+    snapshot.Sort();
+}
+
+/**********************************************************************
+* Function:     select_func
+* Description:  gets the i-th function of the function mode
+* Parameters:   const IDA_DB &db
+*               SIG_SELECT_MODE mode
+*               size_t i - below the number of functions, in the entry
+*               point mode the i-th entry point
+*               DB_FUNC &func - out
+* Returns:      false if it is not selected
+**********************************************************************/
+bool select_func(const IDA_DB &db, SIG_SELECT_MODE mode, size_t i, DB_FUNC &func)
+{
+    if (SIG_SELECT_ENTRY_POINT == mode)
+    {
+        // write all entry point functions
+        return db.GetFuncAt(db.GetEntry(i), func);
+    }
+
+    if (!db.GetFunc(i, func))
+    {
+        return false;
+    }
+
+    switch (mode)
+    {
+        case SIG_SELECT_NON_AUTO:   // write all non auto-generated name functions
+            return (0 != (db.GetFlags(func.startEA) & DB_HAS_NAME)) && !func.bLib;
+
+        case SIG_SELECT_LIBRARY:    // write all library functions
+            return func.bLib;
+
+        case SIG_SELECT_PUBLIC:     // write all public function
+            return db.IsPublicName(func.startEA);
+
+        default:
+            return true;
+    }
+}
+
+/**********************************************************************
+* Function:     get_func_flags
+* Description:  gets the flags the command line tool selects the
+*               functions of a dump with
+* Parameters:   const IDA_DB &db
+*               const DB_FUNC &func
+* Returns:      uint8_t SIG_FUNC_*
+**********************************************************************/
+uint8_t get_func_flags(const IDA_DB &db, const DB_FUNC &func)
+{
+    uint8_t funcFlags = 0;
+    if (func.bLib)
+    {
+        funcFlags |= SIG_FUNC_LIB;
+    }
+    if (0 != (db.GetFlags(func.startEA) & DB_HAS_NAME))
+    {
+        funcFlags |= SIG_FUNC_NAMED;
+    }
+    if (db.IsPublicName(func.startEA))
+    {
+        funcFlags |= SIG_FUNC_PUBLIC;
+    }
+    return funcFlags;
+}
+
+/**********************************************************************
+* Function:     collect_db_sigs
+* Description:  encodes the functions of the mode like a plugin run,
+*               the output is the same as the PAT file of that run
+* Parameters:   const IDA_DB &db
+*               const SIG_SELECT &select
+*               WORKER_POOL &workers - started pool
+*               SIG_WRITER &writer - started writer
+*               SIG_REPLAY_STATS *pStats - out
+* Returns:      false if out of memory or writing failed
+**********************************************************************/
+bool collect_db_sigs(const IDA_DB &db, const SIG_SELECT &select, WORKER_POOL &workers,
+                     SIG_WRITER &writer, SIG_REPLAY_STATS *pStats)
+{
+    SIG_SNAPSHOT snapshot;
+    SIG_BATCH batch;
+    PAT_LINE_INDEX lines;
+
+    memset(pStats, 0, sizeof(*pStats));
+    if (select.bSkipDupLines)
+    {
+        batch.pLines = &lines;
+    }
+    capture_snapshot(db, snapshot);
+
+    SIG_COLLECT collect;
+    collect.pDb = &db;
+    collect.pSnapshot = &snapshot;
+    collect.minFuncLen = select.minFuncLen;
+    collect.bAllNames = (SIG_SELECT_ALL == select.mode);
+    collect.pDiag = NULL;
+
+    size_t numOfFuncs = db.GetFuncCount();
+    for (size_t i = 0; i < numOfFuncs; i++)
+    {
+        DB_FUNC func;
+        if (!select_func(db, select.mode, i, func))
+        {
+            continue;
+        }
+
+        size_t len = (size_t)(func.endEA - func.startEA);
+        if (len < select.minFuncLen)
+        {
+            pStats->numShort++;
+        }
+        if (collect_func_sig(collect, func.startEA, len, batch, false) && batch.IsFull() &&
+            !flush_replay_batch(batch, workers, writer, pStats))
+        {
+            return false;
+        }
+    }
+
+    if (!flush_replay_batch(batch, workers, writer, pStats))
+    {
+        return false;
+    }
+
+    // The terminate signature of pat file
+    return (0 == writer.GetSize()) || writer.Append("---\r\n", 5);
+}
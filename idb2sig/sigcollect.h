@@ -0,0 +1,58 @@
+#ifndef __IDB2SIG_SIGCOLLECT_H__
+#define __IDB2SIG_SIGCOLLECT_H__
+
+#pragma once
+
+/*
+ * Function collection of the plugin.
+ * Reads the bytes, the public names and the references of the functions
+ * from an IDA_DB into a SIG_BATCH, and selects the functions of a mode.
+ * The plugin passes the open database, the command line tool and the
+ * benchmark a recorded MEM_DB, so the whole run works on Linux.
+ * Portable, does not call the IDA SDK.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "idadb.h"
+#include "diaglog.h"
+#include "patgen.h"
+#include "snapshot.h"
+
+#define SIG_NAME_SIZE   1024        // longest name read, with the NUL
+
+/* Diagnostic records of a run */
+typedef enum tagSIG_DIAG_REASON {
+    SIG_DIAG_SHORT_FUNC,            // name is the segment, values are the length and the minimum
+    SIG_DIAG_REF_NOT_FOUND,         // addr is the item, values[0] the referenced address
+    SIG_DIAG_COLLISION              // addr is the function, values[0] the other one, see SIG_COLLISION
+} SIG_DIAG_REASON;
+
+/* How the functions of a run are collected */
+typedef struct tagSIG_COLLECT {
+    const IDA_DB *pDb;
+    const SIG_SNAPSHOT *pSnapshot;  // bytes of the code segments, NULL: read the database
+    uint32_t minFuncLen;            // shorter functions get no pattern
+    bool bAllNames;                 // all functions mode, all names go to the pattern
+    DIAG_LOG *pDiag;                // the short functions, NULL: not reported
+} SIG_COLLECT;
+
+/* Add a function to the batch, false if it should get no pattern line */
+bool collect_func_sig(const SIG_COLLECT &collect, sig_ea_t start_ea, size_t len,
+                      SIG_BATCH &batch, bool bDump);
+
+/* Copy the bytes of all code segments */
+void capture_snapshot(const IDA_DB &db, SIG_SNAPSHOT &snapshot);
+
+/* The i-th function of the mode, false if it is not selected */
+bool select_func(const IDA_DB &db, SIG_SELECT_MODE mode, size_t i, DB_FUNC &func);
+
+/* The SIG_FUNC_* flags of a function for the function dump */
+uint8_t get_func_flags(const IDA_DB &db, const DB_FUNC &func);
+
+/* Encode the selected functions of a database to a PAT file, like a plugin run */
+bool collect_db_sigs(const IDA_DB &db, const SIG_SELECT &select, WORKER_POOL &workers,
+                     SIG_WRITER &writer, SIG_REPLAY_STATS *pStats);
+
+#endif  // __IDB2SIG_SIGCOLLECT_H__
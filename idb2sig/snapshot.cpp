@@ -0,0 +1,657 @@
+/*************************************************************************
+    IDB2SIG segment byte snapshot and function dump
+    Replaces the get_many_bytes/get_byte calls of each collected function
+    with one copy of every code segment, read by all workers. The function
+    dump holds everything the plugin reads from the database, so the
+    pattern generation of every function mode can run on Linux.
+
+    File layout, integers in little endian, addresses sizeof(sig_ea_t):
+        "IDB2SIGS", uint32 version, uint32 address size, uint32 segments
+        per segment: start, end, end - start bytes
+        uint32 entries, per entry: start of the function
+        per function: uint8 1, uint8 SIG_FUNC_* flags, start, uint32 len,
+            uint32 bytes length, uint8 inline, the bytes if inline (else
+            in the segments),
+            uint32 publics, per public: ea, uint8 user name,
+                uint16 name length, name
+            uint32 xrefs, per xref: item, item end, target, uint8 user name,
+                uint16 name length (0xFFFF no name), name
+        uint8 0
+*************************************************************************/
+
+#include <string.h>
+#include <algorithm>
+#include <map>
+
+#include "snapshot.h"
+#include "patindex.h"
+
+using namespace std;
+
+#define SNAP_REC_END        0
+#define SNAP_REC_FUNC       1
+#define SNAP_NO_NAME        0xFFFF
+#define SNAP_MAX_NAME       0xFFFE
+
+/* Orders segments by start address */
+static inline bool segment_less(const SIG_SEGMENT &a, const SIG_SEGMENT &b)
+{
+    return (a.startEA < b.startEA);
+}
+
+uint8_t *SIG_SNAPSHOT::AddSegment(sig_ea_t startEA, sig_ea_t endEA)
+{
+    _ASSERTE(startEA <= endEA);
+
+    segments.push_back(SIG_SEGMENT());
+    SIG_SEGMENT &seg = segments.back();
+    seg.startEA = startEA;
+    seg.endEA = endEA;
+    seg.bytes.resize((size_t)(endEA - startEA));
+    return seg.bytes.empty() ? NULL : &seg.bytes[0];
+}
+
+void SIG_SNAPSHOT::Sort()
+{
+    sort(segments.begin(), segments.end(), segment_less);
+}
+
+/**********************************************************************
+* Function:     SIG_SNAPSHOT::GetBytes
+* Description:  finds the segment holding [ea, ea + len)
+* Parameters:   sig_ea_t ea
+*               size_t len
+* Returns:      pointer to the bytes, NULL if they are not all in one
+*               segment of the snapshot
+**********************************************************************/
+const uint8_t *SIG_SNAPSHOT::GetBytes(sig_ea_t ea, size_t len) const
+{
+    // Last segment starting at or before ea
+    size_t lo = 0, hi = segments.size();
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (segments[mid].startEA <= ea)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    if (0 == lo)
+    {
+        return NULL;
+    }
+
+    const SIG_SEGMENT &seg = segments[lo - 1];
+    if ((ea >= seg.endEA) || (len > (size_t)(seg.endEA - ea)) || seg.bytes.empty())
+    {
+        return NULL;
+    }
+
+    return &seg.bytes[(size_t)(ea - seg.startEA)];
+}
+
+size_t SIG_SNAPSHOT::GetSize() const
+{
+    size_t size = 0;
+    for (vector<SIG_SEGMENT>::const_iterator s = segments.begin(); s != segments.end(); s++)
+    {
+        size += s->bytes.size();
+    }
+    return size;
+}
+
+/* Append a value to a record buffer */
+template <class T>
+static inline void put_value(vector<char> &buf, T value)
+{
+    const char *p = (const char *) &value;
+    buf.insert(buf.end(), p, p + sizeof(value));
+}
+
+/* Append a name with its length to a record buffer */
+static void put_name(vector<char> &buf, const char *pName)
+{
+    size_t len = strlen(pName);
+    if (len > SNAP_MAX_NAME)
+    {
+        len = SNAP_MAX_NAME;
+    }
+    put_value(buf, (uint16_t) len);
+    buf.insert(buf.end(), pName, pName + len);
+}
+
+/* Read a value */
+template <class T>
+static inline bool get_value(PFN_SIG_READ pfnRead, void *ctx, T *pValue)
+{
+    return pfnRead(ctx, pValue, sizeof(*pValue));
+}
+
+/* Read and drop len bytes */
+static bool skip_bytes(PFN_SIG_READ pfnRead, void *ctx, size_t len)
+{
+    char buf[4096];
+    while (len > 0)
+    {
+        size_t n = (len < sizeof(buf)) ? len : sizeof(buf);
+        if (!pfnRead(ctx, buf, n))
+        {
+            return false;
+        }
+        len -= n;
+    }
+    return true;
+}
+
+/**********************************************************************
+* Function:     write_snapshot_header
+* Description:  writes the file header, the bytes of all segments and
+*               the entry point functions
+* Parameters:   const SIG_SNAPSHOT &snapshot
+*               PFN_SIG_WRITE pfnWrite
+*               void *ctx
+* Returns:      false if writing failed
+**********************************************************************/
+bool write_snapshot_header(const SIG_SNAPSHOT &snapshot, PFN_SIG_WRITE pfnWrite, void *ctx)
+{
+    vector<char> buf(SIG_SNAPSHOT_MAGIC, SIG_SNAPSHOT_MAGIC + 8);
+    put_value(buf, (uint32_t) SIG_SNAPSHOT_VERSION);
+    put_value(buf, (uint32_t) sizeof(sig_ea_t));
+    put_value(buf, (uint32_t) snapshot.segments.size());
+    if (!pfnWrite(ctx, &buf[0], buf.size()))
+    {
+        return false;
+    }
+
+    for (vector<SIG_SEGMENT>::const_iterator s = snapshot.segments.begin();
+         s != snapshot.segments.end(); s++)
+    {
+        buf.clear();
+        put_value(buf, s->startEA);
+        put_value(buf, s->endEA);
+        if (!pfnWrite(ctx, &buf[0], buf.size()) ||
+            (!s->bytes.empty() && !pfnWrite(ctx, (const char *) &s->bytes[0], s->bytes.size())))
+        {
+            return false;
+        }
+    }
+
+    buf.clear();
+    put_value(buf, (uint32_t) snapshot.entries.size());
+    for (vector<sig_ea_t>::const_iterator e = snapshot.entries.begin();
+         e != snapshot.entries.end(); e++)
+    {
+        put_value(buf, *e);
+    }
+
+    return pfnWrite(ctx, &buf[0], buf.size());
+}
+
+/**********************************************************************
+* Function:     write_snapshot_batch
+* Description:  writes the collected functions of a batch. Their bytes
+*               are written only when they are not in the snapshot.
+* Parameters:   const SIG_BATCH &batch
+*               PFN_SIG_WRITE pfnWrite
+*               void *ctx
+* Returns:      false if writing failed
+**********************************************************************/
+bool write_snapshot_batch(const SIG_BATCH &batch, PFN_SIG_WRITE pfnWrite, void *ctx)
+{
+    vector<char> buf;
+
+    for (size_t i = 0; i < batch.GetCount(); i++)
+    {
+        const FUNC_SIG_JOB &job = batch.jobs[i];
+        bool bInline = (NULL == job.pExtBytes);
+
+        put_value(buf, (uint8_t) SNAP_REC_FUNC);
+        put_value(buf, job.funcFlags);
+        put_value(buf, job.startEA);
+        put_value(buf, job.len);
+        put_value(buf, (uint32_t) job.bytesLen);
+        put_value(buf, (uint8_t) bInline);
+        if (bInline && (job.bytesLen > 0))
+        {
+            const char *p = (const char *) batch.GetBytes(job);
+            buf.insert(buf.end(), p, p + job.bytesLen);
+        }
+
+        put_value(buf, (uint32_t) job.numPublics);
+        for (size_t p = job.firstPublic; p < job.firstPublic + job.numPublics; p++)
+        {
+            put_value(buf, batch.publics[p].ea);
+            put_value(buf, (uint8_t) batch.publics[p].bUserName);
+            put_name(buf, batch.GetName(batch.publics[p].nameOff));
+        }
+
+        put_value(buf, (uint32_t) job.numXrefs);
+        for (size_t x = job.firstXref; x < job.firstXref + job.numXrefs; x++)
+        {
+            const SIG_XREF &xref = batch.xrefs[x];
+            put_value(buf, xref.item);
+            put_value(buf, xref.itemEnd);
+            put_value(buf, xref.target);
+            put_value(buf, (uint8_t) xref.bUserName);
+            if (NO_SIG_NAME == xref.nameOff)
+            {
+                put_value(buf, (uint16_t) SNAP_NO_NAME);
+            }
+            else
+            {
+                put_name(buf, batch.GetName(xref.nameOff));
+            }
+        }
+    }
+
+    return buf.empty() || pfnWrite(ctx, &buf[0], buf.size());
+}
+
+bool write_snapshot_end(PFN_SIG_WRITE pfnWrite, void *ctx)
+{
+    char end = SNAP_REC_END;
+    return pfnWrite(ctx, &end, 1);
+}
+
+/**********************************************************************
+* Function:     read_snapshot_header
+* Description:  reads the file header, the bytes of all segments and the
+*               entry point functions
+* Parameters:   SIG_SNAPSHOT &snapshot
+*               PFN_SIG_READ pfnRead
+*               void *ctx
+*               uint64_t size - bytes left in the file, the counts and
+*               the segment lengths are checked against it before the
+*               buffers are allocated
+* Returns:      false if the file is not a dump of this address size
+**********************************************************************/
+bool read_snapshot_header(SIG_SNAPSHOT &snapshot, PFN_SIG_READ pfnRead, void *ctx,
+                          uint64_t size)
+{
+    const uint64_t headerSize = 8 + 3 * sizeof(uint32_t);
+    const uint64_t segmentSize = 2 * sizeof(sig_ea_t);
+    char magic[8];
+    uint32_t version = 0, eaSize = 0, numSegments = 0, numEntries = 0;
+
+    snapshot.Clear();
+    if ((size < headerSize) ||
+        !pfnRead(ctx, magic, sizeof(magic)) || (0 != memcmp(magic, SIG_SNAPSHOT_MAGIC, 8)) ||
+        !get_value(pfnRead, ctx, &version) || (SIG_SNAPSHOT_VERSION != version) ||
+        !get_value(pfnRead, ctx, &eaSize) || (sizeof(sig_ea_t) != eaSize) ||
+        !get_value(pfnRead, ctx, &numSegments) ||
+        (numSegments > (size - headerSize) / segmentSize))
+    {
+        return false;
+    }
+    uint64_t left = size - headerSize;
+
+    snapshot.Reserve(numSegments);
+    for (uint32_t i = 0; i < numSegments; i++)
+    {
+        sig_ea_t startEA, endEA;
+        if ((left < segmentSize) ||
+            !get_value(pfnRead, ctx, &startEA) || !get_value(pfnRead, ctx, &endEA) ||
+            (endEA < startEA) || ((uint64_t) (endEA - startEA) > left - segmentSize))
+        {
+            return false;
+        }
+        left -= segmentSize + (uint64_t) (endEA - startEA);
+
+        uint8_t *pBytes = snapshot.AddSegment(startEA, endEA);
+        if ((endEA > startEA) && !pfnRead(ctx, pBytes, (size_t)(endEA - startEA)))
+        {
+            return false;
+        }
+    }
+    snapshot.Sort();
+
+    if ((left < sizeof(uint32_t)) || !get_value(pfnRead, ctx, &numEntries) ||
+        (numEntries > (left - sizeof(uint32_t)) / sizeof(sig_ea_t)))
+    {
+        return false;
+    }
+    snapshot.entries.resize(numEntries);
+    return (0 == numEntries) ||
+           pfnRead(ctx, &snapshot.entries[0], numEntries * sizeof(sig_ea_t));
+}
+
+/*
+ * Read a name and add it to the batch name pool when it is kept,
+ * *pNameOff is NO_SIG_NAME when it is dropped
+ */
+static bool read_name(SIG_BATCH &batch, PFN_SIG_READ pfnRead, void *ctx, uint16_t len,
+                      bool bKeep, size_t *pNameOff)
+{
+    char szName[SNAP_MAX_NAME + 1];
+    if ((len > SNAP_MAX_NAME) || ((len > 0) && !pfnRead(ctx, szName, len)))
+    {
+        return false;
+    }
+    szName[len] = '\0';
+    *pNameOff = bKeep ? batch.AddName(szName) : NO_SIG_NAME;
+    return true;
+}
+
+/* Check if the mode selects a function with these flags */
+static bool is_func_selected(const SIG_SELECT &select, uint8_t funcFlags, uint32_t len)
+{
+    if (len < select.minFuncLen)
+    {
+        return false;
+    }
+
+    switch (select.mode)
+    {
+        case SIG_SELECT_NON_AUTO:
+            return (0 != (funcFlags & SIG_FUNC_NAMED)) && (0 == (funcFlags & SIG_FUNC_LIB));
+
+        case SIG_SELECT_LIBRARY:
+            return (0 != (funcFlags & SIG_FUNC_LIB));
+
+        case SIG_SELECT_PUBLIC:
+            return (0 != (funcFlags & SIG_FUNC_PUBLIC));
+
+        default:
+            // Entry points are selected by the caller
+            return true;
+    }
+}
+
+/**********************************************************************
+* Function:     read_snapshot_func
+* Description:  reads one function, and adds it to the batch when the
+*               mode selects it. In the modes other than all functions,
+*               only user-specified names are kept, like in the plugin.
+* Parameters:   SIG_BATCH &batch - must not be full
+*               const SIG_SNAPSHOT &snapshot - holds the function bytes,
+*               must live until the batch is encoded
+*               PFN_SIG_READ pfnRead
+*               void *ctx
+*               uint64_t size - bytes left in the file, the inline bytes
+*               are checked against it before they are allocated
+*               const SIG_SELECT *pSelect - NULL keeps every function and
+*               name as exported
+*               sig_ea_t *pStartEA - out: start of the function
+*               bool *pbEnd - out: the end of the file was read
+* Returns:      false if the file is bad
+**********************************************************************/
+bool read_snapshot_func(SIG_BATCH &batch, const SIG_SNAPSHOT &snapshot,
+                        PFN_SIG_READ pfnRead, void *ctx, uint64_t size,
+                        const SIG_SELECT *pSelect, sig_ea_t *pStartEA, bool *pbEnd)
+{
+    _ASSERTE(!batch.IsFull());
+
+    uint8_t type;
+    *pbEnd = false;
+    *pStartEA = SIG_BADADDR;
+    if (!get_value(pfnRead, ctx, &type))
+    {
+        return false;
+    }
+    if (SNAP_REC_END == type)
+    {
+        *pbEnd = true;
+        return true;
+    }
+
+    sig_ea_t startEA;
+    uint32_t len, bytesLen, count;
+    uint8_t funcFlags, bInline;
+    if ((SNAP_REC_FUNC != type) || !get_value(pfnRead, ctx, &funcFlags) ||
+        !get_value(pfnRead, ctx, &startEA) || !get_value(pfnRead, ctx, &len) ||
+        !get_value(pfnRead, ctx, &bytesLen) || !get_value(pfnRead, ctx, &bInline) ||
+        (bInline && (bytesLen > size)))
+    {
+        return false;
+    }
+    *pStartEA = startEA;
+
+    bool bKeep = (NULL == pSelect) || is_func_selected(*pSelect, funcFlags, len);
+    bool bAllNames = (NULL == pSelect) || (SIG_SELECT_ALL == pSelect->mode);
+
+    if (!bKeep)
+    {
+        // Skip the record, the names are read into the stack buffer
+        if (bInline && !skip_bytes(pfnRead, ctx, bytesLen))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        FUNC_SIG_JOB &job = batch.AddJob(startEA, len);
+        job.funcFlags = funcFlags;
+        if (bInline)
+        {
+            uint8_t *pBytes = batch.SetBytes(bytesLen);
+            if ((bytesLen > 0) && !pfnRead(ctx, pBytes, bytesLen))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            const uint8_t *pBytes = snapshot.GetBytes(startEA, bytesLen);
+            if (NULL == pBytes)
+            {
+                return false;
+            }
+            batch.SetBytesRef(pBytes, bytesLen);
+        }
+    }
+
+    if (!get_value(pfnRead, ctx, &count))
+    {
+        return false;
+    }
+    for (uint32_t p = 0; p < count; p++)
+    {
+        SIG_PUBLIC pub;
+        uint8_t bUserName;
+        uint16_t nameLen;
+        if (!get_value(pfnRead, ctx, &pub.ea) || !get_value(pfnRead, ctx, &bUserName) ||
+            !get_value(pfnRead, ctx, &nameLen))
+        {
+            return false;
+        }
+
+        pub.bUserName = (0 != bUserName);
+        bool bName = bKeep && (bAllNames || pub.bUserName);
+        if (!read_name(batch, pfnRead, ctx, nameLen, bName, &pub.nameOff))
+        {
+            return false;
+        }
+        if (bName)
+        {
+            batch.AddPublic(pub);
+        }
+    }
+
+    if (!get_value(pfnRead, ctx, &count))
+    {
+        return false;
+    }
+    for (uint32_t x = 0; x < count; x++)
+    {
+        SIG_XREF xref;
+        uint8_t bUserName;
+        uint16_t nameLen;
+        if (!get_value(pfnRead, ctx, &xref.item) || !get_value(pfnRead, ctx, &xref.itemEnd) ||
+            !get_value(pfnRead, ctx, &xref.target) || !get_value(pfnRead, ctx, &bUserName) ||
+            !get_value(pfnRead, ctx, &nameLen))
+        {
+            return false;
+        }
+
+        xref.bUserName = (0 != bUserName);
+        xref.loc = SIG_BADADDR;
+        xref.nameOff = NO_SIG_NAME;
+        if ((SNAP_NO_NAME != nameLen) &&
+            !read_name(batch, pfnRead, ctx, nameLen, bKeep && (bAllNames || xref.bUserName),
+                       &xref.nameOff))
+        {
+            return false;
+        }
+        if (bKeep)
+        {
+            batch.AddXref(xref);
+        }
+    }
+
+    return true;
+}
+
+/* A dump in memory */
+typedef struct tagSIG_MEM_FILE {
+    const uint8_t *pData;
+    size_t size;
+    size_t pos;
+} SIG_MEM_FILE;
+
+static bool read_mem_proc(void *ctx, void *pData, size_t len)
+{
+    SIG_MEM_FILE *pFile = (SIG_MEM_FILE *) ctx;
+    if (len > pFile->size - pFile->pos)
+    {
+        return false;
+    }
+    memcpy(pData, pFile->pData + pFile->pos, len);
+    pFile->pos += len;
+    return true;
+}
+
+/* Encode the batch to the output, count and empty it */
+bool flush_replay_batch(SIG_BATCH &batch, WORKER_POOL &workers, SIG_WRITER &writer,
+                        SIG_REPLAY_STATS *pStats)
+{
+    if (!encode_func_sigs(batch, workers, writer))
+    {
+        return false;
+    }
+
+    pStats->numFuncs += batch.GetCount();
+    for (size_t x = 0; x < batch.xrefs.size(); x++)
+    {
+        if (SIG_BADADDR == batch.xrefs[x].loc)
+        {
+            pStats->numRefsNotFound++;
+        }
+    }
+    if (NULL != batch.pLines)
+    {
+        pStats->numDuplicates = batch.pLines->GetDuplicateCount();
+        pStats->numCollisions += batch.collisions.size();
+    }
+
+    batch.Clear();
+    return true;
+}
+
+/**********************************************************************
+* Function:     replay_snapshot
+* Description:  encodes the functions of a dump selected like a plugin
+*               run, the output is the same as the PAT file of that run
+* Parameters:   const uint8_t *pDump - the whole dump file
+*               size_t size
+*               const SIG_SELECT &select
+*               WORKER_POOL &workers - started pool
+*               SIG_WRITER &writer - started writer
+*               SIG_REPLAY_STATS *pStats - out
+* Returns:      false if the file is bad, out of memory or writing failed
+**********************************************************************/
+bool replay_snapshot(const uint8_t *pDump, size_t size, const SIG_SELECT &select,
+                     WORKER_POOL &workers, SIG_WRITER &writer, SIG_REPLAY_STATS *pStats)
+{
+    SIG_MEM_FILE file = { pDump, size, 0 };
+    SIG_SNAPSHOT snapshot;
+    SIG_BATCH batch;
+    PAT_LINE_INDEX lines;
+    sig_ea_t startEA;
+    bool bEnd = false;
+
+    memset(pStats, 0, sizeof(*pStats));
+    if (select.bSkipDupLines)
+    {
+        batch.pLines = &lines;
+    }
+    if (!read_snapshot_header(snapshot, read_mem_proc, &file, file.size))
+    {
+        return false;
+    }
+
+    if (SIG_SELECT_ENTRY_POINT != select.mode)
+    {
+        // Functions in dump order
+        for (;;)
+        {
+            if (!read_snapshot_func(batch, snapshot, read_mem_proc, &file, file.size - file.pos,
+                                    &select, &startEA, &bEnd))
+            {
+                return false;
+            }
+            if (bEnd || batch.IsFull())
+            {
+                if (!flush_replay_batch(batch, workers, writer, pStats))
+                {
+                    return false;
+                }
+            }
+            if (bEnd)
+            {
+                break;
+            }
+        }
+    }
+    else
+    {
+        // Functions in entry order, find their records first
+        map<sig_ea_t, size_t> records;
+        for (;;)
+        {
+            size_t pos = file.pos;
+            if (!read_snapshot_func(batch, snapshot, read_mem_proc, &file, file.size - file.pos,
+                                    NULL, &startEA, &bEnd))
+            {
+                return false;
+            }
+            batch.Clear();
+            if (bEnd)
+            {
+                break;
+            }
+            records[startEA] = pos;
+        }
+
+        for (size_t i = 0; i < snapshot.entries.size(); i++)
+        {
+            map<sig_ea_t, size_t>::const_iterator r = records.find(snapshot.entries[i]);
+            if (r == records.end())
+            {
+                continue;
+            }
+
+            file.pos = r->second;
+            if (!read_snapshot_func(batch, snapshot, read_mem_proc, &file, file.size - file.pos,
+                                    &select, &startEA, &bEnd))
+            {
+                return false;
+            }
+            if (batch.IsFull() && !flush_replay_batch(batch, workers, writer, pStats))
+            {
+                return false;
+            }
+        }
+
+        if (!flush_replay_batch(batch, workers, writer, pStats))
+        {
+            return false;
+        }
+    }
+
+    // The terminate signature of pat file
+    return (0 == writer.GetSize()) || writer.Append("---\r\n", 5);
+}
@@ -0,0 +1,110 @@
+#ifndef __IDB2SIG_SNAPSHOT_H__
+#define __IDB2SIG_SNAPSHOT_H__
+
+#pragma once
+
+/*
+ * Segment byte snapshot and function dump.
+ * The bytes of the code segments are copied from the database once,
+ * before the functions are collected, and the encoders read only from
+ * the snapshot. The plugin can export the snapshot together with all
+ * functions, their flags, names and references, and the command line
+ * tool creates the PAT file of any function mode from it without IDA.
+ * Portable, does not call the IDA SDK.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "patgen.h"
+#include "patout.h"
+#include "threads.h"
+
+#define SIG_SNAPSHOT_MAGIC      "IDB2SIGS"
+#define SIG_SNAPSHOT_VERSION    2
+
+/* The bytes of one database segment */
+struct SIG_SEGMENT
+{
+    sig_ea_t startEA;
+    sig_ea_t endEA;
+    std::vector<uint8_t> bytes;     // endEA - startEA bytes
+};
+
+struct SIG_SNAPSHOT
+{
+    std::vector<SIG_SEGMENT> segments;  // sorted by address, not overlapping
+    std::vector<sig_ea_t> entries;      // entry point functions in entry order
+
+    void Clear()
+    {
+        segments.clear();
+        entries.clear();
+    }
+
+    void Reserve(size_t numSegments)
+    {
+        segments.reserve(numSegments);
+    }
+
+    /* Add a segment, returns the buffer to fill with its bytes */
+    uint8_t *AddSegment(sig_ea_t startEA, sig_ea_t endEA);
+
+    /* Sort the segments after adding them out of order */
+    void Sort();
+
+    /* Bytes [ea, ea + len) if they are all in one segment, else NULL */
+    const uint8_t *GetBytes(sig_ea_t ea, size_t len) const;
+
+    /* Total number of bytes */
+    size_t GetSize() const;
+};
+
+/* The function modes of the plugin, same values as FUNCTION_MODE */
+typedef enum tagSIG_SELECT_MODE {
+    SIG_SELECT_NON_AUTO = 0,        // named, not library functions
+    SIG_SELECT_LIBRARY,             // library functions
+    SIG_SELECT_PUBLIC,              // functions with a public name
+    SIG_SELECT_ENTRY_POINT,         // entry point functions, in entry order
+    SIG_SELECT_ALL,                 // all functions, with all names
+    SIG_SELECT_MODE_MAX = SIG_SELECT_ALL
+} SIG_SELECT_MODE;
+
+/* Selects the functions and names of a dump like a plugin run */
+typedef struct tagSIG_SELECT {
+    SIG_SELECT_MODE mode;
+    uint32_t minFuncLen;            // shorter functions get no pattern
+    bool bSkipDupLines;             // skip the lines equal to an earlier line
+} SIG_SELECT;
+
+/* Counts of a replay */
+typedef struct tagSIG_REPLAY_STATS {
+    size_t numFuncs;                // functions encoded
+    size_t numShort;                // functions shorter than minFuncLen
+    size_t numRefsNotFound;         // references whose location was not found
+    size_t numDuplicates;           // lines equal to an earlier line, not written
+    size_t numCollisions;           // lines with the key of an earlier line and other names
+} SIG_REPLAY_STATS;
+
+/* Function dump: the segments and entries, then the functions batch by batch */
+bool write_snapshot_header(const SIG_SNAPSHOT &snapshot, PFN_SIG_WRITE pfnWrite, void *ctx);
+bool write_snapshot_batch(const SIG_BATCH &batch, PFN_SIG_WRITE pfnWrite, void *ctx);
+bool write_snapshot_end(PFN_SIG_WRITE pfnWrite, void *ctx);
+
+/* The readers check the counts and lengths against size, the bytes left in the file */
+bool read_snapshot_header(SIG_SNAPSHOT &snapshot, PFN_SIG_READ pfnRead, void *ctx,
+                          uint64_t size);
+bool read_snapshot_func(SIG_BATCH &batch, const SIG_SNAPSHOT &snapshot,
+                        PFN_SIG_READ pfnRead, void *ctx, uint64_t size,
+                        const SIG_SELECT *pSelect, sig_ea_t *pStartEA, bool *pbEnd);
+
+/* Encode the collected functions of a replay, count them and empty the batch */
+bool flush_replay_batch(SIG_BATCH &batch, WORKER_POOL &workers, SIG_WRITER &writer,
+                        SIG_REPLAY_STATS *pStats);
+
+/* Encode the functions of a dump in memory to a PAT file */
+bool replay_snapshot(const uint8_t *pDump, size_t size, const SIG_SELECT &select,
+                     WORKER_POOL &workers, SIG_WRITER &writer, SIG_REPLAY_STATS *pStats);
+
+#endif  // __IDB2SIG_SNAPSHOT_H__